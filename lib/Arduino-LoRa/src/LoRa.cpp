@@ -46,11 +46,14 @@
 #define MODE_TX                  0x03
 #define MODE_RX_CONTINUOUS       0x05
 #define MODE_RX_SINGLE           0x06
+#define MODE_CAD                 0x07
 
 // PA config
 #define PA_BOOST                 0x80
 
 // IRQ masks
+#define IRQ_CAD_DETECTED_MASK      0x01
+#define IRQ_CAD_DONE_MASK          0x04
 #define IRQ_TX_DONE_MASK           0x08
 #define IRQ_PAYLOAD_CRC_ERROR_MASK 0x20
 #define IRQ_RX_DONE_MASK           0x40
@@ -63,11 +66,16 @@ LoRaClass::LoRaClass() :
   _ss(LORA_DEFAULT_SS_PIN), _reset(LORA_DEFAULT_RESET_PIN), _dio0(LORA_DEFAULT_DIO0_PIN),
   _frequency(0),
   _packetIndex(0),
+  _packetLength(0),
   _implicitHeaderMode(0),
-  _onReceive(NULL)
+  _txLength(0),
+  _txImplicitHeaderMode(0),
+  _onReceive(NULL),
+  _onCadDone(NULL)
 {
   // overide Stream timeout value
   setTimeout(0);
+  resolveSsPin();
 }
 
 int LoRaClass::begin(long frequency)
@@ -122,6 +130,7 @@ int LoRaClass::begin(long frequency)
   // set base addresses
   writeRegister(REG_FIFO_TX_BASE_ADDR, 0);
   writeRegister(REG_FIFO_RX_BASE_ADDR, 0);
+  _txLength = 0;
 
   // set LNA boost
   writeRegister(REG_LNA, readRegister(REG_LNA) | 0x03);
@@ -171,6 +180,11 @@ int LoRaClass::beginPacket(int implicitHeader)
 
 int LoRaClass::endPacket(bool async)
 {
+  // keep the packet in the FIFO for retransmit(): the next packets are received after it
+  _txLength = readRegister(REG_PAYLOAD_LENGTH);
+  _txImplicitHeaderMode = _implicitHeaderMode;
+  writeRegister(REG_FIFO_RX_BASE_ADDR, _txLength);
+
   // put in TX mode
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
 
@@ -189,6 +203,29 @@ int LoRaClass::endPacket(bool async)
   return 1;
 }
 
+int LoRaClass::retransmit(bool async)
+{
+  // the packet is no longer in the FIFO, it shall be written again
+  if ((_txLength == 0) || isTransmitting()) {
+    return 0;
+  }
+
+  // put in standby mode
+  idle();
+
+  if (_txImplicitHeaderMode) {
+    implicitHeaderMode();
+  } else {
+    explicitHeaderMode();
+  }
+
+  // the packet is still at the TX base address: only the FIFO address and payload length are restored
+  writeRegister(REG_FIFO_ADDR_PTR, 0);
+  writeRegister(REG_PAYLOAD_LENGTH, _txLength);
+
+  return endPacket(async);
+}
+
 bool LoRaClass::isTransmitting()
 {
   if ((readRegister(REG_OP_MODE) & MODE_TX) == MODE_TX) {
@@ -219,6 +256,11 @@ int LoRaClass::parsePacket(int size)
   // clear IRQ's
   writeRegister(REG_IRQ_FLAGS, irqFlags);
 
+  if (_txLength && (irqFlags & IRQ_RX_DONE_MASK) && (irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK)) {
+    // dropped packet, written in the FIFO anyway
+    checkTxOverwrite(readRegister(REG_FIFO_RX_CURRENT_ADDR), readRegister(REG_RX_NB_BYTES));
+  }
+
   if ((irqFlags & IRQ_RX_DONE_MASK) && (irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
     // received a packet
     _packetIndex = 0;
@@ -230,19 +272,31 @@ int LoRaClass::parsePacket(int size)
       packetLength = readRegister(REG_RX_NB_BYTES);
     }
 
+    _packetLength = packetLength;
+
     // set FIFO address to current RX address
-    writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
+    uint8_t rxAddress = readRegister(REG_FIFO_RX_CURRENT_ADDR);
+    checkTxOverwrite(rxAddress, packetLength);
+    writeRegister(REG_FIFO_ADDR_PTR, rxAddress);
+
+    // in continuous receive mode (receive()) the modem keeps listening while the packet is read:
+    // the next packets are written after this one, the 256 bytes FIFO is used as a ring
+    if (readRegister(REG_OP_MODE) != (MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS)) {
+      // put in standby mode
+      idle();
+    }
+  } else {
+    uint8_t mode = readRegister(REG_OP_MODE);
 
-    // put in standby mode
-    idle();
-  } else if (readRegister(REG_OP_MODE) != (MODE_LONG_RANGE_MODE | MODE_RX_SINGLE)) {
-    // not currently in RX mode
+    if ((mode != (MODE_LONG_RANGE_MODE | MODE_RX_SINGLE)) && (mode != (MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS))) {
+      // not currently in RX mode
 
-    // reset FIFO address
-    writeRegister(REG_FIFO_ADDR_PTR, 0);
+      // reset FIFO address
+      writeRegister(REG_FIFO_ADDR_PTR, 0);
 
-    // put in single RX mode
-    writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_SINGLE);
+      // put in single RX mode
+      writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_SINGLE);
+    }
   }
 
   return packetLength;
@@ -304,7 +358,9 @@ size_t LoRaClass::write(const uint8_t *buffer, size_t size)
 
 int LoRaClass::available()
 {
-  return (readRegister(REG_RX_NB_BYTES) - _packetIndex);
+  // length latched when the packet is parsed: in continuous receive mode
+  // REG_RX_NB_BYTES already holds the length of the next packet once it is received
+  return (_packetLength - _packetIndex);
 }
 
 int LoRaClass::read()
@@ -318,6 +374,29 @@ int LoRaClass::read()
   return readRegister(REG_FIFO);
 }
 
+size_t LoRaClass::read(uint8_t *buffer, size_t size)
+{
+  if (size > (size_t)available()) {
+    size = available();
+  }
+
+  _packetIndex += size;
+
+  // burst read: the FIFO pointer advances at each byte of the same SPI transaction
+  selectChip();
+
+  _spi->beginTransaction(_spiSettings);
+  _spi->transfer(REG_FIFO & 0x7f);
+  for (size_t i = 0; i < size; i++) {
+    buffer[i] = _spi->transfer(0x00);
+  }
+  _spi->endTransaction();
+
+  deselectChip();
+
+  return size;
+}
+
 int LoRaClass::peek()
 {
   if (!available()) {
@@ -353,7 +432,25 @@ void LoRaClass::onReceive(void(*callback)(int))
     SPI.usingInterrupt(digitalPinToInterrupt(_dio0));
 #endif
     attachInterrupt(digitalPinToInterrupt(_dio0), LoRaClass::onDio0Rise, RISING);
-  } else {
+  } else if (!_onCadDone) {
+    detachInterrupt(digitalPinToInterrupt(_dio0));
+#ifdef SPI_HAS_NOTUSINGINTERRUPT
+    SPI.notUsingInterrupt(digitalPinToInterrupt(_dio0));
+#endif
+  }
+}
+
+void LoRaClass::onCadDone(void(*callback)(boolean))
+{
+  _onCadDone = callback;
+
+  if (callback) {
+    pinMode(_dio0, INPUT);
+#ifdef SPI_HAS_NOTUSINGINTERRUPT
+    SPI.usingInterrupt(digitalPinToInterrupt(_dio0));
+#endif
+    attachInterrupt(digitalPinToInterrupt(_dio0), LoRaClass::onDio0Rise, RISING);
+  } else if (!_onReceive) {
     detachInterrupt(digitalPinToInterrupt(_dio0));
 #ifdef SPI_HAS_NOTUSINGINTERRUPT
     SPI.notUsingInterrupt(digitalPinToInterrupt(_dio0));
@@ -363,6 +460,8 @@ void LoRaClass::onReceive(void(*callback)(int))
 
 void LoRaClass::receive(int size)
 {
+  writeRegister(REG_DIO_MAPPING_1, 0x00); // DIO0 => RXDONE
+
   if (size > 0) {
     implicitHeaderMode();
 
@@ -375,6 +474,30 @@ void LoRaClass::receive(int size)
 }
 #endif
 
+void LoRaClass::channelActivityDetection()
+{
+  // clear a previous CAD result
+  writeRegister(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+
+  writeRegister(REG_DIO_MAPPING_1, 0x80); // DIO0 => CADDONE
+  writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
+}
+
+int LoRaClass::channelActivityResult()
+{
+  int irqFlags = readRegister(REG_IRQ_FLAGS);
+
+  if ((irqFlags & IRQ_CAD_DONE_MASK) == 0) {
+    // CAD still running
+    return -1;
+  }
+
+  // clear IRQ's
+  writeRegister(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+
+  return (irqFlags & IRQ_CAD_DETECTED_MASK) ? 1 : 0;
+}
+
 void LoRaClass::idle()
 {
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
@@ -383,6 +506,9 @@ void LoRaClass::idle()
 void LoRaClass::sleep()
 {
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
+
+  // the FIFO is cleared in sleep mode
+  _txLength = 0;
 }
 
 void LoRaClass::setTxPower(int level, int outputPin)
@@ -433,6 +559,16 @@ void LoRaClass::setFrequency(long frequency)
   writeRegister(REG_FRF_LSB, (uint8_t)(frf >> 0));
 }
 
+void LoRaClass::setFrf(uint32_t frf)
+{
+  // frequency = frf * 32 MHz / 2^19 = frf * 15625 / 256, within 16 kHz
+  _frequency = (frf >> 8) * 15625;
+
+  writeRegister(REG_FRF_MSB, (uint8_t)(frf >> 16));
+  writeRegister(REG_FRF_MID, (uint8_t)(frf >> 8));
+  writeRegister(REG_FRF_LSB, (uint8_t)(frf >> 0));
+}
+
 int LoRaClass::getSpreadingFactor()
 {
   return readRegister(REG_MODEM_CONFIG_2) >> 4;
@@ -590,6 +726,7 @@ void LoRaClass::setPins(int ss, int reset, int dio0)
   _ss = ss;
   _reset = reset;
   _dio0 = dio0;
+  resolveSsPin();
 }
 
 void LoRaClass::setSPI(SPIClass& spi)
@@ -633,15 +770,22 @@ void LoRaClass::handleDio0Rise()
   // clear IRQ's
   writeRegister(REG_IRQ_FLAGS, irqFlags);
 
-  if ((irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
+  if (irqFlags & IRQ_CAD_DONE_MASK) {
+    if (_onCadDone) {
+      _onCadDone((irqFlags & IRQ_CAD_DETECTED_MASK) != 0);
+    }
+  } else if ((irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
     // received a packet
     _packetIndex = 0;
 
     // read packet length
     int packetLength = _implicitHeaderMode ? readRegister(REG_PAYLOAD_LENGTH) : readRegister(REG_RX_NB_BYTES);
+    _packetLength = packetLength;
 
     // set FIFO address to current RX address
-    writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
+    uint8_t rxAddress = readRegister(REG_FIFO_RX_CURRENT_ADDR);
+    checkTxOverwrite(rxAddress, packetLength);
+    writeRegister(REG_FIFO_ADDR_PTR, rxAddress);
 
     if (_onReceive) {
       _onReceive(packetLength);
@@ -652,6 +796,18 @@ void LoRaClass::handleDio0Rise()
     // https://github.com/sandeepmistry/arduino-LoRa/issues/218
     // https://github.com/sandeepmistry/arduino-LoRa/issues/222
     // writeRegister(REG_FIFO_ADDR_PTR, 0);
+  } else if (_txLength) {
+    // dropped packet, written in the FIFO anyway
+    checkTxOverwrite(readRegister(REG_FIFO_RX_CURRENT_ADDR), readRegister(REG_RX_NB_BYTES));
+  }
+}
+
+void LoRaClass::checkTxOverwrite(uint8_t rxAddress, int length)
+{
+  // packets are received after the packet kept for retransmit(), up to the end of the FIFO,
+  // then from the start of the FIFO: a packet received there overwrites it
+  if ((rxAddress < _txLength) || (rxAddress + length > 256)) {
+    _txLength = 0;
   }
 }
 
@@ -669,18 +825,55 @@ uint8_t LoRaClass::singleTransfer(uint8_t address, uint8_t value)
 {
   uint8_t response;
 
-  digitalWrite(_ss, LOW);
+  selectChip();
 
   _spi->beginTransaction(_spiSettings);
   _spi->transfer(address);
   response = _spi->transfer(value);
   _spi->endTransaction();
 
-  digitalWrite(_ss, HIGH);
+  deselectChip();
 
   return response;
 }
 
+void LoRaClass::resolveSsPin()
+{
+#ifdef __AVR__
+  _ssPort = portOutputRegister(digitalPinToPort(_ss));
+  _ssMask = digitalPinToBitMask(_ss);
+#endif
+}
+
+inline void LoRaClass::selectChip()
+{
+#if defined(LORA_SS_PORT) && defined(LORA_SS_BIT)
+  LORA_SS_PORT &= ~_BV(LORA_SS_BIT);
+#elif defined(__AVR__)
+  // read-modify-write of the port, atomic as in digitalWrite()
+  uint8_t oldSREG = SREG;
+  cli();
+  *_ssPort &= ~_ssMask;
+  SREG = oldSREG;
+#else
+  digitalWrite(_ss, LOW);
+#endif
+}
+
+inline void LoRaClass::deselectChip()
+{
+#if defined(LORA_SS_PORT) && defined(LORA_SS_BIT)
+  LORA_SS_PORT |= _BV(LORA_SS_BIT);
+#elif defined(__AVR__)
+  uint8_t oldSREG = SREG;
+  cli();
+  *_ssPort |= _ssMask;
+  SREG = oldSREG;
+#else
+  digitalWrite(_ss, HIGH);
+#endif
+}
+
 void LoRaClass::onDio0Rise()
 {
   LoRa.handleDio0Rise();
@@ -24,6 +24,16 @@
 #define PA_OUTPUT_RFO_PIN          0
 #define PA_OUTPUT_PA_BOOST_PIN     1
 
+// FRF register value of a frequency in Hz (32 MHz crystal), constant folded when frequency is a constant
+#define LORA_FRF(frequency)        ((uint32_t)(((uint64_t)(frequency) << 19) / 32000000))
+
+// Chip select of every register access.
+// On AVR, the output register and bit mask of the SS pin are resolved once, when the pin is set:
+// a select is a masked port write instead of a digitalWrite() pin lookup.
+// Defining LORA_SS_PORT and LORA_SS_BIT binds SS at compile time, a select is then a single sbi / cbi
+// instruction, e.g. -D LORA_SS_PORT=PORTB -D LORA_SS_BIT=2 for pin 10 of an ATmega328P.
+// They shall match the pin given to setPins().
+
 class LoRaClass : public Stream {
 public:
   LoRaClass();
@@ -33,6 +43,7 @@ public:
 
   int beginPacket(int implicitHeader = false);
   int endPacket(bool async = false);
+  int retransmit(bool async = false);
 
   int parsePacket(int size = 0);
   int packetRssi();
@@ -46,6 +57,7 @@ public:
   // from Stream
   virtual int available();
   virtual int read();
+  size_t read(uint8_t *buffer, size_t size);
   virtual int peek();
   virtual void flush();
 
@@ -53,12 +65,18 @@ public:
   void onReceive(void(*callback)(int));
 
   void receive(int size = 0);
+
+  void onCadDone(void(*callback)(boolean));
 #endif
+  void channelActivityDetection();
+  int channelActivityResult();
+
   void idle();
   void sleep();
 
   void setTxPower(int level, int outputPin = PA_OUTPUT_PA_BOOST_PIN);
   void setFrequency(long frequency);
+  void setFrf(uint32_t frf);
   void setSpreadingFactor(int sf);
   void setSignalBandwidth(long sbw);
   void setCodingRate4(int denominator);
@@ -89,6 +107,7 @@ private:
 
   void handleDio0Rise();
   bool isTransmitting();
+  void checkTxOverwrite(uint8_t rxAddress, int length);
 
   int getSpreadingFactor();
   long getSignalBandwidth();
@@ -98,6 +117,9 @@ private:
   uint8_t readRegister(uint8_t address);
   void writeRegister(uint8_t address, uint8_t value);
   uint8_t singleTransfer(uint8_t address, uint8_t value);
+  void resolveSsPin();
+  void selectChip();
+  void deselectChip();
 
   static void onDio0Rise();
 
@@ -105,12 +127,20 @@ private:
   SPISettings _spiSettings;
   SPIClass* _spi;
   int _ss;
+#ifdef __AVR__
+  volatile uint8_t* _ssPort;
+  uint8_t _ssMask;
+#endif
   int _reset;
   int _dio0;
   long _frequency;
   int _packetIndex;
+  int _packetLength;
   int _implicitHeaderMode;
+  int _txLength;
+  int _txImplicitHeaderMode;
   void (*_onReceive)(int);
+  void (*_onCadDone)(boolean);
 };
 
 extern LoRaClass LoRa;
@@ -0,0 +1,287 @@
+#include <LoRaHomeDictionary.h>
+
+// the whole module is compiled out unless the JSON keys are compressed (-D LH_DICTIONARY)
+#ifdef LH_DICTIONARY
+
+// keys shared with the gateway, separated by '\0', ended by an empty key
+// Append only: the token of a key is its position in the list
+const char LH_DICTIONARY_KEYS[] PROGMEM =
+    "tx\0"
+    "msg\0"
+    "diag\0"
+    "state\0"
+    "value\0"
+    "relay\0"
+    "switch\0"
+    "temperature\0"
+    "humidity\0"
+    "pressure\0"
+    "battery\0"
+    "rssi\0";
+
+// tokenizer states
+const uint8_t LH_DICTIONARY_OUTSIDE = 0;   // outside of any string
+const uint8_t LH_DICTIONARY_STRING = 1;    // in a string which is not a candidate key
+const uint8_t LH_DICTIONARY_KEY = 2;       // in a candidate key, buffered
+const uint8_t LH_DICTIONARY_KEY_DONE = 3;  // candidate key buffered, waiting for ':'
+
+/**
+ * @brief Construct a new LoRaHomeDictionary tokenizer
+ * 
+ * @param buffer where to write the tokenized JSON, NULL to only measure it
+ * @param capacity size of the buffer, string terminator included
+ * @param offset first byte of the tokenized JSON written in the buffer, e.g. the start of a fragment
+ */
+LoRaHomeDictionary::LoRaHomeDictionary(char *buffer, size_t capacity, size_t offset)
+{
+    this->buffer = buffer;
+    this->capacity = capacity;
+    this->offset = offset;
+    this->length = 0;
+    this->state = LH_DICTIONARY_OUTSIDE;
+    this->escape = false;
+    this->previous = 0;
+    this->keyLength = 0;
+}
+
+/**
+ * @brief tokenize the next character of the JSON text
+ * 
+ * @param c the character
+ * @return size_t always 1
+ */
+size_t LoRaHomeDictionary::write(uint8_t c)
+{
+    switch (this->state)
+    {
+    case LH_DICTIONARY_OUTSIDE:
+        if ((c == '"') && ((this->previous == '{') || (this->previous == ',')))
+        {
+            this->state = LH_DICTIONARY_KEY;
+            this->keyLength = 0;
+            return 1;
+        }
+        this->put(c);
+        if (c == '"')
+        {
+            this->state = LH_DICTIONARY_STRING;
+        }
+        this->previous = c;
+        break;
+    case LH_DICTIONARY_STRING:
+        this->put(c);
+        if (this->escape)
+        {
+            this->escape = false;
+        }
+        else if (c == '\\')
+        {
+            this->escape = true;
+        }
+        else if (c == '"')
+        {
+            this->state = LH_DICTIONARY_OUTSIDE;
+            this->previous = c;
+        }
+        break;
+    case LH_DICTIONARY_KEY:
+        if (c == '"')
+        {
+            this->state = LH_DICTIONARY_KEY_DONE;
+        }
+        else if ((c == '\\') || (this->keyLength == LH_DICTIONARY_MAX_KEY_SIZE))
+        {
+            // not in the dictionary, send it as text
+            this->flushKey();
+            this->state = LH_DICTIONARY_STRING;
+            this->write(c);
+        }
+        else
+        {
+            this->key[this->keyLength++] = c;
+        }
+        break;
+    case LH_DICTIONARY_KEY_DONE:
+    {
+        int16_t index = (c == ':') ? findKey(this->key, this->keyLength) : -1;
+        if (index >= 0)
+        {
+            this->put(LH_DICTIONARY_TOKEN + index);
+            this->state = LH_DICTIONARY_OUTSIDE;
+            this->previous = c;
+        }
+        else
+        {
+            this->flushKey();
+            this->put('"');
+            this->state = LH_DICTIONARY_OUTSIDE;
+            this->previous = '"';
+            this->write(c);
+        }
+        break;
+    }
+    }
+    return 1;
+}
+
+/**
+ * @brief terminate the tokenized JSON text
+ * Like serializeJson(), the text is truncated to the capacity of the buffer
+ * 
+ * @return size_t number of bytes of the tokenized JSON written from offset, without terminator
+ */
+size_t LoRaHomeDictionary::end()
+{
+    if (this->buffer == NULL)
+    {
+        return this->length;
+    }
+    size_t size = (this->length > this->offset) ? min(this->length - this->offset, this->capacity - 1) : 0;
+    this->buffer[size] = '\0';
+    return size;
+}
+
+/**
+ * @brief restore the JSON text of a tokenized payload
+ * 
+ * @param input tokenized JSON
+ * @param length number of bytes of input
+ * @param output where to write the JSON text, NUL terminated
+ * @param capacity size of output
+ * @param size set to the number of bytes of the JSON text, without terminator
+ * @return uint8_t LH_EXPAND_OK, or LH_EXPAND_UNKNOWN_TOKEN / LH_EXPAND_OVERFLOW: output is then not usable
+ */
+uint8_t LoRaHomeDictionary::expand(const char *input, size_t length, char *output, size_t capacity, size_t &size)
+{
+    size = 0;
+    bool inString = false;
+    bool escape = false;
+    char previous = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t c = input[i];
+        if (!inString && (c >= LH_DICTIONARY_TOKEN) && ((previous == '{') || (previous == ',')))
+        {
+            uint16_t offset = getKeyOffset(c - LH_DICTIONARY_TOKEN);
+            uint8_t keyLength = strlen_P(&LH_DICTIONARY_KEYS[offset]);
+            if (keyLength == 0)
+            {
+                return LH_EXPAND_UNKNOWN_TOKEN;
+            }
+            if (size + keyLength + 3 >= capacity)
+            {
+                return LH_EXPAND_OVERFLOW;
+            }
+            output[size++] = '"';
+            memcpy_P(&output[size], &LH_DICTIONARY_KEYS[offset], keyLength);
+            size += keyLength;
+            output[size++] = '"';
+            output[size++] = ':';
+            previous = ':';
+            continue;
+        }
+        if (size + 1 >= capacity)
+        {
+            return LH_EXPAND_OVERFLOW;
+        }
+        output[size++] = c;
+        if (inString)
+        {
+            if (escape)
+            {
+                escape = false;
+            }
+            else if (c == '\\')
+            {
+                escape = true;
+            }
+            else if (c == '"')
+            {
+                inString = false;
+            }
+        }
+        else if (c == '"')
+        {
+            inString = true;
+        }
+        previous = c;
+    }
+    output[size] = '\0';
+    return LH_EXPAND_OK;
+}
+
+/**
+ * @brief write a byte of the tokenized JSON, when in the window of the buffer (from offset, up to its capacity)
+ * 
+ * @param c the byte
+ */
+void LoRaHomeDictionary::put(uint8_t c)
+{
+    if ((this->buffer != NULL) && (this->length >= this->offset) && (this->length - this->offset + 1 < this->capacity))
+    {
+        this->buffer[this->length - this->offset] = c;
+    }
+    this->length++;
+}
+
+/**
+ * @brief write the candidate key buffered as text, opening quote included
+ * 
+ */
+void LoRaHomeDictionary::flushKey()
+{
+    this->put('"');
+    for (uint8_t i = 0; i < this->keyLength; i++)
+    {
+        this->put(this->key[i]);
+    }
+}
+
+/**
+ * @brief look for a key in the dictionary
+ * 
+ * @param key the key, not NUL terminated
+ * @param keyLength number of characters of the key
+ * @return int16_t index of the key, -1 if not found
+ */
+int16_t LoRaHomeDictionary::findKey(const char *key, uint8_t keyLength)
+{
+    uint16_t offset = 0;
+    for (uint8_t index = 0; index < LH_DICTIONARY_TOKEN; index++)
+    {
+        uint8_t entryLength = strlen_P(&LH_DICTIONARY_KEYS[offset]);
+        if (entryLength == 0)
+        {
+            break;
+        }
+        if ((entryLength == keyLength) && (memcmp_P(key, &LH_DICTIONARY_KEYS[offset], keyLength) == 0))
+        {
+            return index;
+        }
+        offset += entryLength + 1;
+    }
+    return -1;
+}
+
+/**
+ * @brief offset of a key in LH_DICTIONARY_KEYS
+ * 
+ * @param index index of the key
+ * @return uint16_t offset, of the empty end key if index is out of the dictionary
+ */
+uint16_t LoRaHomeDictionary::getKeyOffset(uint8_t index)
+{
+    uint16_t offset = 0;
+    for (uint8_t i = 0; i < index; i++)
+    {
+        uint8_t entryLength = strlen_P(&LH_DICTIONARY_KEYS[offset]);
+        if (entryLength == 0)
+        {
+            break;
+        }
+        offset += entryLength + 1;
+    }
+    return offset;
+}
+
+#endif
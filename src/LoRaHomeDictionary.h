@@ -0,0 +1,51 @@
+#ifndef LORAHOMEDICTIONARY_H
+#define LORAHOMEDICTIONARY_H
+
+#include <Arduino.h>
+
+// token of the key i of the dictionary: LH_DICTIONARY_TOKEN + i. Bytes >= 0x80 never start a JSON key or value
+const uint8_t LH_DICTIONARY_TOKEN = 0x80;
+// longer keys are always sent as text
+const uint8_t LH_DICTIONARY_MAX_KEY_SIZE = 16;
+// RX buffer of the expanded JSON payload. A full frame of tokens expands to several times its size:
+// larger payloads are rejected with LH_EXPAND_OVERFLOW
+const uint8_t LH_DICTIONARY_EXPANDED_SIZE = 192;
+
+// verdicts of expand()
+const uint8_t LH_EXPAND_OK = 0;
+const uint8_t LH_EXPAND_UNKNOWN_TOKEN = 1; // token not in the dictionary of the node
+const uint8_t LH_EXPAND_OVERFLOW = 2;      // JSON text larger than the output buffer
+
+/**
+ * @brief JSON key compression with a dictionary shared with the gateway
+ * As a Print, tokenizes the JSON text written into it by serializeJson: each "key": found
+ * in the dictionary is replaced by its 1 byte token. e.g. {"tx":12} (9 bytes) becomes {<0x80>12} (5 bytes).
+ * expand() restores the JSON text of a tokenized payload.
+ * A token is only recognized where a key is expected, right after '{' or ',' outside of a string.
+ */
+class LoRaHomeDictionary : public Print
+{
+public:
+    LoRaHomeDictionary(char *buffer, size_t capacity, size_t offset = 0);
+    size_t write(uint8_t c);
+    size_t end();
+    static uint8_t expand(const char *input, size_t length, char *output, size_t capacity, size_t &size);
+
+private:
+    void put(uint8_t c);
+    void flushKey();
+    static int16_t findKey(const char *key, uint8_t keyLength);
+    static uint16_t getKeyOffset(uint8_t index);
+
+    char *buffer;
+    size_t capacity;
+    size_t offset;
+    size_t length;
+    uint8_t state;
+    bool escape;
+    char previous;
+    char key[LH_DICTIONARY_MAX_KEY_SIZE];
+    uint8_t keyLength;
+};
+
+#endif
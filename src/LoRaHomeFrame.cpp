@@ -1,16 +1,8 @@
 #include <LoRaHomeFrame.h>
+#include <LoRaHomeLog.h>
 
-
-
-//#define DEBUG
-
-#ifdef DEBUG
-#define DEBUG_MSG(x) Serial.println(F(x))
-#define DEBUG_MSG_VAR(x) Serial.println(x)
-#else
-#define DEBUG_MSG(x) // define empty, so macro does nothing
-#endif
-
+// log events of this file
+#define LH_LOG_MODULE LH_LOG_MODULE_FRAME
 
 /**
  * @brief Construct a new LoRaHomeFrame:: LoRaHomeFrame object
@@ -23,6 +15,10 @@ LoRaHomeFrame::LoRaHomeFrame()
     this->nodeIdRecipient = 0;
     this->messageType = 0;
     this->jsonPayload[0] = '\0';
+    this->payloadSize = 0;
+    this->fragment = 0;
+    this->withStats = false;
+    this->compressed = false;
     this->counter = 0;
 }
 
@@ -41,36 +37,133 @@ LoRaHomeFrame::LoRaHomeFrame(uint16_t networkID, uint8_t nodeIdEmitter, uint8_t
     this->nodeIdRecipient = nodeIdRecipient;
     this->messageType = messageType;
     this->jsonPayload[0] = '\0';
+    this->payloadSize = 0;
+    this->fragment = 0;
+    this->withStats = false;
+    this->compressed = false;
     this->counter = counter;
 }
 
 /**
  * @brief serialize a LoRaHomeFrame into the given txBuffer
  * the size of the txBuffer shall be large enough to welcome the LoRaHomeFrame
+ * payloadSize shall be set to the number of bytes of jsonPayload to be sent
  * 
  * @param txBuffer 
  * @return uint8_t 
  */
 uint8_t LoRaHomeFrame::serialize(uint8_t *txBuffer)
 {
-    DEBUG_MSG("LoRaHomeFrame::serialize");
+    LH_LOG(LH_LOG_DEBUG, "LoRaHomeFrame::serialize");
+    uint8_t messageType = this->messageType;
+    uint8_t payloadIndex = LH_FRAME_INDEX_PAYLOAD;
+    if (this->isFragment())
+    {
+        messageType |= LH_MSG_TYPE_FRAGMENT_FLAG;
+        txBuffer[LH_FRAME_INDEX_FRAGMENT] = this->fragment;
+        payloadIndex += LH_FRAME_FRAGMENT_HEADER_SIZE;
+    }
+    if (this->withStats)
+    {
+        messageType |= LH_MSG_TYPE_STATS_FLAG;
+    }
+    if (this->compressed)
+    {
+        messageType |= LH_MSG_TYPE_COMPRESSED_FLAG;
+    }
+#ifdef LH_SECURITY
+    messageType |= LH_MSG_TYPE_SECURED_FLAG;
+#endif
     txBuffer[LH_FRAME_INDEX_EMITTER] = this->nodeIdEmitter;
     txBuffer[LH_FRAME_INDEX_RECIPIENT] = this->nodeIdRecipient;
-    txBuffer[LH_FRAME_INDEX_MESSAGE_TYPE] = this->messageType;
+    txBuffer[LH_FRAME_INDEX_MESSAGE_TYPE] = messageType;
     txBuffer[LH_FRAME_INDEX_NETWORK_ID] = (uint8_t)(this->networkID & 0xff);
     txBuffer[LH_FRAME_INDEX_NETWORK_ID + 1] = (uint8_t)((this->networkID >> 8)) & 0xff;
     txBuffer[LH_FRAME_INDEX_COUNTER] = (uint8_t)(this->counter & 0xff);
     txBuffer[LH_FRAME_INDEX_COUNTER + 1] = (uint8_t)((this->counter >> 8)) & 0xff;
-    uint8_t payloadSize = strlen(this->jsonPayload);
-    txBuffer[LH_FRAME_INDEX_PAYLOAD_SIZE] = payloadSize;
-    if (payloadSize > 0)
+    txBuffer[LH_FRAME_INDEX_PAYLOAD_SIZE] = this->payloadSize;
+    if (this->payloadSize > 0)
+    {
+        memcpy((char *)&txBuffer[payloadIndex], this->jsonPayload, this->payloadSize);
+    }
+    uint8_t size = payloadIndex + this->payloadSize;
+#ifdef LH_SECURITY
+    // encrypt in place, then authenticate header + encrypted payload
+    loraHomeSecurity.crypt(txBuffer, &txBuffer[payloadIndex], this->payloadSize);
+    loraHomeSecurity.computeMIC(txBuffer, size, &txBuffer[size]);
+#endif
+    size += LH_FRAME_MIC_SIZE;
+    this->crc16 = crc16_ccitt(txBuffer, size);
+    txBuffer[size++] = this->crc16 & 0xff;
+    txBuffer[size++] = (this->crc16 >> 8) & 0xff;
+    return size;
+}
+
+/**
+ * @brief make this frame a fragment of a larger message
+ * 
+ * @param index index of the fragment, starting from 0
+ * @param count number of fragments of the message, up to LH_FRAGMENT_MAX_COUNT
+ */
+void LoRaHomeFrame::setFragment(uint8_t index, uint8_t count)
+{
+    this->fragment = (index << 4) | ((count - 1) & 0x0f);
+}
+
+/**
+ * @brief indicate whether the frame is a fragment of a larger message
+ * 
+ * @return true if fragmented
+ */
+bool LoRaHomeFrame::isFragment()
+{
+    return this->fragment != 0;
+}
+
+/**
+ * @brief Get the index of the fragment
+ * 
+ * @return uint8_t index, from 0 to getFragmentCount() - 1
+ */
+uint8_t LoRaHomeFrame::getFragmentIndex()
+{
+    return this->fragment >> 4;
+}
+
+/**
+ * @brief Get the number of fragments of the message
+ * 
+ * @return uint8_t 1 if the frame is not fragmented
+ */
+uint8_t LoRaHomeFrame::getFragmentCount()
+{
+    return (this->fragment & 0x0f) + 1;
+}
+
+/**
+ * @brief set the bitmap payload of a fragment or window ACK
+ * 
+ * @param bitmap received fragments / counters
+ */
+void LoRaHomeFrame::setAckBitmap(uint16_t bitmap)
+{
+    this->jsonPayload[0] = bitmap & 0xff;
+    this->jsonPayload[1] = (bitmap >> 8) & 0xff;
+    this->payloadSize = LH_ACK_BITMAP_SIZE;
+}
+
+/**
+ * @brief get the bitmap payload of a fragment or window ACK
+ * 
+ * @return uint16_t the bitmap, 0 if the frame does not carry one
+ */
+uint16_t LoRaHomeFrame::getAckBitmap()
+{
+    if (this->payloadSize != LH_ACK_BITMAP_SIZE)
     {
-        memcpy((char *)&txBuffer[LH_FRAME_INDEX_PAYLOAD], this->jsonPayload, payloadSize);
+        return 0;
     }
-    this->crc16 = crc16_ccitt(txBuffer, LH_FRAME_HEADER_SIZE + payloadSize);
-    txBuffer[LH_FRAME_HEADER_SIZE + payloadSize + LH_FRAME_FOOTER_SIZE - 2] = this->crc16 & 0xff;
-    txBuffer[LH_FRAME_HEADER_SIZE + payloadSize + LH_FRAME_FOOTER_SIZE - 1] = (this->crc16 >> 8) & 0xff;
-    return LH_FRAME_HEADER_SIZE + payloadSize + LH_FRAME_FOOTER_SIZE;
+    return (uint8_t)this->jsonPayload[0] | ((uint8_t)this->jsonPayload[1] << 8);
 }
 
 /**
@@ -83,16 +176,16 @@ uint8_t LoRaHomeFrame::serialize(uint8_t *txBuffer)
  */
 bool LoRaHomeFrame::checkCRC(uint8_t *rawBytesWithCRC, uint8_t length)
 {
-    DEBUG_MSG("LoRaHomeFrame::checkCRC");
+    LH_LOG(LH_LOG_DEBUG, "LoRaHomeFrame::checkCRC");
     // check if packet is potentially valid. At least 11 bytes
     if (length < LH_FRAME_MIN_SIZE)
     {
-        DEBUG_MSG("--- bad packet received too small");
+        LH_LOG(LH_LOG_WARN, "--- bad packet received too small");
         return false;
     }
     if (length > LH_FRAME_MAX_SIZE)
     {
-        DEBUG_MSG("--- bad packet received too big");
+        LH_LOG(LH_LOG_WARN, "--- bad packet received too big");
         return false;
     }
     // check CRC - last 2 bytes should contain CRC16
@@ -104,13 +197,33 @@ bool LoRaHomeFrame::checkCRC(uint8_t *rawBytesWithCRC, uint8_t length)
     // if CRC16 not valid, ignore LoRa message
     if (rx_crc16 != crc16)
     {
-        DEBUG_MSG("--- CRC Error");
+        LH_LOG(LH_LOG_WARN, "--- CRC Error");
         return false;
     }
-    DEBUG_MSG("--- valid CRC");
+    LH_LOG(LH_LOG_INFO, "--- valid CRC");
     return true;
 }
 
+/**
+ * @brief radio sync word of a network, so that the radio drops the frames of the other networks
+ * The network ID is folded into two nibbles from 1 to 7, skipping 0x12 and 0x34 (LoRaWAN private / public).
+ * Gateway and nodes of a network shall use the same derivation.
+ * 
+ * @param networkID the network ID
+ * @return uint8_t the sync word
+ */
+uint8_t LoRaHomeFrame::getSyncWord(uint16_t networkID)
+{
+    uint8_t folded = (networkID & 0xff) ^ (networkID >> 8);
+    uint8_t high = 1 + ((folded >> 4) % 7);
+    uint8_t low = 1 + ((folded & 0x0f) % 7);
+    if (((high == 1) && (low == 2)) || ((high == 3) && (low == 4)))
+    {
+        high++;
+    }
+    return (high << 4) | low;
+}
+
 /**
  * @brief Create a LoRaHomeFrame from a raw bytes message
  * 
@@ -123,33 +236,194 @@ bool LoRaHomeFrame::checkCRC(uint8_t *rawBytesWithCRC, uint8_t length)
  */
 bool LoRaHomeFrame::createFromRxMessage(uint8_t *rawBytesWithCRC, uint8_t length, bool checkCRC)
 {
-    DEBUG_MSG("LoRaHomeFrame::createFromRxMessage");
-    if (checkCRC)
+    LH_LOG(LH_LOG_DEBUG, "LoRaHomeFrame::createFromRxMessage");
+    LoRaHomeFrameDecoder decoder;
+    decoder.begin(*this, length, checkCRC);
+    for (uint8_t i = 0; i < length; i++)
     {
-        if (!this->checkCRC(rawBytesWithCRC, length))
+        decoder.push(rawBytesWithCRC[i]);
+    }
+    return decoder.end() == LH_DECODE_OK;
+}
+
+/**
+ * @brief start decoding a received frame
+ * 
+ * @param frame filled with the frame decoded
+ * @param length length of the frame, CRC included
+ * @param checkCRC indicate whether the CRC should be checked or not
+ */
+void LoRaHomeFrameDecoder::begin(LoRaHomeFrame &frame, uint8_t length, bool checkCRC)
+{
+    this->frame = &frame;
+    // the bytes of a frame out of bounds are ignored, end() reports it as a CRC error
+    this->length = ((length < LH_FRAME_MIN_SIZE) || (length > LH_FRAME_MAX_SIZE)) ? 0 : length;
+    this->index = 0;
+    this->rawMessageType = 0;
+    this->payloadIndex = LH_FRAME_INDEX_PAYLOAD;
+    this->checkCRC = checkCRC;
+    this->crc16 = 0xFFFF;
+    this->rxCRC16 = 0;
+    frame.fragment = 0;
+    frame.payloadSize = 0;
+#ifdef LH_SECURITY
+    loraHomeSecurity.beginMIC(this->mic);
+#endif
+}
+
+/**
+ * @brief decode the next bytes of the frame, e.g. a burst read from the radio FIFO
+ * 
+ * @param data bytes read from the radio
+ * @param length number of bytes
+ */
+void LoRaHomeFrameDecoder::push(const uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        this->push(data[i]);
+    }
+}
+
+/**
+ * @brief decode the next byte of the frame
+ * 
+ * @param data byte read from the radio
+ */
+void LoRaHomeFrameDecoder::push(uint8_t data)
+{
+    uint8_t i = this->index;
+    if (i >= this->length)
+    {
+        return;
+    }
+    this->index++;
+    // the CRC covers all the bytes but itself, the MIC the bytes before it
+    if (i < this->length - 2)
+    {
+        this->crc16 = LoRaHomeFrame::crc16_update(this->crc16, data);
+    }
+    else
+    {
+        this->rxCRC16 |= (uint16_t)data << ((i == this->length - 2) ? 0 : 8);
+        return;
+    }
+#ifdef LH_SECURITY
+    if (i >= this->length - LH_FRAME_FOOTER_SIZE)
+    {
+        this->rxMIC[i - (this->length - LH_FRAME_FOOTER_SIZE)] = data;
+        return;
+    }
+    loraHomeSecurity.updateMIC(this->mic, data);
+#endif
+    LoRaHomeFrame *frame = this->frame;
+    switch (i)
+    {
+    case LH_FRAME_INDEX_EMITTER:
+        frame->nodeIdEmitter = data;
+        break;
+    case LH_FRAME_INDEX_RECIPIENT:
+        frame->nodeIdRecipient = data;
+        break;
+    case LH_FRAME_INDEX_MESSAGE_TYPE:
+        this->rawMessageType = data;
+        if (data & LH_MSG_TYPE_FRAGMENT_FLAG)
+        {
+            this->payloadIndex += LH_FRAME_FRAGMENT_HEADER_SIZE;
+        }
+        break;
+    case LH_FRAME_INDEX_NETWORK_ID:
+        frame->networkID = data;
+        break;
+    case LH_FRAME_INDEX_NETWORK_ID + 1:
+        frame->networkID |= data << 8;
+        break;
+    case LH_FRAME_INDEX_COUNTER:
+        frame->counter = data;
+        break;
+    case LH_FRAME_INDEX_COUNTER + 1:
+        frame->counter |= data << 8;
+        break;
+    case LH_FRAME_INDEX_PAYLOAD_SIZE:
+        frame->payloadSize = data;
+        break;
+    default:
+        if (i < this->payloadIndex)
+        {
+            frame->fragment = data;
+        }
+        else if (i - this->payloadIndex < LH_FRAME_MAX_PAYLOAD_SIZE)
         {
-            return false;
+            // bytes past the payload size are overwritten by the string terminator or rejected by end()
+            frame->jsonPayload[i - this->payloadIndex] = data;
         }
+        break;
     }
-    // TODO should check whether data are valid or not?
-    this->networkID = rawBytesWithCRC[LH_FRAME_INDEX_NETWORK_ID] | (rawBytesWithCRC[LH_FRAME_INDEX_NETWORK_ID + 1] << 8);
-    this->nodeIdEmitter = rawBytesWithCRC[LH_FRAME_INDEX_EMITTER];
-    this->nodeIdRecipient = rawBytesWithCRC[LH_FRAME_INDEX_RECIPIENT];
-    this->messageType = rawBytesWithCRC[LH_FRAME_INDEX_MESSAGE_TYPE];
-    this->counter = rawBytesWithCRC[LH_FRAME_INDEX_COUNTER] | (rawBytesWithCRC[LH_FRAME_INDEX_COUNTER + 1] << 8);
-    this->payloadSize = rawBytesWithCRC[LH_FRAME_INDEX_PAYLOAD_SIZE];
-    if (this->payloadSize > LH_FRAME_MAX_PAYLOAD_SIZE)
+}
+
+/**
+ * @brief end decoding the frame: check CRC, MIC and payload size, then decrypt the payload
+ * 
+ * @return uint8_t LH_DECODE_OK if the frame is valid, LH_DECODE_CRC_ERROR or LH_DECODE_INVALID otherwise
+ */
+uint8_t LoRaHomeFrameDecoder::end()
+{
+    LoRaHomeFrame *frame = this->frame;
+    if ((this->length == 0) || (this->index != this->length))
     {
-        DEBUG_MSG("--- invalid payload size");
-        return false;
+        LH_LOG(LH_LOG_WARN, "--- bad packet received, wrong size");
+        return LH_DECODE_CRC_ERROR;
     }
-    // copy the json payload if any
-    if (this->payloadSize != 0)
+    if (this->checkCRC && (this->crc16 != this->rxCRC16))
     {
-        memcpy(this->jsonPayload, &rawBytesWithCRC[LH_FRAME_INDEX_PAYLOAD], rawBytesWithCRC[LH_FRAME_INDEX_PAYLOAD_SIZE]);
-        this->jsonPayload[this->payloadSize] = '\0';
+        LH_LOG(LH_LOG_WARN, "--- CRC Error");
+        return LH_DECODE_CRC_ERROR;
     }
-    return true;
+    uint8_t rawMessageType = this->rawMessageType;
+#ifdef LH_SECURITY
+    if ((rawMessageType & LH_MSG_TYPE_SECURED_FLAG) == 0)
+    {
+        LH_LOG(LH_LOG_WARN, "--- unsecured frame rejected");
+        return LH_DECODE_INVALID;
+    }
+    if (!loraHomeSecurity.checkMIC(this->mic, this->rxMIC))
+    {
+        LH_LOG(LH_LOG_WARN, "--- MIC Error");
+        return LH_DECODE_INVALID;
+    }
+#else
+    if (rawMessageType & LH_MSG_TYPE_SECURED_FLAG)
+    {
+        LH_LOG(LH_LOG_WARN, "--- secured frame not supported");
+        return LH_DECODE_INVALID;
+    }
+#endif
+    frame->messageType = rawMessageType & ~(LH_MSG_TYPE_SECURED_FLAG | LH_MSG_TYPE_FRAGMENT_FLAG | LH_MSG_TYPE_STATS_FLAG | LH_MSG_TYPE_COMPRESSED_FLAG);
+    frame->withStats = (rawMessageType & LH_MSG_TYPE_STATS_FLAG) != 0;
+    frame->compressed = (rawMessageType & LH_MSG_TYPE_COMPRESSED_FLAG) != 0;
+    // keep room for the string terminator
+    if ((frame->payloadSize >= LH_FRAME_MAX_PAYLOAD_SIZE) || (this->payloadIndex + frame->payloadSize + LH_FRAME_FOOTER_SIZE > this->length))
+    {
+        LH_LOG(LH_LOG_WARN, "--- invalid payload size");
+        return LH_DECODE_INVALID;
+    }
+#ifdef LH_SECURITY
+    if (frame->payloadSize != 0)
+    {
+        // the nonce is made of the raw header bytes, rebuilt from the fields decoded
+        uint8_t header[LH_FRAME_INDEX_PAYLOAD_SIZE];
+        header[LH_FRAME_INDEX_EMITTER] = frame->nodeIdEmitter;
+        header[LH_FRAME_INDEX_RECIPIENT] = frame->nodeIdRecipient;
+        header[LH_FRAME_INDEX_MESSAGE_TYPE] = rawMessageType;
+        header[LH_FRAME_INDEX_NETWORK_ID] = (uint8_t)(frame->networkID & 0xff);
+        header[LH_FRAME_INDEX_NETWORK_ID + 1] = (uint8_t)(frame->networkID >> 8);
+        header[LH_FRAME_INDEX_COUNTER] = (uint8_t)(frame->counter & 0xff);
+        header[LH_FRAME_INDEX_COUNTER + 1] = (uint8_t)(frame->counter >> 8);
+        loraHomeSecurity.crypt(header, (uint8_t *)frame->jsonPayload, frame->payloadSize);
+    }
+#endif
+    frame->jsonPayload[frame->payloadSize] = '\0';
+    return LH_DECODE_OK;
 }
 
 /**
@@ -168,16 +442,29 @@ uint16_t LoRaHomeFrame::crc16_ccitt(uint8_t *data, unsigned int data_len)
 
     for (unsigned int i = 0; i < data_len; ++i)
     {
-        uint16_t dbyte = data[i];
-        crc ^= dbyte << 8;
+        crc = crc16_update(crc, data[i]);
+    }
+    return crc;
+}
 
-        for (unsigned char j = 0; j < 8; ++j)
-        {
-            uint16_t mix = crc & 0x8000;
-            crc = (crc << 1);
-            if (mix)
-                crc = crc ^ 0x1021;
-        }
+/**
+ * @brief add a byte to a CRC16 ccitt, initial value 0xFFFF
+ * 
+ * @param crc CRC of the previous bytes
+ * @param data next byte
+ * @return uint16_t 
+ */
+uint16_t LoRaHomeFrame::crc16_update(uint16_t crc, uint8_t data)
+{
+    uint16_t dbyte = data;
+    crc ^= dbyte << 8;
+
+    for (unsigned char j = 0; j < 8; ++j)
+    {
+        uint16_t mix = crc & 0x8000;
+        crc = (crc << 1);
+        if (mix)
+            crc = crc ^ 0x1021;
     }
     return crc;
 }
\ No newline at end of file
@@ -2,9 +2,15 @@
 #define LORAHOMEFRAME_H
 
 #include <Arduino.h>
+#include <LoRaHomeSecurity.h>
 
 const uint8_t LH_FRAME_HEADER_SIZE = 8;
-const uint8_t LH_FRAME_FOOTER_SIZE = 2; // only CRC for now. TODO: add security
+#ifdef LH_SECURITY
+const uint8_t LH_FRAME_MIC_SIZE = LH_MIC_SIZE; // truncated AES-CMAC, right before the CRC
+#else
+const uint8_t LH_FRAME_MIC_SIZE = 0;
+#endif
+const uint8_t LH_FRAME_FOOTER_SIZE = 2 + LH_FRAME_MIC_SIZE; // CRC16, preceded by the MIC when security is enabled
 const uint8_t LH_FRAME_MAX_PAYLOAD_SIZE = 128;
 const uint8_t LH_FRAME_MIN_SIZE = LH_FRAME_HEADER_SIZE + LH_FRAME_FOOTER_SIZE;
 const uint8_t LH_FRAME_ACK_SIZE = LH_FRAME_HEADER_SIZE + LH_FRAME_FOOTER_SIZE;
@@ -17,6 +23,26 @@ const uint8_t LH_FRAME_INDEX_NETWORK_ID = 3;
 const uint8_t LH_FRAME_INDEX_COUNTER = 5;
 const uint8_t LH_FRAME_INDEX_PAYLOAD_SIZE = 7; // 2 bytes
 const uint8_t LH_FRAME_INDEX_PAYLOAD = 8;
+// fragmented frames only: fragment byte inserted before the payload
+const uint8_t LH_FRAME_INDEX_FRAGMENT = 8;
+
+// fragment byte: index of the fragment in the 4 MSB, number of fragments - 1 in the 4 LSB
+const uint8_t LH_FRAME_FRAGMENT_HEADER_SIZE = 1;
+const uint8_t LH_FRAGMENT_MAX_COUNT = 16;
+// keep room for the fragment byte and the string terminator of jsonPayload
+const uint8_t LH_FRAGMENT_PAYLOAD_SIZE = LH_FRAME_MAX_PAYLOAD_SIZE - LH_FRAME_FRAGMENT_HEADER_SIZE - 1;
+
+// Max number of fragments of a message. 1 disables fragmentation (-D LH_MAX_FRAGMENTS=n to change)
+#ifndef LH_MAX_FRAGMENTS
+#define LH_MAX_FRAGMENTS 1
+#endif
+static_assert((LH_MAX_FRAGMENTS >= 1) && (LH_MAX_FRAGMENTS <= LH_FRAGMENT_MAX_COUNT), "LH_MAX_FRAGMENTS shall be 1 to 16 (4 bits fragment count)");
+#ifdef RAMEND
+// the node keeps a JSON document of LH_MAX_FRAGMENTS frames: 4 fragments (512 bytes) at most on an ATmega328P
+static_assert(LH_MAX_FRAGMENTS * LH_FRAME_MAX_PAYLOAD_SIZE <= (RAMEND - RAMSTART + 1) / 4, "LH_MAX_FRAGMENTS too large for the RAM");
+#endif
+// largest payload of a message, without terminator: one frame, or LH_MAX_FRAGMENTS fragments
+const uint16_t LH_MAX_PAYLOAD_SIZE = (LH_MAX_FRAGMENTS > 1) ? LH_MAX_FRAGMENTS * LH_FRAGMENT_PAYLOAD_SIZE : LH_FRAME_MAX_PAYLOAD_SIZE - 1;
 
 const uint8_t LH_NODE_ID_GATEWAY = 0x00;
 const uint8_t LH_NODE_ID_BROADCAST = 0xFF;
@@ -29,6 +55,34 @@ const uint8_t LH_MSG_TYPE_GW_MSG_ACK = 0x03;
 
 const uint8_t LH_MSG_TYPE_NODE_ACK = 0x04;
 const uint8_t LH_MSG_TYPE_GW_ACK = 0x06;
+// selective ACK of a fragmented message, counter of the first fragment
+// bit i of the bitmap set if fragment i has been received
+const uint8_t LH_MSG_TYPE_GW_FRAGMENT_ACK = 0x07;
+// windowed uplinks: the last frame of a burst requests a cumulative ACK
+const uint8_t LH_MSG_TYPE_NODE_MSG_WINDOW_ACK_REQ = 0x08;
+// cumulative ACK, counter of the frame requesting it
+// bit i of the bitmap set if the frame with counter (counter - i) has been received
+const uint8_t LH_MSG_TYPE_GW_WINDOW_ACK = 0x09;
+
+// diagnostics uplink, binary payload starting with a LH_DIAG_xxx kind, no ACK
+const uint8_t LH_MSG_TYPE_NODE_DIAG = 0x0A;
+const uint8_t LH_DIAG_PROFILE = 0x01; // stage, then LH_PROFILE_BUCKETS x uint16 histogram counts, LSB first
+
+// payload of the fragment and window ACKs: 16 bits bitmap, LSB first
+const uint8_t LH_ACK_BITMAP_SIZE = 2;
+const uint8_t LH_FRAME_BITMAP_ACK_SIZE = LH_FRAME_ACK_SIZE + LH_ACK_BITMAP_SIZE;
+
+// set on the message type byte of fragmented frames
+const uint8_t LH_MSG_TYPE_FRAGMENT_FLAG = 0x40;
+
+// set on the message type byte of frames whose payload ends with a LoRaHomeStats block (LH_STATS_SIZE bytes)
+const uint8_t LH_MSG_TYPE_STATS_FLAG = 0x20;
+
+// set on the message type byte of frames whose JSON keys are tokenized with the LoRaHomeDictionary
+const uint8_t LH_MSG_TYPE_COMPRESSED_FLAG = 0x10;
+
+// set on the message type byte of frames whose payload is encrypted and followed by a MIC
+const uint8_t LH_MSG_TYPE_SECURED_FLAG = 0x80;
 
 class LoRaHomeFrame
 {
@@ -38,7 +92,15 @@ public:
     bool createFromRxMessage(uint8_t *rawBytesWithCRC, uint8_t length, bool checkCRC);
     //void createAck(uint8_t nodeIdEmitter, uint8_t nodeIdRecipient, uint16_t counter);
     uint8_t serialize(uint8_t *txBuffer);
+    void setFragment(uint8_t index, uint8_t count);
+    bool isFragment();
+    uint8_t getFragmentIndex();
+    uint8_t getFragmentCount();
+    void setAckBitmap(uint16_t bitmap);
+    uint16_t getAckBitmap();
     bool checkCRC(uint8_t *rawBytesWithCRC, uint8_t length);
+    static uint8_t getSyncWord(uint16_t networkID);
+    static uint16_t crc16_update(uint16_t crc, uint8_t data);
 private:
     static uint16_t crc16_ccitt(uint8_t *data, unsigned int data_len);
 
@@ -49,9 +111,44 @@ public:
     uint8_t messageType;
     uint16_t counter;
     uint8_t payloadSize;
-    uint8_t aes_IV;
+    uint8_t fragment;
+    bool withStats;
+    bool compressed;
     uint16_t crc16;
     char jsonPayload[LH_FRAME_MAX_PAYLOAD_SIZE];
 };
 
+// verdicts of LoRaHomeFrameDecoder::end()
+const uint8_t LH_DECODE_OK = 0;
+const uint8_t LH_DECODE_CRC_ERROR = 1; // bad CRC or frame size
+const uint8_t LH_DECODE_INVALID = 2;   // valid CRC, but rejected frame (MIC, security policy, payload size)
+
+/**
+ * @brief Single pass decoder of a received frame, fed byte by byte while the radio FIFO is read
+ * The CRC and MIC are updated on each byte, the header fields are parsed as they come and the payload
+ * is written once, straight into the jsonPayload of the frame: no intermediate copy of the raw frame.
+ */
+class LoRaHomeFrameDecoder
+{
+public:
+    void begin(LoRaHomeFrame &frame, uint8_t length, bool checkCRC = true);
+    void push(uint8_t data);
+    void push(const uint8_t *data, uint8_t length);
+    uint8_t end();
+
+private:
+    LoRaHomeFrame *frame;
+    uint8_t length;
+    uint8_t index;
+    uint8_t rawMessageType;
+    uint8_t payloadIndex;
+    bool checkCRC;
+    uint16_t crc16;
+    uint16_t rxCRC16;
+#ifdef LH_SECURITY
+    LoRaHomeMICState mic;
+    uint8_t rxMIC[LH_MIC_SIZE];
+#endif
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include <LoRaHomeLog.h>
+
+// the whole module is compiled out unless logging is enabled (-D LH_LOG_LEVEL=n)
+#if LH_LOG_LEVEL > 0
+
+/**
+ * @brief Construct a new LoRaHomeLog object, with an empty ring
+ * 
+ */
+LoRaHomeLog::LoRaHomeLog()
+{
+    this->head = 0;
+    this->used = 0;
+    this->lost = 0;
+}
+
+/**
+ * @brief log an event
+ * 
+ * @param module LH_LOG_MODULE_xxx
+ * @param level LH_LOG_xxx
+ * @param id event ID, lhLogId of the message
+ */
+void LoRaHomeLog::write(uint8_t module, uint8_t level, uint16_t id)
+{
+    this->append(module, level, id, false, 0);
+}
+
+/**
+ * @brief log an event with a value
+ * 
+ * @param module LH_LOG_MODULE_xxx
+ * @param level LH_LOG_xxx
+ * @param id event ID, lhLogId of the message
+ * @param value logged with the event
+ */
+void LoRaHomeLog::write(uint8_t module, uint8_t level, uint16_t id, int32_t value)
+{
+    this->append(module, level, id, true, value);
+}
+
+/**
+ * @brief write the oldest records to a port, no more than it accepts without blocking
+ * To be called from the main loop.
+ * 
+ * @param out e.g. Serial
+ */
+void LoRaHomeLog::drain(Print &out)
+{
+    int room = out.availableForWrite();
+    while ((this->used > 0) && (room-- > 0))
+    {
+        out.write(this->ring[this->head++]);
+        if (this->head == LH_LOG_SIZE)
+        {
+            this->head = 0;
+        }
+        this->used--;
+    }
+}
+
+/**
+ * @brief add a record to the ring, preceded by a record of the lost ones if any
+ * 
+ */
+void LoRaHomeLog::append(uint8_t module, uint8_t level, uint16_t id, bool withValue, int32_t value)
+{
+    uint8_t size = LH_LOG_RECORD_SIZE + (withValue ? LH_LOG_VALUE_SIZE : 0);
+    uint8_t lostSize = (this->lost > 0) ? LH_LOG_RECORD_SIZE + LH_LOG_VALUE_SIZE : 0;
+    if (this->used + lostSize + size > LH_LOG_SIZE)
+    {
+        if (this->lost < 0xFFFF)
+        {
+            this->lost++;
+        }
+        return;
+    }
+    if (this->lost > 0)
+    {
+        uint16_t lost = this->lost;
+        this->lost = 0;
+        this->append(LH_LOG_MODULE_LOG, LH_LOG_WARN, 0, true, lost);
+    }
+    uint16_t now = (uint16_t)millis();
+    this->push(LH_LOG_SYNC);
+    this->push((module << 5) | ((level & 0x07) << 2) | (withValue ? 1 : 0));
+    this->push((uint8_t)(id & 0xff));
+    this->push((uint8_t)(id >> 8));
+    this->push((uint8_t)(now & 0xff));
+    this->push((uint8_t)(now >> 8));
+    if (withValue)
+    {
+        for (uint8_t i = 0; i < LH_LOG_VALUE_SIZE; i++)
+        {
+            this->push((uint8_t)(value & 0xff));
+            value >>= 8;
+        }
+    }
+}
+
+/**
+ * @brief append a byte at the end of the ring, room shall have been checked
+ * 
+ */
+void LoRaHomeLog::push(uint8_t data)
+{
+    uint16_t tail = this->head + this->used;
+    if (tail >= LH_LOG_SIZE)
+    {
+        tail -= LH_LOG_SIZE;
+    }
+    this->ring[tail] = data;
+    this->used++;
+}
+
+LoRaHomeLog loraHomeLog;
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef LORAHOMELOG_H
+#define LORAHOMELOG_H
+
+#include <Arduino.h>
+
+// levels
+const uint8_t LH_LOG_ERROR = 1;
+const uint8_t LH_LOG_WARN = 2;
+const uint8_t LH_LOG_INFO = 3;
+const uint8_t LH_LOG_DEBUG = 4;
+
+// modules, each source file logging defines LH_LOG_MODULE
+const uint8_t LH_LOG_MODULE_MAIN = 0;
+const uint8_t LH_LOG_MODULE_NODE = 1;
+const uint8_t LH_LOG_MODULE_FRAME = 2;
+const uint8_t LH_LOG_MODULE_REASSEMBLY = 3;
+const uint8_t LH_LOG_MODULE_APP = 4;
+const uint8_t LH_LOG_MODULE_LOG = 7; // records lost when the ring was full, the value is their number
+
+// Record, multi-byte fields LSB first:
+//   LH_LOG_SYNC, flags (bits 7..5: module, bits 4..2: level, bit 0: value follows), event ID (2 bytes),
+//   millis (2 LSB), [value (4 bytes)]
+// The event is identified by its module and the hash of its message (lhLogId), computed at compile time:
+// the messages are not compiled in, and the ID does not change when the sources around the call are edited.
+// tools/lh_log.py maps it back to the message of the LH_LOG call in the sources, and fails the build
+// (tools/lh_log_check.py) when two messages of a module have the same ID.
+const uint8_t LH_LOG_SYNC = 0xA5;
+const uint8_t LH_LOG_RECORD_SIZE = 6;
+const uint8_t LH_LOG_VALUE_SIZE = 4;
+
+// Highest level logged, 0 compiles the logging out (-D LH_LOG_LEVEL=n to change)
+#ifndef LH_LOG_LEVEL
+#define LH_LOG_LEVEL 0
+#endif
+
+// Bitmap of the modules logged, bit i for module i (-D LH_LOG_MODULES=mask to change)
+#ifndef LH_LOG_MODULES
+#define LH_LOG_MODULES 0xFF
+#endif
+
+// RAM ring size in bytes, max 255 (-D LH_LOG_SIZE=n to change)
+#ifndef LH_LOG_SIZE
+#define LH_LOG_SIZE 128
+#endif
+
+/**
+ * @brief event ID of a log message: FNV-1a hash of the message folded to 16 bits, same as tools/lh_log.py
+ * 
+ * @param message the message, a string literal
+ * @return uint16_t the ID
+ */
+constexpr uint16_t lhLogId(const char *message, uint32_t hash = 2166136261UL)
+{
+    return (*message == '\0') ? (uint16_t)(hash ^ (hash >> 16)) : lhLogId(message + 1, (hash ^ (uint8_t)*message) * 16777619UL);
+}
+
+// The message shall be a string literal. Its ID is a constant: the message itself is not compiled in.
+// The level and module tests are on constants, the calls filtered out are removed by the compiler.
+#if LH_LOG_LEVEL > 0
+#define LH_LOG_ENABLED(level) (((level) <= LH_LOG_LEVEL) && ((LH_LOG_MODULES >> LH_LOG_MODULE) & 1))
+#define LH_LOG(level, message)                                            \
+    do                                                                    \
+    {                                                                     \
+        constexpr uint16_t lhLogEventId = lhLogId(message);               \
+        if (LH_LOG_ENABLED(level))                                        \
+            loraHomeLog.write(LH_LOG_MODULE, level, lhLogEventId);        \
+    } while (0)
+#define LH_LOG_VALUE(level, message, value)                               \
+    do                                                                    \
+    {                                                                     \
+        constexpr uint16_t lhLogEventId = lhLogId(message);               \
+        if (LH_LOG_ENABLED(level))                                        \
+            loraHomeLog.write(LH_LOG_MODULE, level, lhLogEventId, value); \
+    } while (0)
+#else
+#define LH_LOG(level, message)
+#define LH_LOG_VALUE(level, message, value)
+#endif
+
+/**
+ * @brief Binary log: numeric events in a RAM ring, drained to the serial port without blocking
+ * Writing an event costs a few us instead of ~90 us per character of a Serial print at 115200 baud.
+ * When the ring is full, the new events are counted as lost and reported by a LH_LOG_MODULE_LOG record.
+ */
+class LoRaHomeLog
+{
+public:
+    LoRaHomeLog();
+    void write(uint8_t module, uint8_t level, uint16_t id);
+    void write(uint8_t module, uint8_t level, uint16_t id, int32_t value);
+    void drain(Print &out);
+
+private:
+    void append(uint8_t module, uint8_t level, uint16_t id, bool withValue, int32_t value);
+    void push(uint8_t data);
+
+    uint8_t ring[LH_LOG_SIZE];
+    uint8_t head;
+    uint8_t used;
+    uint16_t lost;
+};
+
+extern LoRaHomeLog loraHomeLog;
+
+#endif
@@ -1,19 +1,16 @@
 
 #include <LoRaHomeNode.h>
-#include <LoRa.h>
+#include <LoRaHomeRadioSX127x.h>
+#include <LoRaHomeRadioCapture.h>
 #include <LoRaNode.h>
+#include <LoRaHomeProfiler.h>
+#include <LoRaHomeDictionary.h>
 #include <ArduinoJson.h>
 #include "NodeConfig.h"
+#include <LoRaHomeLog.h>
 
-#define DEBUG
-
-#ifdef DEBUG
-#define DEBUG_MSG(x) Serial.println(F(x))
-#define DEBUG_MSG_VAR(x) Serial.println(x)
-#else
-#define DEBUG_MSG(x) // define empty, so macro does nothing
-#define DEBUG_MSG_VAR(x)
-#endif
+// log events of this file
+#define LH_LOG_MODULE LH_LOG_MODULE_NODE
 
 // -------------------------------------------------------
 // LoRa HARDWARE CONFIGURATION
@@ -30,8 +27,9 @@
 // LoRa MODEM SETTINGS
 // -------------------------------------------------------
 // The sync word assures you don't get LoRa messages from other LoRa transceivers
-// ranges from 0-0xFF - make sure that the node is using the same sync word
-#define LORA_SYNC_WORD 0xB2
+// It is derived from MY_NETWORK_ID (LoRaHomeFrame::getSyncWord), so the radio itself drops the frames of other networks.
+// Define LORA_SYNC_WORD to force a value instead (0-0xFF, same on the gateway), e.g. 0xB2 for gateways not deriving it
+// #define LORA_SYNC_WORD 0xB2
 // frequency
 // can be changed to 433E6, 915E6
 #define LORA_FREQUENCY 868E6
@@ -54,10 +52,145 @@
 // However, the rise in CR value will also increase the duration for the transmission
 // Supported values are between 5 and 8, these correspond to coding rates of 4/5 and 4/8. The coding rate numerator is fixed at 4
 #define LORA_CODING_RATE_DENOMINATOR 5
+// TX power in dBm, supported values are between 2 and 20 (PA_BOOST output)
+#define LORA_TX_POWER 17
+
+// -------------------------------------------------------
+// CHANNEL PLAN
+// -------------------------------------------------------
+// Each uplink frame is sent on a channel picked pseudo randomly in LORA_CHANNEL_FRF.
+// The ACK comes back on the channel of the frame requesting it.
+// Downlinks are received on the first channel. The gateway shall listen on all the channels.
+// Capacity, pure ALOHA with up to 10% of uplinks lost in collisions (offered load <= 5.3% of the airtime per channel),
+// 30 bytes frames at SF7 / 125 kHz (~72 ms on air), one uplink per node every 10 min:
+// - 1 channel: ~440 nodes
+// - 3 channels: ~1300 nodes
+// - 8 channels: ~3500 nodes
+// tools/lh_netsim.py simulates the plan of a build (LBT, retries, capture effect, gateway model), see [env:netsim].
+// FRF register values are computed at compile time, hopping only writes 3 registers.
+// -D LORA_CHANNEL_PLAN=... to change, e.g. 3 channels: LORA_FRF(868100000),LORA_FRF(868300000),LORA_FRF(868500000)
+#ifndef LORA_CHANNEL_PLAN
+#define LORA_CHANNEL_PLAN LORA_FRF(LORA_FREQUENCY)
+#endif
+const uint32_t LORA_CHANNEL_FRF[] PROGMEM = {LORA_CHANNEL_PLAN};
+const uint8_t LORA_CHANNEL_COUNT = sizeof(LORA_CHANNEL_FRF) / sizeof(LORA_CHANNEL_FRF[0]);
 
 #define ACK_TIMEOUT 2000 // 2000 ms max to receive an Ack
 #define MAX_RETRY_NO_VALID_ACK 3
 
+// -------------------------------------------------------
+// RECEIVE POLICY
+// -------------------------------------------------------
+// LH_RX_POLICY_CONTINUOUS: the radio is always in RX, downlinks are received at any time.
+// LH_RX_POLICY_WINDOWS: the radio sleeps, except while waiting for the ACK and during two receive windows
+// opened RX1_DELAY and RX2_DELAY after each uplink. The gateway holds the downlinks of the node until then.
+// Energy per day with SX1276 datasheet currents (RX 10.8 mA, sleep 0.2 uA):
+// - continuous: 10.8 mA x 24 h = ~260 mAh
+// - windows: uplinks per day x (ACK wait + 2 x RX_WINDOW_DURATION) of RX. With one uplink every 10 min
+//   and a 100 ms ACK wait: 144 x 0.7 s = ~100 s of RX = ~0.3 mAh
+// LH_RX_POLICY_WAKE_ON_RADIO: the radio sleeps and wakes every WOR_PERIOD for a CAD. When a preamble is detected,
+// it listens until a frame is received, or for WOR_RX_TIMEOUT. Downlinks are received at any time, after a delay.
+// The gateway shall send the downlinks to the node with a preamble longer than WOR_PERIOD, so that a CAD falls in it:
+//   preamble symbols >= WOR_PERIOD / Tsym + 2 (CAD) + 8 (RX sync), Tsym = 2^SF / bandwidth (1.024 ms at SF7 / 125 kHz)
+//   e.g. WOR_PERIOD 1000 ms at SF7: LoRa.setPreambleLength(987) on the gateway, ~1 s more time on air per downlink
+// Trade-offs at SF7 / 125 kHz, a wake up costing a CAD (~2 symbols) + ~1 ms of oscillator start at RX current:
+// - downlink latency: the whole preamble is sent, ~WOR_PERIOD + frame time on air
+// - listening current: 10.8 mA x 3 ms / WOR_PERIOD, ~32 uA at 1 s (~0.8 mAh/day), ~3 uA at 10 s (~0.08 mAh/day)
+// - RX per downlink: WOR_PERIOD / 2 + frame time on air on average, the gateway is deaf to uplinks ~WOR_PERIOD
+// tools/lh_netsim.py --rx-policy wake-on-radio simulates it with downlinks, collisions and the gateway half duplex.
+#define LORA_RX_POLICY LH_RX_POLICY_CONTINUOUS
+#define RX1_DELAY 1000         // ms after the end of the uplink exchange
+#define RX2_DELAY 2000         // ms after the end of the uplink exchange
+#define RX_WINDOW_DURATION 300 // ms
+#ifndef WOR_PERIOD
+#define WOR_PERIOD 1000        // ms between two CAD (-D WOR_PERIOD=n to change)
+#endif
+#define WOR_RX_TIMEOUT 1500    // ms of RX after a detection: rest of the preamble (up to WOR_PERIOD) and frame
+// receiver preamble length, max when the emitter one is longer (SX1276 datasheet 4.1.1.6)
+#define WOR_RX_PREAMBLE_LENGTH 0xFFFF
+#define LORA_PREAMBLE_LENGTH 8 // symbols, uplinks
+
+// wake-on-radio states
+const uint8_t LH_WAKE_SLEEP = 0; // until the next CAD
+const uint8_t LH_WAKE_CAD = 1;   // CAD running
+const uint8_t LH_WAKE_RX = 2;    // preamble detected, waiting for the frame
+const uint8_t LH_WAKE_DONE = 3;  // frame received, back to sleep
+
+// -------------------------------------------------------
+// LISTEN BEFORE TALK
+// -------------------------------------------------------
+// Before each transmission a Channel Activity Detection (CAD) checks that no other node is transmitting.
+// ACKs to a gateway downlink skip it: the gateway listens for them right after its transmission, as for LoRaWAN class A.
+// While the channel is busy, the transmission is deferred by a random backoff.
+// After LBT_MAX_ATTEMPTS busy channel detections, the frame is sent anyway. 0 disables listen before talk
+#ifndef LBT_MAX_ATTEMPTS
+#define LBT_MAX_ATTEMPTS 5 // -D LBT_MAX_ATTEMPTS=n to change
+#endif
+#define LBT_BACKOFF_MIN 20  // ms
+#define LBT_BACKOFF_MAX 200 // ms
+// a CAD lasts about 2 symbols (~2 ms at SF7, ~66 ms at SF12)
+#define LBT_CAD_TIMEOUT 100 // ms
+
+// -------------------------------------------------------
+// LINK STATS
+// -------------------------------------------------------
+// A LoRaHomeStats block (LH_STATS_SIZE bytes) is appended to the payload of every STATS_UPLINK_INTERVAL th uplink,
+// and to the next uplink when the gateway sends "diag":"stats". 0: on request only.
+// Fragmented uplinks never carry it, nor uplinks without room left in the frame: the block then goes with the next one.
+#define STATS_UPLINK_INTERVAL 10
+
+// radio used unless another one is given with setRadio()
+static LoRaHomeRadioSX127x defaultRadio(LoRa, SS, RST, DIO0);
+#ifdef LH_CAPTURE
+// packets sent and received by the default radio, kept in a RAM ring (-D LH_CAPTURE)
+LoRaHomeRadioRing loraHomeCapture(defaultRadio);
+#endif
+
+/**
+ * @brief FNV-1a hash of the bytes printed into it
+ * Used to compare a JSON payload with the last reported one without buffering it
+ */
+class PayloadHash : public Print
+{
+public:
+  uint32_t hash = 2166136261UL;
+  size_t write(uint8_t c)
+  {
+    this->hash = (this->hash ^ c) * 16777619UL;
+    return 1;
+  }
+};
+
+/**
+ * @brief window of the bytes printed into it: only the bytes from offset are kept, up to capacity - 1
+ * Used to serialize one fragment of a payload without buffering the whole payload
+ */
+class PayloadWindow : public Print
+{
+public:
+  PayloadWindow(char *buffer, size_t capacity, size_t offset) : buffer(buffer), capacity(capacity), offset(offset) {}
+  size_t write(uint8_t c)
+  {
+    if ((this->position >= this->offset) && (this->position - this->offset + 1 < this->capacity))
+    {
+      this->buffer[this->position - this->offset] = c;
+    }
+    this->position++;
+    return 1;
+  }
+  size_t end()
+  {
+    size_t size = (this->position > this->offset) ? min(this->position - this->offset, this->capacity - 1) : 0;
+    this->buffer[size] = '\0';
+    return size;
+  }
+
+private:
+  char *buffer;
+  size_t capacity;
+  size_t offset;
+  size_t position = 0;
+};
 
 /**
  * @brief Construct a new LoRaHomeNode::LoRaHomeNode object
@@ -65,6 +198,27 @@
  */
 LoRaHomeNode::LoRaHomeNode()
 {
+#ifdef LH_CAPTURE
+  this->radio = &loraHomeCapture;
+#else
+  this->radio = &defaultRadio;
+#endif
+  this->rxPolicy = LORA_RX_POLICY;
+  this->channel = 0;
+  this->lastUplinkTime = 0;
+  this->rxWindowOpen = false;
+  this->wakeState = LH_WAKE_SLEEP;
+  this->wakeTime = 0;
+  this->lastReportHash = 0;
+  this->lastReportTime = 0;
+  this->lastReportValid = false;
+  this->uplinksSinceStats = 0;
+  this->statsRequested = false;
+#if LH_TX_WINDOW_SIZE > 1
+  this->windowHead = 0;
+  this->windowCount = 0;
+  this->windowPending = 0;
+#endif
 }
 /**
 * Set Node in Rx Mode with active invert IQ
@@ -73,8 +227,13 @@ LoRaHomeNode::LoRaHomeNode()
 */
 void LoRaHomeNode::rxMode()
 {
-  LoRa.enableInvertIQ(); // active invert I and Q signals
-  LoRa.receive();        // set receive mode
+  this->radio->enableInvertIQ(); // active invert I and Q signals
+  if (this->rxPolicy == LH_RX_POLICY_WAKE_ON_RADIO)
+  {
+    // downlinks come with a preamble longer than the default one
+    this->radio->setPreambleLength(WOR_RX_PREAMBLE_LENGTH);
+  }
+  this->radio->receive();        // set receive mode
 }
 
 /**
@@ -84,8 +243,42 @@ void LoRaHomeNode::rxMode()
 */
 void LoRaHomeNode::txMode()
 {
-  LoRa.idle();            // set standby mode
-  LoRa.disableInvertIQ(); // normal mode
+  this->radio->idle();            // set standby mode
+  this->radio->disableInvertIQ(); // normal mode
+  if (this->rxPolicy == LH_RX_POLICY_WAKE_ON_RADIO)
+  {
+    this->radio->setPreambleLength(LORA_PREAMBLE_LENGTH);
+  }
+}
+
+/**
+ * @brief switch the radio to a channel of the channel plan
+ * The radio is left in standby mode if the channel changes
+ * 
+ * @param channel index in LORA_CHANNEL_FRF
+ */
+void LoRaHomeNode::setChannel(uint8_t channel)
+{
+  if (channel == this->channel)
+  {
+    return;
+  }
+  // FRF is written in standby mode
+  this->radio->idle();
+  this->radio->setFrf(pgm_read_dword(&LORA_CHANNEL_FRF[channel]));
+  this->channel = channel;
+}
+
+/**
+ * @brief pick the channel of the next uplink frame
+ * 
+ */
+void LoRaHomeNode::hopChannel()
+{
+  if (LORA_CHANNEL_COUNT > 1)
+  {
+    this->setChannel(random(LORA_CHANNEL_COUNT));
+  }
 }
 
 /**
@@ -95,74 +288,409 @@ void LoRaHomeNode::txMode()
 */
 void LoRaHomeNode::setup()
 {
-  DEBUG_MSG("LoRaHomeNode::setup");
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::setup");
   //setup LoRa transceiver module
-  DEBUG_MSG("--- LoRa Begin");
-  LoRa.setPins(SS, RST, DIO0);
-  while (!LoRa.begin(LORA_FREQUENCY))
+  LH_LOG(LH_LOG_DEBUG, "--- LoRa Begin");
+  while (!this->radio->begin(LORA_FREQUENCY))
   {
-    DEBUG_MSG(".");
+    LH_LOG(LH_LOG_DEBUG, ".");
     delay(500);
   }
-  DEBUG_MSG("--- setSpreadingFactor");
-  LoRa.setSpreadingFactor(LORA_SPREADING_FACTOR);
-  DEBUG_MSG("--- setSignalBandwidth");
-  LoRa.setSignalBandwidth(LORA_SIGNAL_BANDWIDTH);
-  DEBUG_MSG("--- setCodingRate4");
-  LoRa.setCodingRate4(LORA_CODING_RATE_DENOMINATOR);
-  DEBUG_MSG("--- setSyncWord");
+  // downlink channel
+  this->radio->setFrf(pgm_read_dword(&LORA_CHANNEL_FRF[0]));
+  LH_LOG(LH_LOG_DEBUG, "--- setSpreadingFactor");
+  this->radio->setSpreadingFactor(LORA_SPREADING_FACTOR);
+  LH_LOG(LH_LOG_DEBUG, "--- setTxPower");
+  this->radio->setTxPower(LORA_TX_POWER);
+  LH_LOG(LH_LOG_DEBUG, "--- setSignalBandwidth");
+  this->radio->setSignalBandwidth(LORA_SIGNAL_BANDWIDTH);
+  LH_LOG(LH_LOG_DEBUG, "--- setCodingRate4");
+  this->radio->setCodingRate4(LORA_CODING_RATE_DENOMINATOR);
+  LH_LOG(LH_LOG_DEBUG, "--- setSyncWord");
   // Change sync word (0xF3) to match the receiver
   // The sync word assures you don't get LoRa messages from other LoRa transceivers
   // ranges from 0-0xFF
-  LoRa.setSyncWord(LORA_SYNC_WORD);
-  DEBUG_MSG("--- enableCrc");
-  LoRa.enableCrc();
+#ifdef LORA_SYNC_WORD
+  this->radio->setSyncWord(LORA_SYNC_WORD);
+#else
+  this->radio->setSyncWord(LoRaHomeFrame::getSyncWord(MY_NETWORK_ID));
+#endif
+  LH_LOG(LH_LOG_DEBUG, "--- enableCrc");
+  this->radio->enableCrc();
+#ifdef LH_SECURITY
+  LH_LOG(LH_LOG_DEBUG, "--- security begin");
+  loraHomeSecurity.begin(SECURITY_KEY);
+#endif
+#ifdef LH_STORAGE
+  // warm boot: resume after the last reserved TX counter block, with the last link settings
+  this->state.counterLimit = 0;
+  this->state.spreadingFactor = LORA_SPREADING_FACTOR;
+  this->state.txPower = LORA_TX_POWER;
+  this->state.rxCounter = 0;
+  this->state.rxCounterValid = false;
+  if (loraHomeStorage.load(this->state))
+  {
+    LH_LOG(LH_LOG_INFO, "--- state restored");
+    Node->setTxCounter(this->state.counterLimit);
+    this->radio->setSpreadingFactor(this->state.spreadingFactor);
+    this->radio->setTxPower(this->state.txPower);
+  }
+  this->reserveCounters();
+#endif
 
   // set in rx mode.
   this->rxMode();
+  // wideband RSSI noise as seed of the listen before talk backoff
+  randomSeed(((unsigned long)this->radio->random() << 8) | this->radio->random());
+  // sleep until the first uplink when listening in receive windows only
+  this->scheduleRxWindows();
+}
+
+/**
+ * @brief use another radio than the SX127x of the LoRa library, e.g. to record or replay the traffic
+ * To be called before setup()
+ * 
+ * @param radio the radio
+ */
+void LoRaHomeNode::setRadio(LoRaHomeRadio *radio)
+{
+  this->radio = radio;
+}
+
+/**
+ * @brief select how the node listens for downlinks
+ * 
+ * @param policy LH_RX_POLICY_CONTINUOUS, LH_RX_POLICY_WINDOWS or LH_RX_POLICY_WAKE_ON_RADIO
+ */
+void LoRaHomeNode::setRxPolicy(uint8_t policy)
+{
+  // default preamble, unless rxMode() extends it for wake-on-radio
+  this->radio->setPreambleLength(LORA_PREAMBLE_LENGTH);
+  this->rxPolicy = policy;
+  if (policy == LH_RX_POLICY_CONTINUOUS)
+  {
+    this->rxMode();
+  }
+  else
+  {
+    this->scheduleRxWindows();
+  }
+}
+
+/**
+ * @brief change the spreading factor, saved in EEPROM with -D LH_STORAGE
+ * 
+ * @param spreadingFactor 7 to 12
+ */
+void LoRaHomeNode::setSpreadingFactor(uint8_t spreadingFactor)
+{
+  this->radio->setSpreadingFactor(spreadingFactor);
+#ifdef LH_STORAGE
+  if (this->state.spreadingFactor != spreadingFactor)
+  {
+    this->state.spreadingFactor = spreadingFactor;
+    loraHomeStorage.save(this->state);
+  }
+#endif
+}
+
+/**
+ * @brief change the TX power, saved in EEPROM with -D LH_STORAGE
+ * 
+ * @param txPower in dBm, 2 to 20
+ */
+void LoRaHomeNode::setTxPower(int8_t txPower)
+{
+  this->radio->setTxPower(txPower);
+#ifdef LH_STORAGE
+  if (this->state.txPower != txPower)
+  {
+    this->state.txPower = txPower;
+    loraHomeStorage.save(this->state);
+  }
+#endif
+}
+
+/**
+ * @brief reserve the next block of TX counter values in EEPROM when the current one is almost used
+ * After a reset the node resumes from the end of the reserved block, so a counter value is never sent twice
+ * With -D LH_SECURITY the last block ends at LH_SECURITY_COUNTER_MAX instead of wrapping
+ * Nothing to do without -D LH_STORAGE
+ */
+void LoRaHomeNode::reserveCounters()
+{
+#ifdef LH_STORAGE
+  uint16_t left = this->state.counterLimit - Node->getTxCounter();
+  if ((left < LH_STORAGE_COUNTER_MARGIN) || (left > LH_STORAGE_COUNTER_BLOCK))
+  {
+    uint16_t limit = Node->getTxCounter() + LH_STORAGE_COUNTER_BLOCK;
+#ifdef LH_SECURITY
+    if (limit < Node->getTxCounter())
+    {
+      limit = LH_SECURITY_COUNTER_MAX;
+    }
+#endif
+    if (limit != this->state.counterLimit)
+    {
+      this->state.counterLimit = limit;
+      loraHomeStorage.save(this->state);
+    }
+  }
+#endif
+}
+
+/**
+ * @brief check that the TX counter can still be used as nonce for the frames of one exchange
+ * The 16 bit counter shall never wrap with the same key: once exhausted, nothing is sent until the node
+ * is flashed with a new key and its EEPROM state erased
+ * 
+ * @return true if no frame may be sent anymore. Always false without -D LH_SECURITY
+ */
+bool LoRaHomeNode::txCounterExhausted()
+{
+#ifdef LH_SECURITY
+  // an exchange (fragments, profiler dump) uses at most LH_STORAGE_COUNTER_MARGIN counter values
+  if (Node->getTxCounter() > LH_SECURITY_COUNTER_MAX - LH_STORAGE_COUNTER_MARGIN)
+  {
+    LH_LOG(LH_LOG_ERROR, "--- TX counter exhausted, new key required");
+    return true;
+  }
+#endif
+  return false;
+}
+
+/**
+ * @brief Get the link and protocol stats of the node
+ * 
+ * @return LoRaHomeStats& 
+ */
+LoRaHomeStats &LoRaHomeNode::getStats()
+{
+  return this->stats;
+}
+
+/**
+ * @brief end of an uplink exchange: put the radio to sleep until the RX1 window, or the next wake-on-radio CAD
+ * Nothing to do with the continuous receive policy
+ */
+void LoRaHomeNode::scheduleRxWindows()
+{
+  if (this->rxPolicy == LH_RX_POLICY_CONTINUOUS)
+  {
+    return;
+  }
+  this->radio->sleep();
+  this->rxWindowOpen = false;
+  this->wakeState = LH_WAKE_SLEEP;
+  this->lastUplinkTime = millis();
+  this->wakeTime = this->lastUplinkTime;
+}
+
+/**
+ * @brief open / close the RX1 and RX2 windows as time goes
+ * 
+ * @return true if the radio is listening
+ */
+bool LoRaHomeNode::updateRxWindows()
+{
+  if (this->rxPolicy == LH_RX_POLICY_WAKE_ON_RADIO)
+  {
+    return this->updateWakeOnRadio();
+  }
+  if (this->rxPolicy != LH_RX_POLICY_WINDOWS)
+  {
+    return true;
+  }
+  unsigned long elapsed = millis() - this->lastUplinkTime;
+  bool open = ((elapsed >= RX1_DELAY) && (elapsed < RX1_DELAY + RX_WINDOW_DURATION)) ||
+              ((elapsed >= RX2_DELAY) && (elapsed < RX2_DELAY + RX_WINDOW_DURATION));
+  if (open && !this->rxWindowOpen)
+  {
+    this->rxMode();
+  }
+  else if (!open && this->rxWindowOpen)
+  {
+    this->radio->sleep();
+  }
+  this->rxWindowOpen = open;
+  return open;
 }
 
-bool LoRaHomeNode::receiveAck()
+/**
+ * @brief time left before the receive policy needs receiveLoraMessage() again: opening or closing of a receive window,
+ * next wake-on-radio CAD or end of its RX. A packet received needs it at once anyway
+ * 
+ * @return unsigned long in ms, (unsigned long)-1 while the radio listens continuously or until the next uplink
+ */
+unsigned long LoRaHomeNode::getTimeToNextRxEvent()
+{
+  if (this->rxPolicy == LH_RX_POLICY_WINDOWS)
+  {
+    unsigned long elapsed = millis() - this->lastUplinkTime;
+    const unsigned long edges[] = {RX1_DELAY, RX1_DELAY + RX_WINDOW_DURATION, RX2_DELAY, RX2_DELAY + RX_WINDOW_DURATION};
+    for (unsigned long edge : edges)
+    {
+      if (elapsed < edge)
+      {
+        return edge - elapsed;
+      }
+    }
+  }
+  else if (this->rxPolicy == LH_RX_POLICY_WAKE_ON_RADIO)
+  {
+    unsigned long elapsed = millis() - this->wakeTime;
+    if (this->wakeState == LH_WAKE_SLEEP)
+    {
+      return (elapsed < WOR_PERIOD) ? WOR_PERIOD - elapsed : 0;
+    }
+    if (this->wakeState == LH_WAKE_RX)
+    {
+      return (elapsed < WOR_RX_TIMEOUT) ? WOR_RX_TIMEOUT - elapsed : 0;
+    }
+    // CAD result polled, or back to sleep after a frame
+    return 0;
+  }
+  return (unsigned long)-1;
+}
+
+/**
+ * @brief wake-on-radio: a CAD every WOR_PERIOD while the radio sleeps, RX when a preamble is detected
+ * The radio goes back to sleep after a frame, or WOR_RX_TIMEOUT after a detection without frame
+ * 
+ * @return true if the radio is listening
+ */
+bool LoRaHomeNode::updateWakeOnRadio()
+{
+  unsigned long elapsed = millis() - this->wakeTime;
+  switch (this->wakeState)
+  {
+  case LH_WAKE_SLEEP:
+    if (elapsed < WOR_PERIOD)
+    {
+      return false;
+    }
+    // the period is counted from the start of each CAD
+    this->wakeTime = millis();
+    this->radio->idle();
+    this->radio->enableInvertIQ(); // downlinks are sent with inverted IQ
+    this->radio->channelActivityDetection();
+    this->wakeState = LH_WAKE_CAD;
+    return false;
+  case LH_WAKE_CAD:
+  {
+    int cad = this->radio->channelActivityResult();
+    if ((cad < 0) && (elapsed < LBT_CAD_TIMEOUT))
+    {
+      return false;
+    }
+    if (cad > 0)
+    {
+      LH_LOG(LH_LOG_DEBUG, "--- preamble detected, wake up");
+      this->rxMode();
+      this->wakeState = LH_WAKE_RX;
+      return true;
+    }
+    break;
+  }
+  case LH_WAKE_RX:
+    if (elapsed < WOR_RX_TIMEOUT)
+    {
+      return true;
+    }
+    LH_LOG(LH_LOG_INFO, "--- wake up without frame");
+    break;
+  default:
+    break;
+  }
+  // channel free, frame received or no frame: back to sleep until the next CAD
+  this->radio->sleep();
+  this->wakeState = LH_WAKE_SLEEP;
+  return false;
+}
+
+/**
+ * @brief Listen before talk: run channel activity detections until the channel is free
+ * Each busy detection defers the transmission by a random backoff
+ * 
+ * @return true if the channel is free, false if still busy after LBT_MAX_ATTEMPTS detections
+ */
+bool LoRaHomeNode::waitForFreeChannel()
+{
+#if LBT_MAX_ATTEMPTS > 0
+  for (uint8_t attempt = 0; attempt < LBT_MAX_ATTEMPTS; attempt++)
+  {
+    this->radio->channelActivityDetection();
+    unsigned long cadStartTime = millis();
+    int cad;
+    do
+    {
+      cad = this->radio->channelActivityResult();
+    } while ((cad < 0) && ((millis() - cadStartTime) < LBT_CAD_TIMEOUT));
+    if (cad <= 0)
+    {
+      // channel free, or no CAD result: do not block the transmission
+      return true;
+    }
+    LH_LOG(LH_LOG_INFO, "--- channel busy, backoff");
+    delay(random(LBT_BACKOFF_MIN, LBT_BACKOFF_MAX));
+  }
+  // channel still busy
+  return false;
+#else
+  // listen before talk disabled
+  return true;
+#endif
+}
+
+/**
+ * @brief wait for the gateway ACK of the frame(s) sent with the given counter
+ * 
+ * @param counter counter of the frame to be acknowledged (first fragment for a fragmented message, last frame of a window burst)
+ * @param ack filled with the ACK frame received
+ * @return true if a valid ACK is received before ACK_TIMEOUT
+ */
+bool LoRaHomeNode::receiveAck(uint16_t counter, LoRaHomeFrame &ack)
 {
   unsigned long ackStartWaitingTime = millis();
-  //try to parse packet
-  int packetSize = LoRa.parsePacket();
-  LoRaHomeFrame lhf;
-  DEBUG_MSG("LoRaHomeNode::receiveAck");
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::receiveAck");
   // switch to rxMode to receive ACK
   this->rxMode();
-  while (((millis() - ackStartWaitingTime) < ACK_TIMEOUT) && (packetSize == 0))
+  while ((millis() - ackStartWaitingTime) < ACK_TIMEOUT)
   {
-    packetSize = LoRa.parsePacket();
-    if (packetSize == LH_FRAME_ACK_SIZE)
+    int packetSize = this->radio->parsePacket();
+    if ((packetSize >= LH_FRAME_ACK_SIZE) && (packetSize <= LH_FRAME_BITMAP_ACK_SIZE))
     {
-      uint8_t rxBuffer[LH_FRAME_ACK_SIZE];
-      int j = 0;
-      while (packetSize > 0)
+      // decode while reading the FIFO
+      LoRaHomeFrameDecoder decoder;
+      decoder.begin(ack, packetSize);
+      this->readFrame(decoder, packetSize);
+      uint8_t verdict = decoder.end();
+      if (verdict == LH_DECODE_OK)
       {
-        // read available bytes
-        rxBuffer[j++] = (char)LoRa.read();
-        packetSize--;
-      }
-      if (lhf.createFromRxMessage(rxBuffer, j, true) == true)
-      {
-        if ((lhf.nodeIdEmitter == LH_NODE_ID_GATEWAY) && (lhf.nodeIdRecipient == Node->getNodeId()) && (lhf.messageType == LH_MSG_TYPE_GW_ACK))
+        this->stats.increment(LH_STAT_RX_FRAMES);
+        if ((ack.nodeIdEmitter == LH_NODE_ID_GATEWAY) && (ack.nodeIdRecipient == Node->getNodeId()) &&
+            ((ack.messageType == LH_MSG_TYPE_GW_ACK) || (ack.messageType == LH_MSG_TYPE_GW_FRAGMENT_ACK) ||
+             (ack.messageType == LH_MSG_TYPE_GW_WINDOW_ACK)))
         {
-          if (lhf.counter == Node->getTxCounter())
+          if (ack.counter == counter)
           {
-            DEBUG_MSG("--- good ack received!");
+            LH_PROFILE_LAP(LH_PROFILE_ACK_WAIT);
+            this->stats.setLastAckSignal(this->radio->packetRssi(), this->radio->packetSnr());
+            LH_LOG_VALUE(LH_LOG_INFO, "--- good ack received, counter", counter);
             return true;
           }
         }
       }
       else
       {
-        packetSize = 0; // to loop again
-        DEBUG_MSG("--- bad ack received!");
+        this->stats.increment((verdict == LH_DECODE_CRC_ERROR) ? LH_STAT_RX_CRC_ERROR : LH_STAT_RX_INVALID);
+        LH_LOG(LH_LOG_WARN, "--- bad ack received!");
       }
     }
   }
-  DEBUG_MSG("--- no ACK received");
+  LH_PROFILE_LAP(LH_PROFILE_ACK_WAIT);
+  this->stats.increment(LH_STAT_ACK_TIMEOUT);
+  LH_LOG_VALUE(LH_LOG_WARN, "--- no ACK received, counter", counter);
   return false;
 }
 
@@ -170,50 +698,416 @@ bool LoRaHomeNode::receiveAck()
 * [sendToLora2MQTTGateway description]
 */
 void LoRaHomeNode::sendToGateway()
+{
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::sendToGateway()");
+  LH_PROFILE_START();
+  // create payload
+  LH_LOG(LH_LOG_DEBUG, "--- create LoraHomePayload");
+  JsonDocument &jsonDoc = this->jsonDoc;
+  jsonDoc.clear();
+  Node->beginSamples();
+  Node->addJsonTxPayload(jsonDoc);
+  LH_PROFILE_LAP(LH_PROFILE_JSON_BUILD);
+  // report on change: do not send a payload identical to the last acknowledged one
+  bool reportOnChange = (Node->getMaxSilenceInterval() != 0);
+  PayloadHash payloadHash;
+  if (reportOnChange)
+  {
+    Node->applyDeadbands(jsonDoc);
+    serializeJson(jsonDoc, payloadHash);
+    if (this->lastReportValid && (payloadHash.hash == this->lastReportHash) && !Node->isTransmissionForced() &&
+        !this->statsRequested && ((millis() - this->lastReportTime) < Node->getMaxSilenceInterval()))
+    {
+      LH_LOG(LH_LOG_INFO, "--- payload unchanged, not sent");
+      return;
+    }
+  }
+  if (this->txCounterExhausted())
+  {
+    this->stats.increment(LH_STAT_TX_LOST);
+    return;
+  }
+  // a truncated JSON text is useless to the gateway: a payload too large is not sent at all
+  size_t payloadSize = this->measurePayload(jsonDoc);
+  if (payloadSize > LH_MAX_PAYLOAD_SIZE)
+  {
+    LH_LOG_VALUE(LH_LOG_ERROR, "--- payload too large, not sent", payloadSize);
+    this->stats.increment(LH_STAT_TX_LOST);
+    return;
+  }
+  this->uplinksSinceStats++;
+  this->reserveCounters();
+  bool acknowledged = false;
+  bool fragmented = false;
+#if LH_MAX_FRAGMENTS > 1
+  if (payloadSize >= LH_FRAME_MAX_PAYLOAD_SIZE)
+  {
+    acknowledged = this->sendFragmentsToGateway(jsonDoc, payloadSize);
+    fragmented = true;
+  }
+#endif
+  if (!fragmented)
+  {
+#if LH_TX_WINDOW_SIZE > 1
+    acknowledged = this->sendWindowToGateway(jsonDoc);
+#else
+    acknowledged = this->sendFrameToGateway(jsonDoc);
+#endif
+  }
+#if LH_TX_WINDOW_SIZE == 1
+  // windowed uplinks not acknowledged yet stay in the window, they are only lost when dropped from it
+  if (!acknowledged)
+  {
+    this->stats.increment(LH_STAT_TX_LOST);
+  }
+#else
+  if (fragmented && !acknowledged)
+  {
+    this->stats.increment(LH_STAT_TX_LOST);
+  }
+#endif
+  if (acknowledged)
+  {
+    Node->commitSamples();
+  }
+  if (reportOnChange && acknowledged)
+  {
+    this->lastReportHash = payloadHash.hash;
+    this->lastReportTime = millis();
+    this->lastReportValid = true;
+    Node->commitDeadbands(jsonDoc);
+  }
+  this->endUplink();
+}
+
+/**
+ * @brief end of the frames of an uplink, sent on hopped channels: back to the downlink channel, then RX windows
+ * 
+ */
+void LoRaHomeNode::endUplink()
+{
+  if (this->channel != 0)
+  {
+    this->setChannel(0);
+    this->rxMode();
+  }
+  this->scheduleRxWindows();
+}
+
+/**
+ * @brief serialize a JSON payload as sent over the air: JSON text, with the keys tokenized with -D LH_DICTIONARY
+ * 
+ * @param jsonDoc the JSON payload
+ * @param buffer where to serialize it, truncated and NUL terminated like serializeJson()
+ * @param capacity size of the buffer
+ * @param offset first byte of the payload written, e.g. the start of a fragment
+ * @return size_t number of bytes written, without terminator
+ */
+size_t LoRaHomeNode::serializePayload(JsonDocument &jsonDoc, char *buffer, size_t capacity, size_t offset)
+{
+#ifdef LH_DICTIONARY
+  LoRaHomeDictionary tokenizer(buffer, capacity, offset);
+  serializeJson(jsonDoc, tokenizer);
+  return tokenizer.end();
+#else
+  if (offset == 0)
+  {
+    return serializeJson(jsonDoc, buffer, capacity);
+  }
+  PayloadWindow window(buffer, capacity, offset);
+  serializeJson(jsonDoc, window);
+  return window.end();
+#endif
+}
+
+/**
+ * @brief size of a JSON payload as sent over the air
+ * 
+ * @param jsonDoc the JSON payload
+ * @return size_t number of bytes, without terminator
+ */
+size_t LoRaHomeNode::measurePayload(JsonDocument &jsonDoc)
+{
+#ifdef LH_DICTIONARY
+  LoRaHomeDictionary tokenizer(NULL, 0);
+  serializeJson(jsonDoc, tokenizer);
+  return tokenizer.end();
+#else
+  return measureJson(jsonDoc);
+#endif
+}
+
+/**
+ * @brief send a JSON payload in a single frame and wait for its ACK (stop-and-wait)
+ * 
+ * @param jsonDoc the JSON payload
+ * @return true if acknowledged by the gateway
+ */
+bool LoRaHomeNode::sendFrameToGateway(JsonDocument &jsonDoc)
 {
   int retry = 0;
-  DEBUG_MSG("LoRaHomeNode::sendToGateway()");
+  bool acknowledged;
   uint8_t txBuffer[LH_FRAME_MAX_SIZE];
-  DEBUG_MSG("--- create LoraHomeFrame");
+  LH_LOG(LH_LOG_DEBUG, "--- create LoraHomeFrame");
   // create frame
   LoRaHomeFrame lhf(MY_NETWORK_ID, Node->getNodeId(), LH_NODE_ID_GATEWAY, LH_MSG_TYPE_NODE_MSG_ACK_REQ, Node->getTxCounter());
-  // create payload
-  DEBUG_MSG("--- create LoraHomePayload");
-  StaticJsonDocument<128> jsonDoc;
-  Node->addJsonTxPayload(jsonDoc);
-  serializeJson(jsonDoc, lhf.jsonPayload, LH_FRAME_MAX_PAYLOAD_SIZE);
+  lhf.payloadSize = this->serializePayload(jsonDoc, lhf.jsonPayload, LH_FRAME_MAX_PAYLOAD_SIZE);
+#ifdef LH_DICTIONARY
+  lhf.compressed = true;
+#endif
+  this->appendStats(lhf);
   //add payload to the frame if any
   uint8_t size = lhf.serialize(txBuffer);
-  DEBUG_MSG("--- LoraHomeFrame serialized");
+  LH_PROFILE_LAP(LH_PROFILE_SERIALIZE);
+  LH_LOG(LH_LOG_DEBUG, "--- LoraHomeFrame serialized");
   // send the LoRa message until valid ack is received with max retries
+  LoRaHomeFrame ack;
   do
   {
-    retry++;
-    this->send(txBuffer, size);
-  } while ((receiveAck() == false) && (retry < MAX_RETRY_NO_VALID_ACK));
+    if (retry++ > 0)
+    {
+      this->stats.increment(LH_STAT_TX_RETRIES);
+    }
+    this->hopChannel();
+    this->send(txBuffer, size, retry > 1);
+    acknowledged = receiveAck(lhf.counter, ack);
+  } while ((acknowledged == false) && (retry < MAX_RETRY_NO_VALID_ACK));
   // increment TxCounter
   // TODO should only increment TxCounter if msg sent + ack received ... else error
   Node->incrementTxCounter();
+  return acknowledged;
 }
 
+#if LH_MAX_FRAGMENTS > 1
+/**
+ * @brief send a JSON payload too large for one frame as a burst of fragments
+ * Fragment i is sent with counter TxCounter + i. Only the last fragment of a burst requests an ACK.
+ * The gateway answers with the bitmap of the fragments received, only the missing ones are resent.
+ * Each fragment is serialized from the JSON document straight into its frame, the whole payload is never buffered.
+ * 
+ * @param jsonDoc the JSON payload
+ * @param messageSize size of the payload as sent over the air, at most LH_MAX_PAYLOAD_SIZE
+ * @return true if all the fragments have been acknowledged
+ */
+bool LoRaHomeNode::sendFragmentsToGateway(JsonDocument &jsonDoc, uint16_t messageSize)
+{
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::sendFragmentsToGateway()");
+  uint8_t count = (messageSize + LH_FRAGMENT_PAYLOAD_SIZE - 1) / LH_FRAGMENT_PAYLOAD_SIZE;
+  uint16_t firstCounter = Node->getTxCounter();
+  uint16_t missing = (uint16_t)((1UL << count) - 1);
+  uint8_t txBuffer[LH_FRAME_MAX_SIZE];
+  LoRaHomeFrame ack;
+  int retry = 0;
+  bool firstBurst = true;
+  while ((missing != 0) && (retry < MAX_RETRY_NO_VALID_ACK))
+  {
+    retry++;
+    if (!firstBurst)
+    {
+      this->stats.increment(LH_STAT_TX_RETRIES);
+    }
+    firstBurst = false;
+    uint8_t last = count - 1;
+    while ((missing & (1 << last)) == 0)
+    {
+      last--;
+    }
+    for (uint8_t i = 0; i <= last; i++)
+    {
+      if (missing & (1 << i))
+      {
+        uint8_t messageType = (i == last) ? LH_MSG_TYPE_NODE_MSG_ACK_REQ : LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ;
+        LoRaHomeFrame lhf(MY_NETWORK_ID, Node->getNodeId(), LH_NODE_ID_GATEWAY, messageType, firstCounter + i);
+        lhf.setFragment(i, count);
+#ifdef LH_DICTIONARY
+        lhf.compressed = true;
+#endif
+        lhf.payloadSize = this->serializePayload(jsonDoc, lhf.jsonPayload, LH_FRAGMENT_PAYLOAD_SIZE + 1, i * LH_FRAGMENT_PAYLOAD_SIZE);
+        uint8_t size = lhf.serialize(txBuffer);
+        LH_PROFILE_LAP(LH_PROFILE_SERIALIZE);
+        this->hopChannel();
+        this->send(txBuffer, size);
+      }
+    }
+    if ((this->receiveAck(firstCounter, ack) == true) && (ack.messageType == LH_MSG_TYPE_GW_FRAGMENT_ACK))
+    {
+      uint16_t received = ack.getAckBitmap();
+      if (missing & received)
+      {
+        // progress made, retries only count bursts without any new fragment acknowledged
+        retry = 0;
+      }
+      missing &= ~received;
+    }
+  }
+  if (missing != 0)
+  {
+    LH_LOG(LH_LOG_WARN, "--- fragmented message not fully acknowledged");
+  }
+  // one counter value per fragment
+  for (uint8_t i = 0; i < count; i++)
+  {
+    Node->incrementTxCounter();
+  }
+  return (missing == 0);
+}
+#endif
+
+#if LH_TX_WINDOW_SIZE > 1
+/**
+ * @brief queue a new frame in the TX window and send all the unacknowledged frames of the window
+ * Frames are sent back to back, only the last one requests a cumulative ACK.
+ * The ACK bitmap tells which counters have been received, only the gaps are resent.
+ * Frames still unacknowledged after MAX_RETRY_NO_VALID_ACK bursts stay in the window
+ * and are resent with the next transmission. When the window is full, the oldest frame is dropped.
+ * 
+ * @param jsonDoc the JSON payload of the new frame
+ * @return true if the new frame has been acknowledged
+ */
+bool LoRaHomeNode::sendWindowToGateway(JsonDocument &jsonDoc)
+{
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::sendWindowToGateway()");
+  if (this->windowCount == LH_TX_WINDOW_SIZE)
+  {
+    LH_LOG(LH_LOG_WARN, "--- TX window full, oldest frame dropped");
+    this->stats.increment(LH_STAT_TX_LOST);
+    this->windowPending &= ~(1 << this->windowHead);
+    this->windowHead = (this->windowHead + 1) % LH_TX_WINDOW_SIZE;
+    this->windowCount--;
+  }
+  // queue the new frame
+  uint8_t slot = (this->windowHead + this->windowCount) % LH_TX_WINDOW_SIZE;
+  uint8_t newSlot = slot;
+  LoRaHomeFrame &lhf = this->txWindow[slot];
+  lhf = LoRaHomeFrame(MY_NETWORK_ID, Node->getNodeId(), LH_NODE_ID_GATEWAY, LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ, Node->getTxCounter());
+  lhf.payloadSize = this->serializePayload(jsonDoc, lhf.jsonPayload, LH_FRAME_MAX_PAYLOAD_SIZE);
+#ifdef LH_DICTIONARY
+  lhf.compressed = true;
+#endif
+  this->appendStats(lhf);
+  this->windowPending |= (1 << slot);
+  this->windowCount++;
+  Node->incrementTxCounter();
+  // the window resends this frame until it is acknowledged or dropped: the next payloads carry the newer samples only
+  Node->commitSamples();
+
+  uint8_t txBuffer[LH_FRAME_MAX_SIZE];
+  LoRaHomeFrame ack;
+  int retry = 0;
+  bool firstBurst = true;
+  while ((this->windowPending != 0) && (retry < MAX_RETRY_NO_VALID_ACK))
+  {
+    retry++;
+    if (!firstBurst)
+    {
+      this->stats.increment(LH_STAT_TX_RETRIES);
+    }
+    firstBurst = false;
+    // burst of the pending frames, oldest first. The last one requests the ACK
+    uint8_t lastSlot = this->windowHead;
+    for (uint8_t i = 0; i < this->windowCount; i++)
+    {
+      slot = (this->windowHead + i) % LH_TX_WINDOW_SIZE;
+      if (this->windowPending & (1 << slot))
+      {
+        lastSlot = slot;
+      }
+    }
+    for (uint8_t i = 0; i < this->windowCount; i++)
+    {
+      slot = (this->windowHead + i) % LH_TX_WINDOW_SIZE;
+      if (this->windowPending & (1 << slot))
+      {
+        LoRaHomeFrame &pending = this->txWindow[slot];
+        pending.messageType = (slot == lastSlot) ? LH_MSG_TYPE_NODE_MSG_WINDOW_ACK_REQ : LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ;
+        uint8_t size = pending.serialize(txBuffer);
+        LH_PROFILE_LAP(LH_PROFILE_SERIALIZE);
+        this->hopChannel();
+        this->send(txBuffer, size);
+      }
+    }
+    uint16_t lastCounter = this->txWindow[lastSlot].counter;
+    if ((this->receiveAck(lastCounter, ack) == true) && (ack.messageType == LH_MSG_TYPE_GW_WINDOW_ACK))
+    {
+      uint16_t received = ack.getAckBitmap();
+      bool progress = false;
+      for (slot = 0; slot < LH_TX_WINDOW_SIZE; slot++)
+      {
+        uint16_t distance = lastCounter - this->txWindow[slot].counter;
+        if ((this->windowPending & (1 << slot)) && (distance < 16) && (received & (1 << distance)))
+        {
+          this->windowPending &= ~(1 << slot);
+          progress = true;
+        }
+      }
+      // release the acknowledged frames at the head of the window
+      while ((this->windowCount > 0) && ((this->windowPending & (1 << this->windowHead)) == 0))
+      {
+        this->windowHead = (this->windowHead + 1) % LH_TX_WINDOW_SIZE;
+        this->windowCount--;
+      }
+      if (progress)
+      {
+        retry = 0;
+      }
+    }
+  }
+  return (this->windowPending & (1 << newSlot)) == 0;
+}
+#endif
+
 /**
  * @brief 
  * 
  * @param txBuffer 
+ * @param size 
+ * @param retry the frame is the last one sent: the radio sends it again from its FIFO if it still holds it
+ * @param listenBeforeTalk false to send without channel activity detection, e.g. for an ACK to a downlink
  */
-void LoRaHomeNode::send(uint8_t *txBuffer, uint8_t size)
+void LoRaHomeNode::send(uint8_t *txBuffer, uint8_t size, bool retry, bool listenBeforeTalk)
 {
-  DEBUG_MSG("LoRaHomeNode::send");
-  DEBUG_MSG("--- sending LoRa message to LoRa2MQTT gateway");
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::send");
+  LH_LOG(LH_LOG_INFO, "--- sending LoRa message to LoRa2MQTT gateway");
   this->txMode();
-  LoRa.beginPacket();
-  for (uint8_t i = 0; i < size; i++)
+  if (listenBeforeTalk && !this->waitForFreeChannel())
+  {
+    LH_LOG(LH_LOG_WARN, "--- channel still busy, send anyway");
+    this->stats.increment(LH_STAT_LBT_BUSY);
+  }
+  LH_PROFILE_LAP(LH_PROFILE_LBT);
+  // a retry is sent from the radio FIFO, unless a received packet has overwritten the frame
+  if (!(retry && this->radio->retransmit()))
   {
-    LoRa.write(txBuffer[i]);
-    //DEBUG_MSG_VAR(txBuffer[i]);
+    this->radio->beginPacket();
+    this->radio->write(txBuffer, size);
+    LH_PROFILE_LAP(LH_PROFILE_FIFO_UPLOAD);
+    this->radio->endPacket();
   }
-  LoRa.endPacket();
+  LH_PROFILE_LAP(LH_PROFILE_TIME_ON_AIR);
+  this->stats.increment(LH_STAT_TX_FRAMES);
   this->rxMode();
+  LH_PROFILE_LAP(LH_PROFILE_TURNAROUND);
+}
+
+/**
+ * @brief read the next bytes of the packet received into the decoder, in SPI bursts
+ * 
+ * @param decoder decoder of the frame
+ * @param length number of bytes to read
+ */
+void LoRaHomeNode::readFrame(LoRaHomeFrameDecoder &decoder, uint8_t length)
+{
+  uint8_t chunk[LH_RADIO_READ_CHUNK];
+  while (length > 0)
+  {
+    uint8_t n = this->radio->read(chunk, min(length, LH_RADIO_READ_CHUNK));
+    if (n == 0)
+    {
+      return;
+    }
+    decoder.push(chunk, n);
+    length -= n;
+  }
 }
 
 /**
@@ -221,68 +1115,249 @@ void LoRaHomeNode::send(uint8_t *txBuffer, uint8_t size)
 */
 void LoRaHomeNode::receiveLoraMessage()
 {
+  // radio asleep outside of the receive windows
+  if (!this->updateRxWindows())
+  {
+    return;
+  }
   //try to parse packet
-  int packetSize = LoRa.parsePacket();
+  int packetSize = this->radio->parsePacket();
   // return immediately if no message available
   if (packetSize == 0)
   {
     return;
   }
+  // wake-on-radio: one frame per wake up, the radio goes back to sleep at the next call
+  if (this->rxPolicy == LH_RX_POLICY_WAKE_ON_RADIO)
+  {
+    this->wakeState = LH_WAKE_DONE;
+  }
   // check if we can accept the message
+  // no need to flush the FIFO, the next parsePacket() resets its pointer
   if ((packetSize > LH_FRAME_MAX_SIZE) || (packetSize < LH_FRAME_MIN_SIZE))
   {
-    while (LoRa.available())
-    {
-      // flush Fifo
-      LoRa.read();
-    }
     return;
   }
-  DEBUG_MSG("LoRaHomeNode::receiveLoraMessage");
-  // read bytes available
-  uint8_t rxMessage[LH_FRAME_MAX_SIZE];
-  uint8_t j = 0;
-  for (j = 0; j < packetSize; j++)
+  LH_PROFILE_START();
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::receiveLoraMessage");
+  // the frame is decoded while the FIFO is read: CRC and header fields are computed on the fly
+  // and the payload is written once, in the frame. No raw copy of the frame in RAM.
+  LoRaHomeFrame lhf;
+  LoRaHomeFrameDecoder decoder;
+  decoder.begin(lhf, packetSize);
+  // read the emitter and recipient first: the frames for other nodes are dropped
+  // without reading the rest of the FIFO nor checking the CRC.
+  // The packet has been fully received at this point: the radio raises no interrupt on a valid header
+  // (DIO3) on this board, so the reception itself is not aborted early.
+  this->readFrame(decoder, LH_FRAME_INDEX_RECIPIENT + 1);
+  if ((lhf.nodeIdRecipient != Node->getNodeId()) && (lhf.nodeIdRecipient != LH_NODE_ID_BROADCAST))
   {
-    // read available bytes
-    rxMessage[j] = (char)LoRa.read();
+    // unverified: the recipient byte of a corrupted frame is counted too
+    this->stats.increment(LH_STAT_RX_OTHER_NODE);
+    return;
   }
-  // create LoRa Home frame
-  LoRaHomeFrame lhf;
-  lhf.createFromRxMessage(rxMessage, j, true);
+  // the radio keeps listening in continuous RX: the next packets received during
+  // the processing are stored after this one in the radio FIFO
+  this->readFrame(decoder, packetSize - (LH_FRAME_INDEX_RECIPIENT + 1));
+  LH_PROFILE_LAP(LH_PROFILE_FIFO_READ);
+  uint8_t verdict = decoder.end();
+  if (verdict != LH_DECODE_OK)
+  {
+    LH_LOG(LH_LOG_WARN, "--- ignore message, invalid frame");
+    this->stats.increment((verdict == LH_DECODE_CRC_ERROR) ? LH_STAT_RX_CRC_ERROR : LH_STAT_RX_INVALID);
+    return;
+  }
+  LH_PROFILE_LAP(LH_PROFILE_DECODE);
   if (lhf.networkID != MY_NETWORK_ID)
   {
-    DEBUG_MSG("--- ignore message, not the right network ID");
+    LH_LOG_VALUE(LH_LOG_WARN, "--- ignore message, not the right network ID", lhf.networkID);
+    this->stats.increment(LH_STAT_RX_WRONG_NETWORK);
     return;
   }
-  DEBUG_MSG("--- message received");
+#ifdef LH_SECURITY
+  // replay protection: the counter of the authenticated frames shall increase.
+  // The reference is kept in EEPROM: only the very first frame of the node sets it
+  int16_t counterAge = lhf.counter - this->state.rxCounter;
+  if (this->state.rxCounterValid && (counterAge < 0))
+  {
+    LH_LOG_VALUE(LH_LOG_WARN, "--- ignore message, replayed counter", lhf.counter);
+    this->stats.increment(LH_STAT_RX_INVALID);
+    return;
+  }
+#endif
+  this->stats.increment(LH_STAT_RX_FRAMES);
+  LH_LOG(LH_LOG_INFO, "--- message received");
+  if (lhf.isFragment())
+  {
+    LH_LOG(LH_LOG_WARN, "--- ignore message, fragmented downlink not supported");
+    return;
+  }
+#ifdef LH_SECURITY
+  if (this->state.rxCounterValid && (counterAge == 0))
+  {
+    // same frame sent again, its ACK was lost: acknowledged again but not dispatched twice
+    LH_LOG(LH_LOG_INFO, "--- duplicate message");
+    this->acknowledge(lhf);
+    return;
+  }
+  // saved before the frame is acted upon: after a reset, it can not be replayed
+  this->state.rxCounter = lhf.counter;
+  this->state.rxCounterValid = true;
+  loraHomeStorage.save(this->state);
+#endif
   // serializeJson(jsonDoc, Serial);
   uint8_t nodeInvoked = lhf.nodeIdRecipient;
-  // Am I the node invoked for this messages
-  if (nodeInvoked == Node->getNodeId())
+  // Am I the node invoked for this messages, or is it a broadcast
+  if ((nodeInvoked == Node->getNodeId()) || (nodeInvoked == LH_NODE_ID_BROADCAST))
   {
     // I am the one!
-    DEBUG_MSG("--- I am node invoked");
+    LH_LOG(LH_LOG_INFO, "--- I am node invoked");
     // parse JSON message
-    DeserializationError error = deserializeJson(jsonDoc, lhf.jsonPayload);
-    // deserializeJson error
-    if (error)
+    char *payload = lhf.jsonPayload;
+#ifdef LH_DICTIONARY
+    // expanded JSON text, parsed in place: must live until the end of the dispatch
+    char expanded[LH_DICTIONARY_EXPANDED_SIZE];
+    if (lhf.compressed)
+    {
+      size_t expandedSize;
+      uint8_t verdict = LoRaHomeDictionary::expand(lhf.jsonPayload, lhf.payloadSize, expanded, sizeof(expanded), expandedSize);
+      if (verdict == LH_EXPAND_OVERFLOW)
+      {
+        LH_LOG_VALUE(LH_LOG_WARN, "--- ignore message, expanded payload too large", lhf.payloadSize);
+        return;
+      }
+      if (verdict != LH_EXPAND_OK)
+      {
+        LH_LOG(LH_LOG_WARN, "--- ignore message, unknown key token");
+        return;
+      }
+      payload = expanded;
+    }
+#else
+    if (lhf.compressed)
     {
-      DEBUG_MSG("--- deserializeJson error");
+      LH_LOG(LH_LOG_WARN, "--- ignore message, tokenized keys not supported");
       return;
     }
-    // if message received request an ack
-    if ((lhf.messageType == LH_MSG_TYPE_GW_MSG_ACK) || (lhf.messageType == LH_MSG_TYPE_NODE_MSG_ACK_REQ))
+#endif
+    DeserializationError error = deserializeJson(jsonDoc, payload);
+    LH_PROFILE_LAP(LH_PROFILE_JSON_PARSE);
+    // deserializeJson error
+    if (error)
     {
-      LoRaHomeFrame lhfAck(MY_NETWORK_ID, Node->getNodeId(), lhf.nodeIdEmitter, LH_MSG_TYPE_NODE_ACK, lhf.counter);
-      uint8_t txBuffer[LH_FRAME_MIN_SIZE];
-      uint8_t size = lhfAck.serialize(txBuffer);
-      this->send(txBuffer, size);
-      DEBUG_MSG("--- ack sent");
+      LH_LOG(LH_LOG_WARN, "--- deserializeJson error");
+      return;
     }
+    this->acknowledge(lhf);
+    this->handleDiagnosticsRequest(jsonDoc);
     //JsonObject root = jsonDoc.to<JsonObject>();
     Node->parseJsonRxPayload(jsonDoc);
+    LH_PROFILE_LAP(LH_PROFILE_APP_CALLBACK);
+  }
+}
+
+/**
+ * @brief send the ACK of a frame received, if its type requests one
+ * A broadcast is never acknowledged: all the nodes would answer at once
+ * 
+ * @param lhf the frame received
+ */
+void LoRaHomeNode::acknowledge(LoRaHomeFrame &lhf)
+{
+  if (((lhf.messageType != LH_MSG_TYPE_GW_MSG_ACK) && (lhf.messageType != LH_MSG_TYPE_NODE_MSG_ACK_REQ)) ||
+      (lhf.nodeIdRecipient == LH_NODE_ID_BROADCAST))
+  {
+    return;
   }
+  LoRaHomeFrame lhfAck(MY_NETWORK_ID, Node->getNodeId(), lhf.nodeIdEmitter, LH_MSG_TYPE_NODE_ACK, lhf.counter);
+  uint8_t txBuffer[LH_FRAME_MIN_SIZE];
+  uint8_t size = lhfAck.serialize(txBuffer);
+  // the gateway waits for the ACK right after its downlink: no listen before talk
+  this->send(txBuffer, size, false, false);
+  LH_LOG(LH_LOG_INFO, "--- ack sent");
 }
 
+/**
+ * @brief handle the diagnostics requested by the gateway with the reserved "diag" key of a downlink
+ * "diag":"stats" appends the stats block to the next uplink
+ * "diag":"prof" sends the profiler histograms
+ * 
+ * @param jsonDoc the JSON payload received
+ */
+void LoRaHomeNode::handleDiagnosticsRequest(JsonDocument &jsonDoc)
+{
+  const char *diag = jsonDoc["diag"];
+  if (diag == NULL)
+  {
+    return;
+  }
+  if (strcmp(diag, "stats") == 0)
+  {
+    this->statsRequested = true;
+  }
+#ifdef LH_PROFILER
+  if (strcmp(diag, "prof") == 0)
+  {
+    this->sendProfileToGateway();
+  }
+#endif
+}
+
+/**
+ * @brief append the stats block to the payload of an uplink frame when due
+ * The payload keeps room for the string terminator, the block is postponed when it does not fit
+ * 
+ * @param lhf the uplink frame, payloadSize set
+ */
+void LoRaHomeNode::appendStats(LoRaHomeFrame &lhf)
+{
+  bool due = this->statsRequested || ((STATS_UPLINK_INTERVAL != 0) && (this->uplinksSinceStats >= STATS_UPLINK_INTERVAL));
+  if (!due || (lhf.payloadSize + LH_STATS_SIZE >= LH_FRAME_MAX_PAYLOAD_SIZE))
+  {
+    return;
+  }
+  lhf.payloadSize += this->stats.serialize((uint8_t *)&lhf.jsonPayload[lhf.payloadSize]);
+  lhf.withStats = true;
+  this->uplinksSinceStats = 0;
+  this->statsRequested = false;
+}
+
+#ifdef LH_PROFILER
+/**
+ * @brief send the profiler histograms to the gateway, one LH_MSG_TYPE_NODE_DIAG frame per stage, without ACK
+ * Each frame is sent on a hopped uplink channel after listen before talk, then the node is back on the downlink channel
+ * 
+ */
+void LoRaHomeNode::sendProfileToGateway()
+{
+  LH_LOG(LH_LOG_DEBUG, "LoRaHomeNode::sendProfileToGateway()");
+  if (this->txCounterExhausted())
+  {
+    return;
+  }
+  this->reserveCounters();
+  uint8_t txBuffer[LH_FRAME_MAX_SIZE];
+  for (uint8_t stage = 0; stage < LH_PROFILE_STAGES; stage++)
+  {
+    LoRaHomeFrame lhf(MY_NETWORK_ID, Node->getNodeId(), LH_NODE_ID_GATEWAY, LH_MSG_TYPE_NODE_DIAG, Node->getTxCounter());
+    uint8_t i = 0;
+    lhf.jsonPayload[i++] = LH_DIAG_PROFILE;
+    lhf.jsonPayload[i++] = stage;
+    for (uint8_t bucket = 0; bucket < LH_PROFILE_BUCKETS; bucket++)
+    {
+      uint16_t count = loraHomeProfiler.getCount(stage, bucket);
+      lhf.jsonPayload[i++] = count & 0xff;
+      lhf.jsonPayload[i++] = (count >> 8) & 0xff;
+    }
+    lhf.payloadSize = i;
+    uint8_t size = lhf.serialize(txBuffer);
+    // same path as the other uplinks: channel hopping, listen before talk
+    this->hopChannel();
+    this->send(txBuffer, size);
+    Node->incrementTxCounter();
+  }
+  this->endUplink();
+}
+#endif
+
 LoRaHomeNode loraHomeNode;
\ No newline at end of file
@@ -4,22 +4,104 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <LoRaHomeFrame.h>
+#include <LoRaHomeRadio.h>
+#include <LoRaHomeStats.h>
+#include <LoRaHomeStorage.h>
+
+// Number of uplink frames in flight waiting for a cumulative ACK. 1 is stop-and-wait (-D LH_TX_WINDOW_SIZE=n to change)
+// Each slot of the window holds a LoRaHomeFrame in RAM. Max 16, the width of the ACK bitmap
+#ifndef LH_TX_WINDOW_SIZE
+#define LH_TX_WINDOW_SIZE 1
+#endif
+static_assert((LH_TX_WINDOW_SIZE >= 1) && (LH_TX_WINDOW_SIZE <= 16), "LH_TX_WINDOW_SIZE shall be 1 to 16 (16 bits ACK bitmap)");
+#ifdef RAMEND
+// ~140 bytes per slot: 3 slots at most on an ATmega328P
+static_assert(LH_TX_WINDOW_SIZE * sizeof(LoRaHomeFrame) <= (RAMEND - RAMSTART + 1) / 4, "LH_TX_WINDOW_SIZE too large for the RAM");
+#endif
+
+// bytes read from the radio FIFO per SPI burst, buffered on the stack
+const uint8_t LH_RADIO_READ_CHUNK = 16;
+
+// receive policies
+const uint8_t LH_RX_POLICY_CONTINUOUS = 0; // radio always listening
+const uint8_t LH_RX_POLICY_WINDOWS = 1;    // radio asleep except in the RX1 / RX2 windows following each uplink
+const uint8_t LH_RX_POLICY_WAKE_ON_RADIO = 2; // radio asleep, woken periodically by a CAD, downlinks sent with a long preamble
 
 class LoRaHomeNode
 {
 public:
     LoRaHomeNode();
+    void setRadio(LoRaHomeRadio *radio);
     void setup();
     void sendToGateway();
     void receiveLoraMessage();
+    unsigned long getTimeToNextRxEvent();
+    void setRxPolicy(uint8_t policy);
+    void setSpreadingFactor(uint8_t spreadingFactor);
+    void setTxPower(int8_t txPower);
+    LoRaHomeStats &getStats();
+#ifdef LH_PROFILER
+    void sendProfileToGateway();
+#endif
 
 private:
     void rxMode();
     void txMode();
-    bool receiveAck();
-    void send(uint8_t* txBuffer, uint8_t size);
+    void setChannel(uint8_t channel);
+    void hopChannel();
+    void reserveCounters();
+    bool txCounterExhausted();
+    bool waitForFreeChannel();
+    void scheduleRxWindows();
+    void endUplink();
+    bool updateRxWindows();
+    bool updateWakeOnRadio();
+    void acknowledge(LoRaHomeFrame &lhf);
+    void handleDiagnosticsRequest(JsonDocument &jsonDoc);
+    void appendStats(LoRaHomeFrame &lhf);
+    size_t serializePayload(JsonDocument &jsonDoc, char *buffer, size_t capacity, size_t offset = 0);
+    size_t measurePayload(JsonDocument &jsonDoc);
+    bool sendFrameToGateway(JsonDocument &jsonDoc);
+    bool receiveAck(uint16_t counter, LoRaHomeFrame &ack);
+    void readFrame(LoRaHomeFrameDecoder &decoder, uint8_t length);
+#if LH_MAX_FRAGMENTS > 1
+    bool sendFragmentsToGateway(JsonDocument &jsonDoc, uint16_t messageSize);
+#endif
+#if LH_TX_WINDOW_SIZE > 1
+    bool sendWindowToGateway(JsonDocument &jsonDoc);
+#endif
+    void send(uint8_t* txBuffer, uint8_t size, bool retry = false, bool listenBeforeTalk = true);
     static uint16_t crc16_ccitt(char *data, unsigned int data_len);
-    StaticJsonDocument<LH_FRAME_MAX_PAYLOAD_SIZE> jsonDoc;
+    // JSON payload of the uplink being sent or of the downlink received, never both at once.
+    // Static rather than on the stack: sized for LH_MAX_FRAGMENTS frames, it shows in the RAM usage of the build
+    StaticJsonDocument<LH_MAX_FRAGMENTS * LH_FRAME_MAX_PAYLOAD_SIZE> jsonDoc;
+    LoRaHomeRadio *radio;
+    uint8_t rxPolicy;
+    uint8_t channel;
+#ifdef LH_STORAGE
+    // state restored at boot and saved on change, with the replay protection reference of LH_SECURITY
+    LoRaHomeState state;
+#endif
+    unsigned long lastUplinkTime;
+    bool rxWindowOpen;
+    // wake-on-radio: LH_WAKE_xxx and start of the last CAD
+    uint8_t wakeState;
+    unsigned long wakeTime;
+    // report on change: hash of the last acknowledged payload
+    uint32_t lastReportHash;
+    unsigned long lastReportTime;
+    bool lastReportValid;
+    // link and protocol stats, appended to every STATS_UPLINK_INTERVAL th uplink or on request
+    LoRaHomeStats stats;
+    uint8_t uplinksSinceStats;
+    bool statsRequested;
+#if LH_TX_WINDOW_SIZE > 1
+    // ring of the frames sent and not yet acknowledged
+    LoRaHomeFrame txWindow[LH_TX_WINDOW_SIZE];
+    uint8_t windowHead;
+    uint8_t windowCount;
+    uint16_t windowPending;
+#endif
 };
 
 extern LoRaHomeNode loraHomeNode;
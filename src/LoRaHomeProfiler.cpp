@@ -0,0 +1,163 @@
+#include <LoRaHomeProfiler.h>
+
+// the whole module is compiled out unless the profiler is enabled (-D LH_PROFILER)
+#ifdef LH_PROFILER
+
+#ifdef __AVR__
+extern uint8_t __heap_start;
+extern void *__brkval;
+#endif
+
+/**
+ * @brief Construct a new LoRaHomeProfiler object, with empty histograms
+ * 
+ */
+LoRaHomeProfiler::LoRaHomeProfiler()
+{
+    this->lastLap = 0;
+    this->reset();
+}
+
+/**
+ * @brief start timing a path. The first lap is measured from now
+ * 
+ */
+void LoRaHomeProfiler::start()
+{
+    this->lastLap = micros();
+}
+
+/**
+ * @brief end of a stage: record the time elapsed since the previous lap
+ * 
+ * @param stage LH_PROFILE_xxx stage
+ */
+void LoRaHomeProfiler::lap(uint8_t stage)
+{
+    unsigned long now = micros();
+    this->record(stage, now - this->lastLap);
+    this->lastLap = now;
+}
+
+/**
+ * @brief add a duration to the histogram of a stage
+ * 
+ * @param stage LH_PROFILE_xxx stage
+ * @param duration in us
+ */
+void LoRaHomeProfiler::record(uint8_t stage, unsigned long duration)
+{
+    if (stage >= LH_PROFILE_STAGES)
+    {
+        return;
+    }
+    uint16_t &count = this->histograms[stage][getBucket(duration)];
+    if (count != 0xFFFF)
+    {
+        count++;
+    }
+}
+
+/**
+ * @brief clear all the histograms
+ * 
+ */
+void LoRaHomeProfiler::reset()
+{
+    memset(this->histograms, 0, sizeof(this->histograms));
+}
+
+/**
+ * @brief print the histograms, one CSV line per stage: "prof,<stage>,<bucket 0>,...,<bucket n>"
+ * followed by the stack headroom: "stack,<bytes>"
+ * 
+ * @param out where to print, typically Serial
+ */
+void LoRaHomeProfiler::dump(Print &out)
+{
+    for (uint8_t stage = 0; stage < LH_PROFILE_STAGES; stage++)
+    {
+        out.print(F("prof,"));
+        out.print(stage);
+        for (uint8_t bucket = 0; bucket < LH_PROFILE_BUCKETS; bucket++)
+        {
+            out.print(',');
+            out.print(this->histograms[stage][bucket]);
+        }
+        out.println();
+    }
+    out.print(F("stack,"));
+    out.println(this->getStackHeadroom());
+}
+
+/**
+ * @brief Get the count of a histogram bucket
+ * 
+ * @param stage LH_PROFILE_xxx stage
+ * @param bucket bucket index
+ * @return uint16_t number of durations recorded in the bucket
+ */
+uint16_t LoRaHomeProfiler::getCount(uint8_t stage, uint8_t bucket)
+{
+    return this->histograms[stage][bucket];
+}
+
+/**
+ * @brief paint the free RAM between the heap and the current stack pointer
+ * To be called once, as early as possible in setup()
+ * 
+ */
+void LoRaHomeProfiler::paintStack()
+{
+#ifdef __AVR__
+    uint8_t marker;
+    uint8_t *p = (__brkval == 0) ? &__heap_start : (uint8_t *)__brkval;
+    // keep a margin for the frame of this function
+    while (p < &marker - 8)
+    {
+        *p++ = LH_PROFILE_STACK_PAINT;
+    }
+#endif
+}
+
+/**
+ * @brief Get the number of bytes never reached by the stack since paintStack()
+ * 
+ * @return uint16_t untouched bytes above the heap, 0 if not supported
+ */
+uint16_t LoRaHomeProfiler::getStackHeadroom()
+{
+    uint16_t headroom = 0;
+#ifdef __AVR__
+    uint8_t marker;
+    uint8_t *p = (__brkval == 0) ? &__heap_start : (uint8_t *)__brkval;
+    while ((p < &marker) && (*p == LH_PROFILE_STACK_PAINT))
+    {
+        p++;
+        headroom++;
+    }
+#endif
+    return headroom;
+}
+
+/**
+ * @brief log2 bucket of a duration
+ * 
+ * @param duration in us
+ * @return uint8_t bucket index
+ */
+uint8_t LoRaHomeProfiler::getBucket(unsigned long duration)
+{
+    uint8_t bucket = 0;
+    duration >>= 3;
+    while ((duration != 0) && (bucket < LH_PROFILE_BUCKETS - 1))
+    {
+        duration >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+LoRaHomeProfiler loraHomeProfiler;
+
+#endif
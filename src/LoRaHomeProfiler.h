@@ -0,0 +1,64 @@
+#ifndef LORAHOMEPROFILER_H
+#define LORAHOMEPROFILER_H
+
+#include <Arduino.h>
+
+// Tx path stages
+const uint8_t LH_PROFILE_JSON_BUILD = 0;  // addJsonTxPayload
+const uint8_t LH_PROFILE_SERIALIZE = 1;   // serializeJson + frame serialization (CRC, security)
+const uint8_t LH_PROFILE_LBT = 2;         // standby + listen before talk
+const uint8_t LH_PROFILE_FIFO_UPLOAD = 3; // frame written into the radio FIFO over SPI
+const uint8_t LH_PROFILE_TIME_ON_AIR = 4; // until TX done
+const uint8_t LH_PROFILE_TURNAROUND = 5;  // TX to RX switch
+const uint8_t LH_PROFILE_ACK_WAIT = 6;    // until ACK received or timeout
+// Rx path stages
+const uint8_t LH_PROFILE_FIFO_READ = 7;    // frame read from the radio FIFO over SPI, CRC and fields decoded on the fly
+const uint8_t LH_PROFILE_DECODE = 8;       // verdict: CRC and MIC checks, payload decryption
+const uint8_t LH_PROFILE_JSON_PARSE = 9;   // deserializeJson
+const uint8_t LH_PROFILE_APP_CALLBACK = 10; // parseJsonRxPayload
+const uint8_t LH_PROFILE_STAGES = 11;
+
+// bucket 0: < 8 us (micros() resolution at 8 MHz), bucket i: [2^(i+2), 2^(i+3)) us, last bucket: >= 2^21 us
+const uint8_t LH_PROFILE_BUCKETS = 20;
+
+// free RAM between the heap and the stack is painted with this value, the stack high water mark is where it stops
+const uint8_t LH_PROFILE_STACK_PAINT = 0xC5;
+
+// stage timestamps are compiled out unless the profiler is enabled (-D LH_PROFILER)
+#ifdef LH_PROFILER
+#define LH_PROFILE_START() loraHomeProfiler.start()
+#define LH_PROFILE_LAP(stage) loraHomeProfiler.lap(stage)
+#else
+#define LH_PROFILE_START()
+#define LH_PROFILE_LAP(stage)
+#endif
+
+/**
+ * @brief Per stage latency histograms of the Tx and Rx hot paths
+ * Stages are timed as laps: each lap records the time elapsed since the previous lap (or start)
+ * into the log2 histogram of the stage. Counters saturate at 0xFFFF.
+ * The worst case stack depth of all the paths is measured by stack painting (AVR only).
+ */
+class LoRaHomeProfiler
+{
+public:
+    LoRaHomeProfiler();
+    void start();
+    void lap(uint8_t stage);
+    void record(uint8_t stage, unsigned long duration);
+    void reset();
+    void dump(Print &out);
+    uint16_t getCount(uint8_t stage, uint8_t bucket);
+    void paintStack();
+    uint16_t getStackHeadroom();
+
+private:
+    static uint8_t getBucket(unsigned long duration);
+
+    unsigned long lastLap;
+    uint16_t histograms[LH_PROFILE_STAGES][LH_PROFILE_BUCKETS];
+};
+
+extern LoRaHomeProfiler loraHomeProfiler;
+
+#endif
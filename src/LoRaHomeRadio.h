@@ -0,0 +1,57 @@
+#ifndef LORAHOMERADIO_H
+#define LORAHOMERADIO_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Radio used by LoRaHomeNode
+ * Implemented by LoRaHomeRadioSX127x on the LoRa library, by LoRaHomeRadioRecorder to capture the traffic
+ * of another radio and by LoRaHomeRadioReplay to feed captured traffic back through the node.
+ * Methods follow the LoRaClass API.
+ */
+class LoRaHomeRadio
+{
+public:
+    virtual ~LoRaHomeRadio() {}
+    // begin and configure
+    virtual bool begin(long frequency) = 0;
+    virtual void setSpreadingFactor(int sf) = 0;
+    virtual void setSignalBandwidth(long sbw) = 0;
+    virtual void setCodingRate4(int denominator) = 0;
+    virtual void setSyncWord(int sw) = 0;
+    virtual void setPreambleLength(long length) = 0;
+    virtual void setTxPower(int level) = 0;
+    virtual void setFrf(uint32_t frf) = 0;
+    virtual void enableCrc() = 0;
+    virtual void enableInvertIQ() = 0;
+    virtual void disableInvertIQ() = 0;
+    // operating modes
+    virtual void idle() = 0;
+    virtual void sleep() = 0;
+    virtual void receive() = 0;
+    // send
+    virtual void beginPacket() = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual void endPacket() = 0;
+    // send the last packet again if the radio still holds it, false if it shall be written again
+    virtual bool retransmit() = 0;
+    // receive: size of the packet received (0 if none), then its bytes. After receive(), the radio keeps listening
+    virtual int parsePacket() = 0;
+    virtual int read() = 0;
+    // bulk read of the next bytes of the packet, in one SPI burst on a radio: number of bytes read
+    virtual size_t read(uint8_t *buffer, size_t length) = 0;
+    // interrupt driven reception: callback called from the DIO0 IRQ with the size of the packet received,
+    // its bytes are then read with read(). NULL to go back to parsePacket() polling
+    virtual void onReceive(void (*callback)(int)) = 0;
+    // channel activity detection: started, then polled until the CAD done IRQ (-1 while running, 1 if detected)
+    virtual void channelActivityDetection() = 0;
+    virtual int channelActivityResult() = 0;
+    // interrupt driven CAD: callback called from the CAD done IRQ, true if a preamble was detected
+    virtual void onCadDone(void (*callback)(bool)) = 0;
+    // metrics
+    virtual int packetRssi() = 0;
+    virtual float packetSnr() = 0;
+    virtual uint8_t random() = 0;
+};
+
+#endif
@@ -0,0 +1,719 @@
+#include <LoRaHomeRadioCapture.h>
+
+/**
+ * @brief print a capture line
+ * 
+ * @param out where to print
+ * @param tag "rx" or "tx"
+ * @param packet bytes of the packet
+ * @param length number of bytes
+ * @param rssi RSSI in dBm, rx only
+ * @param snr SNR in 0.25 dB, rx only
+ */
+static void printCaptureLine(Print &out, const char *tag, const uint8_t *packet, uint8_t length, int rssi, int snr)
+{
+    static const char hex[] PROGMEM = "0123456789abcdef";
+    out.print(tag);
+    out.print(',');
+    out.print(millis());
+    out.print(',');
+    if (tag[0] == 'r')
+    {
+        out.print(rssi);
+        out.print(',');
+        out.print(snr);
+        out.print(',');
+    }
+    for (uint8_t i = 0; i < length; i++)
+    {
+        out.write(pgm_read_byte(&hex[packet[i] >> 4]));
+        out.write(pgm_read_byte(&hex[packet[i] & 0x0f]));
+    }
+    out.println();
+}
+
+/**
+ * @brief copy the next bytes of a packet held in RAM
+ * 
+ * @param packet bytes of the packet
+ * @param length number of bytes of the packet
+ * @param index next byte to read, updated
+ * @param buffer where to copy the bytes
+ * @param size number of bytes wanted
+ * @return size_t number of bytes copied
+ */
+static size_t readPacket(const uint8_t *packet, uint8_t length, uint8_t &index, uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while ((n < size) && (index < length))
+    {
+        buffer[n++] = packet[index++];
+    }
+    return n;
+}
+
+LoRaHomeRadioRecorder *LoRaHomeRadioRecorder::receiving = NULL;
+
+/**
+ * @brief Construct a new LoRaHomeRadioRecorder object
+ * 
+ * @param radio the radio actually used
+ * @param capture where to print the capture lines
+ */
+LoRaHomeRadioRecorder::LoRaHomeRadioRecorder(LoRaHomeRadio &radio, Print &capture) : radio(radio), capture(&capture)
+{
+    this->receiveCallback = NULL;
+    this->spreadingFactor = 0;
+    this->frf = 0;
+    this->length = 0;
+    this->index = 0;
+}
+
+/**
+ * @brief Construct a new LoRaHomeRadioRecorder object without capture lines, for recorders overriding record()
+ * 
+ * @param radio the radio actually used
+ */
+LoRaHomeRadioRecorder::LoRaHomeRadioRecorder(LoRaHomeRadio &radio) : radio(radio), capture(NULL)
+{
+    this->receiveCallback = NULL;
+    this->spreadingFactor = 0;
+    this->frf = 0;
+    this->length = 0;
+    this->index = 0;
+}
+
+/**
+ * @brief record a packet sent or received: print its capture line
+ * 
+ * @param tx true for a packet sent
+ * @param packet bytes of the packet
+ * @param length number of bytes
+ * @param rssi RSSI in dBm, rx only
+ * @param snr SNR in 0.25 dB, rx only
+ */
+void LoRaHomeRadioRecorder::record(bool tx, const uint8_t *packet, uint8_t length, int rssi, int snr)
+{
+    if (this->capture != NULL)
+    {
+        printCaptureLine(*this->capture, tx ? "tx" : "rx", packet, length, rssi, snr);
+    }
+}
+
+bool LoRaHomeRadioRecorder::begin(long frequency)
+{
+    return this->radio.begin(frequency);
+}
+
+void LoRaHomeRadioRecorder::setSpreadingFactor(int sf)
+{
+    this->spreadingFactor = sf;
+    this->radio.setSpreadingFactor(sf);
+}
+
+void LoRaHomeRadioRecorder::setSignalBandwidth(long sbw)
+{
+    this->radio.setSignalBandwidth(sbw);
+}
+
+void LoRaHomeRadioRecorder::setCodingRate4(int denominator)
+{
+    this->radio.setCodingRate4(denominator);
+}
+
+void LoRaHomeRadioRecorder::setSyncWord(int sw)
+{
+    this->radio.setSyncWord(sw);
+}
+
+void LoRaHomeRadioRecorder::setPreambleLength(long length)
+{
+    this->radio.setPreambleLength(length);
+}
+
+void LoRaHomeRadioRecorder::setTxPower(int level)
+{
+    this->radio.setTxPower(level);
+}
+
+void LoRaHomeRadioRecorder::setFrf(uint32_t frf)
+{
+    this->frf = frf;
+    this->radio.setFrf(frf);
+}
+
+void LoRaHomeRadioRecorder::enableCrc()
+{
+    this->radio.enableCrc();
+}
+
+void LoRaHomeRadioRecorder::enableInvertIQ()
+{
+    this->radio.enableInvertIQ();
+}
+
+void LoRaHomeRadioRecorder::disableInvertIQ()
+{
+    this->radio.disableInvertIQ();
+}
+
+void LoRaHomeRadioRecorder::idle()
+{
+    this->radio.idle();
+}
+
+void LoRaHomeRadioRecorder::sleep()
+{
+    this->radio.sleep();
+}
+
+void LoRaHomeRadioRecorder::receive()
+{
+    this->radio.receive();
+}
+
+void LoRaHomeRadioRecorder::beginPacket()
+{
+    this->length = 0;
+    this->radio.beginPacket();
+}
+
+/**
+ * @brief send bytes, kept to be recorded at endPacket()
+ * 
+ */
+size_t LoRaHomeRadioRecorder::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; (i < size) && (this->length < LH_FRAME_MAX_SIZE); i++)
+    {
+        this->packet[this->length++] = buffer[i];
+    }
+    return this->radio.write(buffer, size);
+}
+
+void LoRaHomeRadioRecorder::endPacket()
+{
+    this->radio.endPacket();
+    this->record(true, this->packet, this->length, 0, 0);
+}
+
+/**
+ * @brief the packet sent is not kept to be recorded again: the packets received use the same buffer
+ * 
+ * @return false, the packet shall be written again
+ */
+bool LoRaHomeRadioRecorder::retransmit()
+{
+    return false;
+}
+
+/**
+ * @brief receive a packet: read and record it
+ * 
+ * @return int size of the packet, 0 if none
+ */
+int LoRaHomeRadioRecorder::parsePacket()
+{
+    int size = this->radio.parsePacket();
+    if (size > 0)
+    {
+        this->capturePacket(size);
+    }
+    return size;
+}
+
+/**
+ * @brief read the packet received from the radio, in one burst, and record it
+ * 
+ * @param size size of the packet
+ */
+void LoRaHomeRadioRecorder::capturePacket(int size)
+{
+    this->index = 0;
+    this->length = this->radio.read(this->packet, min(size, (int)LH_FRAME_MAX_SIZE));
+    this->record(false, this->packet, this->length, this->radio.packetRssi(), (int)(this->radio.packetSnr() * 4));
+}
+
+int LoRaHomeRadioRecorder::read()
+{
+    if (this->index >= this->length)
+    {
+        return -1;
+    }
+    return this->packet[this->index++];
+}
+
+size_t LoRaHomeRadioRecorder::read(uint8_t *buffer, size_t length)
+{
+    return readPacket(this->packet, this->length, this->index, buffer, length);
+}
+
+/**
+ * @brief register the receive callback: the packet is read and recorded in the IRQ, then served from RAM
+ * 
+ * @param callback called with the size of the packet received, NULL to unregister
+ */
+void LoRaHomeRadioRecorder::onReceive(void (*callback)(int))
+{
+    this->receiveCallback = callback;
+    LoRaHomeRadioRecorder::receiving = (callback != NULL) ? this : NULL;
+    this->radio.onReceive((callback != NULL) ? LoRaHomeRadioRecorder::receiveTrampoline : NULL);
+}
+
+/**
+ * @brief receive IRQ of the radio: record the packet, then call the callback of the application
+ * 
+ * @param size size of the packet received
+ */
+void LoRaHomeRadioRecorder::receiveTrampoline(int size)
+{
+    LoRaHomeRadioRecorder *recorder = LoRaHomeRadioRecorder::receiving;
+    if (recorder == NULL)
+    {
+        return;
+    }
+    recorder->capturePacket(size);
+    recorder->receiveCallback(size);
+}
+
+void LoRaHomeRadioRecorder::channelActivityDetection()
+{
+    this->radio.channelActivityDetection();
+}
+
+int LoRaHomeRadioRecorder::channelActivityResult()
+{
+    return this->radio.channelActivityResult();
+}
+
+void LoRaHomeRadioRecorder::onCadDone(void (*callback)(bool))
+{
+    this->radio.onCadDone(callback);
+}
+
+int LoRaHomeRadioRecorder::packetRssi()
+{
+    return this->radio.packetRssi();
+}
+
+float LoRaHomeRadioRecorder::packetSnr()
+{
+    return this->radio.packetSnr();
+}
+
+uint8_t LoRaHomeRadioRecorder::random()
+{
+    return this->radio.random();
+}
+
+/**
+ * @brief Construct a new LoRaHomeRadioRing object, with an empty ring
+ * 
+ * @param radio the radio actually used
+ */
+LoRaHomeRadioRing::LoRaHomeRadioRing(LoRaHomeRadio &radio) : LoRaHomeRadioRecorder(radio)
+{
+    this->clear();
+}
+
+/**
+ * @brief empty the ring
+ * 
+ */
+void LoRaHomeRadioRing::clear()
+{
+    this->head = 0;
+    this->used = 0;
+    this->dropped = 0;
+}
+
+/**
+ * @brief stream the records in the binary capture format, then empty the ring
+ * 
+ * @param out where to write the capture, e.g. Serial
+ */
+void LoRaHomeRadioRing::dump(Print &out)
+{
+    out.write('L');
+    out.write('H');
+    out.write('C');
+    out.write(LH_CAPTURE_VERSION);
+    out.write((uint8_t)(this->dropped & 0xff));
+    out.write((uint8_t)(this->dropped >> 8));
+    out.write((uint8_t)(this->used & 0xff));
+    out.write((uint8_t)(this->used >> 8));
+    uint16_t i = this->head;
+    for (uint16_t n = 0; n < this->used; n++)
+    {
+        out.write(this->ring[i++]);
+        if (i == LH_CAPTURE_SIZE)
+        {
+            i = 0;
+        }
+    }
+    this->clear();
+}
+
+/**
+ * @brief add a record to the ring, dropping the oldest ones if needed
+ * 
+ * @param tx true for a packet sent
+ * @param packet bytes of the packet
+ * @param length number of bytes, truncated to fit the ring
+ * @param rssi RSSI in dBm, rx only
+ * @param snr SNR in 0.25 dB, rx only
+ */
+void LoRaHomeRadioRing::record(bool tx, const uint8_t *packet, uint8_t length, int rssi, int snr)
+{
+    if (length > LH_CAPTURE_SIZE - LH_CAPTURE_RECORD_HEADER_SIZE)
+    {
+        length = LH_CAPTURE_SIZE - LH_CAPTURE_RECORD_HEADER_SIZE;
+    }
+    uint16_t size = LH_CAPTURE_RECORD_HEADER_SIZE + length;
+    while (this->used + size > LH_CAPTURE_SIZE)
+    {
+        // the length is the last byte of the record header
+        uint16_t lengthIndex = this->head + LH_CAPTURE_RECORD_HEADER_SIZE - 1;
+        uint16_t oldest = LH_CAPTURE_RECORD_HEADER_SIZE + this->ring[lengthIndex % LH_CAPTURE_SIZE];
+        this->head = (this->head + oldest) % LH_CAPTURE_SIZE;
+        this->used -= oldest;
+        if (this->dropped < 0xFFFF)
+        {
+            this->dropped++;
+        }
+    }
+    unsigned long now = millis();
+    uint8_t header[LH_CAPTURE_RECORD_HEADER_SIZE];
+    header[0] = (tx ? LH_CAPTURE_FLAG_TX : 0) | (this->spreadingFactor & 0x0f);
+    header[1] = (uint8_t)(now & 0xff);
+    header[2] = (uint8_t)((now >> 8) & 0xff);
+    header[3] = (uint8_t)((now >> 16) & 0xff);
+    header[4] = (uint8_t)((now >> 24) & 0xff);
+    header[5] = (uint8_t)(this->frf & 0xff);
+    header[6] = (uint8_t)((this->frf >> 8) & 0xff);
+    header[7] = (uint8_t)((this->frf >> 16) & 0xff);
+    header[8] = (uint8_t)(int8_t)constrain(rssi, -128, 127);
+    header[9] = (uint8_t)(int8_t)constrain(snr, -128, 127);
+    header[10] = length;
+    this->push(header, LH_CAPTURE_RECORD_HEADER_SIZE);
+    this->push(packet, length);
+}
+
+/**
+ * @brief append bytes at the end of the ring, room shall have been made
+ * 
+ */
+void LoRaHomeRadioRing::push(const uint8_t *data, uint8_t length)
+{
+    uint16_t tail = this->head + this->used;
+    if (tail >= LH_CAPTURE_SIZE)
+    {
+        tail -= LH_CAPTURE_SIZE;
+    }
+    for (uint8_t i = 0; i < length; i++)
+    {
+        this->ring[tail++] = data[i];
+        if (tail == LH_CAPTURE_SIZE)
+        {
+            tail = 0;
+        }
+    }
+    this->used += length;
+}
+
+/**
+ * @brief Construct a new LoRaHomeRadioReplay object
+ * 
+ * @param capture the capture lines to replay
+ * @param sink where to print the packets sent, NULL to drop them
+ */
+LoRaHomeRadioReplay::LoRaHomeRadioReplay(Stream &capture, Print *sink) : capture(capture)
+{
+    this->sink = sink;
+    this->receiveCallback = NULL;
+    this->cadDoneCallback = NULL;
+    this->length = 0;
+    this->index = 0;
+    this->rssi = 0;
+    this->snr = 0;
+    this->seed = 1;
+}
+
+/**
+ * @brief deliver the next packet of the capture to the receive callback, as the DIO0 IRQ would
+ * 
+ * @return true if a packet has been delivered, false at the end of the capture or without callback
+ */
+bool LoRaHomeRadioReplay::dispatch()
+{
+    if (this->receiveCallback == NULL)
+    {
+        return false;
+    }
+    int size = this->parsePacket();
+    if (size == 0)
+    {
+        return false;
+    }
+    this->receiveCallback(size);
+    return true;
+}
+
+bool LoRaHomeRadioReplay::begin(long)
+{
+    return true;
+}
+
+void LoRaHomeRadioReplay::setSpreadingFactor(int)
+{
+}
+
+void LoRaHomeRadioReplay::setSignalBandwidth(long)
+{
+}
+
+void LoRaHomeRadioReplay::setCodingRate4(int)
+{
+}
+
+void LoRaHomeRadioReplay::setSyncWord(int)
+{
+}
+
+void LoRaHomeRadioReplay::setPreambleLength(long)
+{
+}
+
+void LoRaHomeRadioReplay::setTxPower(int)
+{
+}
+
+void LoRaHomeRadioReplay::setFrf(uint32_t)
+{
+}
+
+void LoRaHomeRadioReplay::enableCrc()
+{
+}
+
+void LoRaHomeRadioReplay::enableInvertIQ()
+{
+}
+
+void LoRaHomeRadioReplay::disableInvertIQ()
+{
+}
+
+void LoRaHomeRadioReplay::idle()
+{
+}
+
+void LoRaHomeRadioReplay::sleep()
+{
+}
+
+void LoRaHomeRadioReplay::receive()
+{
+}
+
+void LoRaHomeRadioReplay::beginPacket()
+{
+    this->length = 0;
+}
+
+size_t LoRaHomeRadioReplay::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; (i < size) && (this->length < LH_FRAME_MAX_SIZE); i++)
+    {
+        this->packet[this->length++] = buffer[i];
+    }
+    return size;
+}
+
+void LoRaHomeRadioReplay::endPacket()
+{
+    if (this->sink != NULL)
+    {
+        printCaptureLine(*this->sink, "tx", this->packet, this->length, 0, 0);
+    }
+    this->length = 0;
+}
+
+/**
+ * @brief the packet sent is not kept: each retry is written again, as printed on the sink
+ * 
+ * @return false, the packet shall be written again
+ */
+bool LoRaHomeRadioReplay::retransmit()
+{
+    return false;
+}
+
+/**
+ * @brief receive the next packet of the capture
+ * 
+ * @return int size of the packet, 0 at the end of the capture
+ */
+int LoRaHomeRadioReplay::parsePacket()
+{
+    this->index = 0;
+    if (!this->readRecord())
+    {
+        this->length = 0;
+    }
+    return this->length;
+}
+
+int LoRaHomeRadioReplay::read()
+{
+    if (this->index >= this->length)
+    {
+        return -1;
+    }
+    return this->packet[this->index++];
+}
+
+size_t LoRaHomeRadioReplay::read(uint8_t *buffer, size_t length)
+{
+    return readPacket(this->packet, this->length, this->index, buffer, length);
+}
+
+/**
+ * @brief register the receive callback, called by dispatch()
+ * 
+ * @param callback called with the size of the packet, NULL to unregister
+ */
+void LoRaHomeRadioReplay::onReceive(void (*callback)(int))
+{
+    this->receiveCallback = callback;
+}
+
+/**
+ * @brief the channel is always free: the CAD done callback is called at once
+ * 
+ */
+void LoRaHomeRadioReplay::channelActivityDetection()
+{
+    if (this->cadDoneCallback != NULL)
+    {
+        this->cadDoneCallback(false);
+    }
+}
+
+int LoRaHomeRadioReplay::channelActivityResult()
+{
+    return 0;
+}
+
+void LoRaHomeRadioReplay::onCadDone(void (*callback)(bool))
+{
+    this->cadDoneCallback = callback;
+}
+
+int LoRaHomeRadioReplay::packetRssi()
+{
+    return this->rssi;
+}
+
+float LoRaHomeRadioReplay::packetSnr()
+{
+    return this->snr / 4.0;
+}
+
+/**
+ * @brief deterministic pseudo random byte (8 bits xorshift), so that replays are reproducible
+ * 
+ */
+uint8_t LoRaHomeRadioReplay::random()
+{
+    this->seed ^= this->seed << 3;
+    this->seed ^= this->seed >> 5;
+    this->seed ^= this->seed << 4;
+    return this->seed;
+}
+
+/**
+ * @brief read the next "rx" line of the capture into the packet buffer
+ * 
+ * @return true if a packet has been read, false at the end of the capture
+ */
+bool LoRaHomeRadioReplay::readRecord()
+{
+    while (true)
+    {
+        int tag = this->capture.read();
+        if (tag < 0)
+        {
+            return false;
+        }
+        if ((tag != 'r') || (this->capture.read() != 'x') || (this->capture.read() != ','))
+        {
+            if (tag != '\n')
+            {
+                this->skipLine();
+            }
+            continue;
+        }
+        this->readNumber(); // millis
+        this->rssi = this->readNumber();
+        this->snr = this->readNumber();
+        this->length = 0;
+        int high;
+        while (((high = this->capture.read()) >= 0) && (high != '\n') && (high != '\r'))
+        {
+            int low = this->capture.read();
+            uint8_t value = 0;
+            for (uint8_t i = 0; i < 2; i++)
+            {
+                int c = (i == 0) ? high : low;
+                value <<= 4;
+                value |= (c <= '9') ? (c - '0') : ((c | 0x20) - 'a' + 10);
+            }
+            if (this->length < LH_FRAME_MAX_SIZE)
+            {
+                this->packet[this->length++] = value;
+            }
+        }
+        if (high == '\r')
+        {
+            this->skipLine();
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief read a decimal field, up to the next ','
+ * 
+ * @return long the value
+ */
+long LoRaHomeRadioReplay::readNumber()
+{
+    long value = 0;
+    bool negative = false;
+    int c;
+    while (((c = this->capture.read()) >= 0) && (c != ',') && (c != '\n'))
+    {
+        if (c == '-')
+        {
+            negative = true;
+        }
+        else
+        {
+            value = value * 10 + (c - '0');
+        }
+    }
+    return negative ? -value : value;
+}
+
+/**
+ * @brief skip the capture up to the end of the line
+ * 
+ */
+void LoRaHomeRadioReplay::skipLine()
+{
+    int c;
+    while (((c = this->capture.read()) >= 0) && (c != '\n'))
+    {
+    }
+}
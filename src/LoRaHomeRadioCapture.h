@@ -0,0 +1,176 @@
+#ifndef LORAHOMERADIOCAPTURE_H
+#define LORAHOMERADIOCAPTURE_H
+
+#include <LoRaHomeRadio.h>
+#include <LoRaHomeFrame.h>
+
+// Capture format, one packet per line:
+//   rx,<millis>,<RSSI dBm>,<SNR in 0.25 dB>,<packet bytes in hex>
+//   tx,<millis>,<packet bytes in hex>
+
+// Binary capture format of LoRaHomeRadioRing::dump(), multi-byte fields LSB first:
+//   "LHC", LH_CAPTURE_VERSION, records dropped (2 bytes), size of the records (2 bytes), records, oldest first
+// record:
+//   flags: bit 7 set for tx, bits 3..0 spreading factor
+//   millis (4 bytes), FRF register of the channel (3 bytes), RSSI in dBm, SNR in 0.25 dB (0 for tx)
+//   length, packet bytes
+// tools/lh_pcap.py converts captures to pcap
+const uint8_t LH_CAPTURE_VERSION = 1;
+const uint8_t LH_CAPTURE_HEADER_SIZE = 8;
+const uint8_t LH_CAPTURE_RECORD_HEADER_SIZE = 11;
+const uint8_t LH_CAPTURE_FLAG_TX = 0x80;
+
+// RAM ring size in bytes, e.g. ~6 uplinks of 30 bytes with their ACK (-D LH_CAPTURE_SIZE=n to change)
+#ifndef LH_CAPTURE_SIZE
+#define LH_CAPTURE_SIZE 256
+#endif
+
+/**
+ * @brief LoRaHomeRadio recording the packets sent and received by another radio
+ * Each packet is printed as a capture line, e.g. on Serial or a file on a host.
+ * Received packets are read at once from the radio, then served from RAM.
+ * With onReceive(), the packet is read and recorded in the IRQ before the callback: record() shall then be
+ * short, e.g. the RAM ring of LoRaHomeRadioRing rather than capture lines on Serial. One recorder at a time.
+ */
+class LoRaHomeRadioRecorder : public LoRaHomeRadio
+{
+public:
+    LoRaHomeRadioRecorder(LoRaHomeRadio &radio, Print &capture);
+    explicit LoRaHomeRadioRecorder(LoRaHomeRadio &radio);
+    bool begin(long frequency);
+    void setSpreadingFactor(int sf);
+    void setSignalBandwidth(long sbw);
+    void setCodingRate4(int denominator);
+    void setSyncWord(int sw);
+    void setPreambleLength(long length);
+    void setTxPower(int level);
+    void setFrf(uint32_t frf);
+    void enableCrc();
+    void enableInvertIQ();
+    void disableInvertIQ();
+    void idle();
+    void sleep();
+    void receive();
+    void beginPacket();
+    size_t write(const uint8_t *buffer, size_t size);
+    void endPacket();
+    bool retransmit();
+    int parsePacket();
+    int read();
+    size_t read(uint8_t *buffer, size_t length);
+    void onReceive(void (*callback)(int));
+    void channelActivityDetection();
+    int channelActivityResult();
+    void onCadDone(void (*callback)(bool));
+    int packetRssi();
+    float packetSnr();
+    uint8_t random();
+
+protected:
+    virtual void record(bool tx, const uint8_t *packet, uint8_t length, int rssi, int snr);
+
+    uint8_t spreadingFactor;
+    uint32_t frf;
+
+private:
+    void capturePacket(int size);
+    static void receiveTrampoline(int size);
+
+    // recorder of the receive IRQ, the radio callback has no context
+    static LoRaHomeRadioRecorder *receiving;
+    LoRaHomeRadio &radio;
+    Print *capture;
+    void (*receiveCallback)(int);
+    uint8_t packet[LH_FRAME_MAX_SIZE];
+    uint8_t length;
+    uint8_t index;
+};
+
+/**
+ * @brief LoRaHomeRadioRecorder keeping the last packets in a RAM ring, dumped on request in the binary capture format
+ * Unlike capture lines, recording costs no serial time: the protocol timing is not altered.
+ * When the ring is full, the oldest records are dropped.
+ */
+class LoRaHomeRadioRing : public LoRaHomeRadioRecorder
+{
+public:
+    explicit LoRaHomeRadioRing(LoRaHomeRadio &radio);
+    void dump(Print &out);
+    void clear();
+
+protected:
+    void record(bool tx, const uint8_t *packet, uint8_t length, int rssi, int snr);
+
+private:
+    void push(const uint8_t *data, uint8_t length);
+
+    uint8_t ring[LH_CAPTURE_SIZE];
+    uint16_t head;
+    uint16_t used;
+    uint16_t dropped;
+};
+
+#ifdef LH_CAPTURE
+extern LoRaHomeRadioRing loraHomeCapture;
+#endif
+
+/**
+ * @brief LoRaHomeRadio replaying captured traffic, to run the node deterministically on recorded field traffic
+ * Each parsePacket() returns the next "rx" line of the capture, "tx" lines are skipped.
+ * The packets sent are printed as "tx" lines on an optional sink, to be compared with the capture.
+ * The channel is always free and the radio settings are ignored.
+ * The capture stream shall deliver whole lines, e.g. a file on a host.
+ * With onReceive(), the packets are delivered by dispatch(), which stands for the DIO0 IRQ.
+ */
+class LoRaHomeRadioReplay : public LoRaHomeRadio
+{
+public:
+    LoRaHomeRadioReplay(Stream &capture, Print *sink = NULL);
+    bool dispatch();
+    bool begin(long frequency);
+    void setSpreadingFactor(int sf);
+    void setSignalBandwidth(long sbw);
+    void setCodingRate4(int denominator);
+    void setSyncWord(int sw);
+    void setPreambleLength(long length);
+    void setTxPower(int level);
+    void setFrf(uint32_t frf);
+    void enableCrc();
+    void enableInvertIQ();
+    void disableInvertIQ();
+    void idle();
+    void sleep();
+    void receive();
+    void beginPacket();
+    size_t write(const uint8_t *buffer, size_t size);
+    void endPacket();
+    bool retransmit();
+    int parsePacket();
+    int read();
+    size_t read(uint8_t *buffer, size_t length);
+    void onReceive(void (*callback)(int));
+    void channelActivityDetection();
+    int channelActivityResult();
+    void onCadDone(void (*callback)(bool));
+    int packetRssi();
+    float packetSnr();
+    uint8_t random();
+
+private:
+    bool readRecord();
+    long readNumber();
+    void skipLine();
+
+    Stream &capture;
+    Print *sink;
+    void (*receiveCallback)(int);
+    void (*cadDoneCallback)(bool);
+    uint8_t packet[LH_FRAME_MAX_SIZE];
+    uint8_t length;
+    uint8_t index;
+    int rssi;
+    int snr;
+    uint8_t seed;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include <LoRaHomeRadioSX127x.h>
+
+/**
+ * @brief Construct a new LoRaHomeRadioSX127x object
+ * 
+ * @param lora the LoRa library instance, usually LoRa
+ * @param ss SPI slave select pin
+ * @param reset reset pin
+ * @param dio0 DIO0 pin
+ */
+LoRaHomeRadioSX127x::LoRaHomeRadioSX127x(LoRaClass &lora, int ss, int reset, int dio0) : lora(lora)
+{
+    this->ss = ss;
+    this->reset = reset;
+    this->dio0 = dio0;
+}
+
+/**
+ * @brief set the pins and start the radio
+ * 
+ * @param frequency in Hz
+ * @return true if the radio answered
+ */
+bool LoRaHomeRadioSX127x::begin(long frequency)
+{
+    this->lora.setPins(this->ss, this->reset, this->dio0);
+    return this->lora.begin(frequency) == 1;
+}
+
+void LoRaHomeRadioSX127x::setSpreadingFactor(int sf)
+{
+    this->lora.setSpreadingFactor(sf);
+}
+
+void LoRaHomeRadioSX127x::setSignalBandwidth(long sbw)
+{
+    this->lora.setSignalBandwidth(sbw);
+}
+
+void LoRaHomeRadioSX127x::setCodingRate4(int denominator)
+{
+    this->lora.setCodingRate4(denominator);
+}
+
+void LoRaHomeRadioSX127x::setSyncWord(int sw)
+{
+    this->lora.setSyncWord(sw);
+}
+
+void LoRaHomeRadioSX127x::setPreambleLength(long length)
+{
+    this->lora.setPreambleLength(length);
+}
+
+void LoRaHomeRadioSX127x::setTxPower(int level)
+{
+    this->lora.setTxPower(level);
+}
+
+void LoRaHomeRadioSX127x::setFrf(uint32_t frf)
+{
+    this->lora.setFrf(frf);
+}
+
+void LoRaHomeRadioSX127x::enableCrc()
+{
+    this->lora.enableCrc();
+}
+
+void LoRaHomeRadioSX127x::enableInvertIQ()
+{
+    this->lora.enableInvertIQ();
+}
+
+void LoRaHomeRadioSX127x::disableInvertIQ()
+{
+    this->lora.disableInvertIQ();
+}
+
+void LoRaHomeRadioSX127x::idle()
+{
+    this->lora.idle();
+}
+
+void LoRaHomeRadioSX127x::sleep()
+{
+    this->lora.sleep();
+}
+
+void LoRaHomeRadioSX127x::receive()
+{
+    this->lora.receive();
+}
+
+void LoRaHomeRadioSX127x::beginPacket()
+{
+    this->lora.beginPacket();
+}
+
+size_t LoRaHomeRadioSX127x::write(const uint8_t *buffer, size_t size)
+{
+    return this->lora.write(buffer, size);
+}
+
+void LoRaHomeRadioSX127x::endPacket()
+{
+    this->lora.endPacket();
+}
+
+/**
+ * @brief send the last packet again from the radio FIFO, without writing it over SPI
+ * 
+ * @return true if sent, false if the packet has been overwritten by received packets
+ */
+bool LoRaHomeRadioSX127x::retransmit()
+{
+    return this->lora.retransmit() == 1;
+}
+
+int LoRaHomeRadioSX127x::parsePacket()
+{
+    return this->lora.parsePacket();
+}
+
+int LoRaHomeRadioSX127x::read()
+{
+    return this->lora.read();
+}
+
+size_t LoRaHomeRadioSX127x::read(uint8_t *buffer, size_t length)
+{
+    return this->lora.read(buffer, length);
+}
+
+/**
+ * @brief register the receive callback, called from the DIO0 IRQ
+ * Not available on the MKR WAN 1300, where the LoRa library has no IRQ support: the radio is polled.
+ * 
+ * @param callback called with the size of the packet received, NULL to unregister
+ */
+void LoRaHomeRadioSX127x::onReceive(void (*callback)(int))
+{
+#ifndef ARDUINO_SAMD_MKRWAN1300
+    this->lora.onReceive(callback);
+#endif
+}
+
+void LoRaHomeRadioSX127x::channelActivityDetection()
+{
+    this->lora.channelActivityDetection();
+}
+
+int LoRaHomeRadioSX127x::channelActivityResult()
+{
+    return this->lora.channelActivityResult();
+}
+
+/**
+ * @brief register the CAD done callback, called from the DIO0 IRQ
+ * Not available on the MKR WAN 1300, as onReceive()
+ * 
+ * @param callback called with true if a preamble was detected, NULL to unregister
+ */
+void LoRaHomeRadioSX127x::onCadDone(void (*callback)(bool))
+{
+#ifndef ARDUINO_SAMD_MKRWAN1300
+    this->lora.onCadDone(callback);
+#endif
+}
+
+int LoRaHomeRadioSX127x::packetRssi()
+{
+    return this->lora.packetRssi();
+}
+
+float LoRaHomeRadioSX127x::packetSnr()
+{
+    return this->lora.packetSnr();
+}
+
+uint8_t LoRaHomeRadioSX127x::random()
+{
+    return this->lora.random();
+}
@@ -0,0 +1,50 @@
+#ifndef LORAHOMERADIOSX127X_H
+#define LORAHOMERADIOSX127X_H
+
+#include <LoRaHomeRadio.h>
+#include <LoRa.h>
+
+/**
+ * @brief LoRaHomeRadio on a SX127x driven by the LoRa library
+ */
+class LoRaHomeRadioSX127x : public LoRaHomeRadio
+{
+public:
+    LoRaHomeRadioSX127x(LoRaClass &lora, int ss, int reset, int dio0);
+    bool begin(long frequency);
+    void setSpreadingFactor(int sf);
+    void setSignalBandwidth(long sbw);
+    void setCodingRate4(int denominator);
+    void setSyncWord(int sw);
+    void setPreambleLength(long length);
+    void setTxPower(int level);
+    void setFrf(uint32_t frf);
+    void enableCrc();
+    void enableInvertIQ();
+    void disableInvertIQ();
+    void idle();
+    void sleep();
+    void receive();
+    void beginPacket();
+    size_t write(const uint8_t *buffer, size_t size);
+    void endPacket();
+    bool retransmit();
+    int parsePacket();
+    int read();
+    size_t read(uint8_t *buffer, size_t length);
+    void onReceive(void (*callback)(int));
+    void channelActivityDetection();
+    int channelActivityResult();
+    void onCadDone(void (*callback)(bool));
+    int packetRssi();
+    float packetSnr();
+    uint8_t random();
+
+private:
+    LoRaClass &lora;
+    int ss;
+    int reset;
+    int dio0;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <LoRaHomeReassembly.h>
+#include <LoRaHomeLog.h>
+
+// log events of this file
+#define LH_LOG_MODULE LH_LOG_MODULE_REASSEMBLY
+
+/**
+ * @brief Construct a new LoRaHomeReassembly object, empty
+ * 
+ */
+LoRaHomeReassembly::LoRaHomeReassembly()
+{
+    this->reset();
+}
+
+/**
+ * @brief drop the message being reassembled
+ * 
+ */
+void LoRaHomeReassembly::reset()
+{
+    this->nodeIdEmitter = LH_NODE_ID_BROADCAST;
+    this->firstCounter = 0;
+    this->fragmentCount = 0;
+    this->bitmap = 0;
+    this->length = 0;
+    this->message[0] = '\0';
+}
+
+/**
+ * @brief add a received fragment to the message
+ * 
+ * @param lhf fragment frame, CRC (and MIC) already checked
+ * @return true when all fragments of the message have been received
+ */
+bool LoRaHomeReassembly::addFragment(LoRaHomeFrame &lhf)
+{
+    LH_LOG(LH_LOG_DEBUG, "LoRaHomeReassembly::addFragment");
+    uint8_t index = lhf.getFragmentIndex();
+    uint8_t count = lhf.getFragmentCount();
+    if ((!lhf.isFragment()) || (index >= count) || (count > LH_MAX_FRAGMENTS))
+    {
+        LH_LOG(LH_LOG_WARN, "--- invalid fragment");
+        return false;
+    }
+    // every fragment but the last one is full
+    if (((index < count - 1) && (lhf.payloadSize != LH_FRAGMENT_PAYLOAD_SIZE)) || (lhf.payloadSize > LH_FRAGMENT_PAYLOAD_SIZE))
+    {
+        LH_LOG(LH_LOG_WARN, "--- invalid fragment size");
+        return false;
+    }
+    uint16_t first = lhf.counter - index;
+    if ((lhf.nodeIdEmitter != this->nodeIdEmitter) || (first != this->firstCounter) || (count != this->fragmentCount))
+    {
+        LH_LOG(LH_LOG_INFO, "--- new message");
+        this->reset();
+        this->nodeIdEmitter = lhf.nodeIdEmitter;
+        this->firstCounter = first;
+        this->fragmentCount = count;
+    }
+    memcpy(&this->message[index * LH_FRAGMENT_PAYLOAD_SIZE], lhf.jsonPayload, lhf.payloadSize);
+    this->bitmap |= (1 << index);
+    if (index == count - 1)
+    {
+        this->length = index * LH_FRAGMENT_PAYLOAD_SIZE + lhf.payloadSize;
+    }
+    if (this->isComplete())
+    {
+        this->message[this->length] = '\0';
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief indicate whether all fragments have been received
+ * 
+ * @return true if the message is complete
+ */
+bool LoRaHomeReassembly::isComplete()
+{
+    return (this->fragmentCount != 0) && (this->bitmap == (uint16_t)((1UL << this->fragmentCount) - 1));
+}
+
+/**
+ * @brief Get the bitmap of the received fragments, to be sent back in the fragment ACK
+ * 
+ * @return uint16_t fragment i received if bit i is set
+ */
+uint16_t LoRaHomeReassembly::getBitmap()
+{
+    return this->bitmap;
+}
+
+/**
+ * @brief Get the counter of the first fragment, used as counter of the fragment ACK
+ * 
+ * @return uint16_t 
+ */
+uint16_t LoRaHomeReassembly::getFirstCounter()
+{
+    return this->firstCounter;
+}
+
+/**
+ * @brief Get the node ID of the emitter of the message
+ * 
+ * @return uint8_t 
+ */
+uint8_t LoRaHomeReassembly::getNodeIdEmitter()
+{
+    return this->nodeIdEmitter;
+}
+
+/**
+ * @brief Get the reassembled message, null terminated once complete
+ * 
+ * @return const char* 
+ */
+const char *LoRaHomeReassembly::getMessage()
+{
+    return this->message;
+}
+
+/**
+ * @brief Get the length of the reassembled message
+ * 
+ * @return uint16_t number of bytes, 0 until the last fragment is received
+ */
+uint16_t LoRaHomeReassembly::getLength()
+{
+    return this->length;
+}
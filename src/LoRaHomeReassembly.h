@@ -0,0 +1,38 @@
+#ifndef LORAHOMEREASSEMBLY_H
+#define LORAHOMEREASSEMBLY_H
+
+#include <Arduino.h>
+#include <LoRaHomeFrame.h>
+
+const uint16_t LH_REASSEMBLY_MAX_SIZE = LH_MAX_FRAGMENTS * LH_FRAGMENT_PAYLOAD_SIZE;
+
+/**
+ * @brief Reassembly of a fragmented message, in a buffer bounded by LH_MAX_FRAGMENTS
+ * One message is reassembled at a time: a fragment of another message restarts the reassembly.
+ * Fragment i of a message is sent with counter firstCounter + i, so that each frame keeps a unique counter.
+ * The receiver acknowledges with a LH_MSG_TYPE_GW_FRAGMENT_ACK frame carrying getBitmap(),
+ * the emitter then only resends the missing fragments.
+ */
+class LoRaHomeReassembly
+{
+public:
+    LoRaHomeReassembly();
+    void reset();
+    bool addFragment(LoRaHomeFrame &lhf);
+    bool isComplete();
+    uint16_t getBitmap();
+    uint16_t getFirstCounter();
+    uint8_t getNodeIdEmitter();
+    const char *getMessage();
+    uint16_t getLength();
+
+private:
+    uint8_t nodeIdEmitter;
+    uint16_t firstCounter;
+    uint8_t fragmentCount;
+    uint16_t bitmap;
+    uint16_t length;
+    char message[LH_REASSEMBLY_MAX_SIZE + 1];
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include <LoRaHomeSecurity.h>
+
+// the whole module is compiled out unless frame security is enabled (-D LH_SECURITY)
+#ifdef LH_SECURITY
+
+// AES S-box, kept in flash to save 256 bytes of RAM
+static const uint8_t sbox[256] PROGMEM = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+
+#define SBOX(x) pgm_read_byte(&sbox[(x)])
+
+// multiply by x in GF(2^8)
+static inline uint8_t xtime(uint8_t x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1b : 0x00);
+}
+
+// CTR counter blocks start with this tag so that they never equal a CMAC chaining input built from a header
+const uint8_t LH_CTR_BLOCK_TAG = 0x01;
+// number of header bytes mixed into the nonce: emitter, recipient, type, network ID and counter
+const uint8_t LH_NONCE_HEADER_SIZE = 7;
+
+/**
+ * @brief Construct a new LoRaHomeSecurity object. begin() shall be called before any frame is protected
+ *
+ */
+LoRaHomeSecurity::LoRaHomeSecurity()
+{
+}
+
+/**
+ * @brief Expand the AES-128 key and derive the CMAC subkeys
+ * Done once at setup so that the per frame cost is limited to block encryptions
+ *
+ * @param key_P 16 bytes key stored in PROGMEM
+ */
+void LoRaHomeSecurity::begin(const uint8_t *key_P)
+{
+    memcpy_P(this->roundKeys, key_P, LH_AES_BLOCK_SIZE);
+    uint8_t rcon = 0x01;
+    for (uint8_t i = LH_AES_BLOCK_SIZE; i < LH_AES_KEY_SCHEDULE_SIZE; i += 4)
+    {
+        uint8_t t0 = this->roundKeys[i - 4];
+        uint8_t t1 = this->roundKeys[i - 3];
+        uint8_t t2 = this->roundKeys[i - 2];
+        uint8_t t3 = this->roundKeys[i - 1];
+        if ((i % LH_AES_BLOCK_SIZE) == 0)
+        {
+            // RotWord + SubWord + Rcon
+            uint8_t tmp = t0;
+            t0 = SBOX(t1) ^ rcon;
+            t1 = SBOX(t2);
+            t2 = SBOX(t3);
+            t3 = SBOX(tmp);
+            rcon = xtime(rcon);
+        }
+        this->roundKeys[i] = this->roundKeys[i - LH_AES_BLOCK_SIZE] ^ t0;
+        this->roundKeys[i + 1] = this->roundKeys[i - LH_AES_BLOCK_SIZE + 1] ^ t1;
+        this->roundKeys[i + 2] = this->roundKeys[i - LH_AES_BLOCK_SIZE + 2] ^ t2;
+        this->roundKeys[i + 3] = this->roundKeys[i - LH_AES_BLOCK_SIZE + 3] ^ t3;
+    }
+    // CMAC subkeys (RFC 4493): L = AES(K, 0), K1 = L << 1, K2 = K1 << 1
+    uint8_t l[LH_AES_BLOCK_SIZE];
+    memset(l, 0, LH_AES_BLOCK_SIZE);
+    this->encryptBlock(l);
+    leftShiftSubkey(this->cmacK1, l);
+    leftShiftSubkey(this->cmacK2, this->cmacK1);
+}
+
+/**
+ * @brief Encrypt or decrypt in place with AES-128-CTR
+ * The counter block is built from the frame header, the frame counter being the nonce
+ *
+ * @param header serialized frame header
+ * @param data buffer to be encrypted / decrypted in place
+ * @param length number of bytes
+ */
+void LoRaHomeSecurity::crypt(const uint8_t *header, uint8_t *data, uint8_t length)
+{
+    uint8_t keyStream[LH_AES_BLOCK_SIZE];
+    uint8_t blockIndex = 0;
+    while (length > 0)
+    {
+        memset(keyStream, 0, LH_AES_BLOCK_SIZE);
+        keyStream[0] = LH_CTR_BLOCK_TAG;
+        memcpy(&keyStream[1], header, LH_NONCE_HEADER_SIZE);
+        keyStream[LH_AES_BLOCK_SIZE - 1] = blockIndex++;
+        this->encryptBlock(keyStream);
+        uint8_t n = (length < LH_AES_BLOCK_SIZE) ? length : LH_AES_BLOCK_SIZE;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            data[i] ^= keyStream[i];
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+/**
+ * @brief Compute the AES-CMAC of a buffer, truncated to LH_MIC_SIZE bytes
+ *
+ * @param data bytes to authenticate (header + encrypted payload)
+ * @param length number of bytes
+ * @param mic output, LH_MIC_SIZE bytes
+ */
+void LoRaHomeSecurity::computeMIC(const uint8_t *data, uint8_t length, uint8_t *mic)
+{
+    LoRaHomeMICState state;
+    this->beginMIC(state);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        this->updateMIC(state, data[i]);
+    }
+    this->finishMIC(state, mic);
+}
+
+/**
+ * @brief Check the truncated AES-CMAC of a received buffer
+ *
+ * @param data bytes authenticated by the emitter
+ * @param length number of bytes
+ * @param mic received MIC, LH_MIC_SIZE bytes
+ * @return true if the MIC matches
+ */
+bool LoRaHomeSecurity::checkMIC(const uint8_t *data, uint8_t length, const uint8_t *mic)
+{
+    LoRaHomeMICState state;
+    this->beginMIC(state);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        this->updateMIC(state, data[i]);
+    }
+    return this->checkMIC(state, mic);
+}
+
+/**
+ * @brief Start an AES-CMAC computed incrementally, e.g. while a frame is read from the radio
+ *
+ * @param state CMAC state
+ */
+void LoRaHomeSecurity::beginMIC(LoRaHomeMICState &state)
+{
+    memset(state.x, 0, LH_AES_BLOCK_SIZE);
+    state.fill = 0;
+}
+
+/**
+ * @brief Add a byte to an AES-CMAC
+ * A full block is only encrypted when the next byte comes: the last block is finished with a subkey.
+ *
+ * @param state CMAC state
+ * @param data next byte to authenticate
+ */
+void LoRaHomeSecurity::updateMIC(LoRaHomeMICState &state, uint8_t data)
+{
+    if (state.fill == LH_AES_BLOCK_SIZE)
+    {
+        this->encryptBlock(state.x);
+        state.fill = 0;
+    }
+    state.x[state.fill++] ^= data;
+}
+
+/**
+ * @brief End an AES-CMAC, truncated to LH_MIC_SIZE bytes
+ *
+ * @param state CMAC state
+ * @param mic output, LH_MIC_SIZE bytes
+ */
+void LoRaHomeSecurity::finishMIC(LoRaHomeMICState &state, uint8_t *mic)
+{
+    // last block: complete blocks use K1, padded ones use K2
+    const uint8_t *subkey = (state.fill == LH_AES_BLOCK_SIZE) ? this->cmacK1 : this->cmacK2;
+    if (state.fill < LH_AES_BLOCK_SIZE)
+    {
+        state.x[state.fill] ^= 0x80;
+    }
+    for (uint8_t i = 0; i < LH_AES_BLOCK_SIZE; i++)
+    {
+        state.x[i] ^= subkey[i];
+    }
+    this->encryptBlock(state.x);
+    memcpy(mic, state.x, LH_MIC_SIZE);
+}
+
+/**
+ * @brief End an AES-CMAC and compare it with a received MIC
+ *
+ * @param state CMAC state
+ * @param mic received MIC, LH_MIC_SIZE bytes
+ * @return true if the MIC matches
+ */
+bool LoRaHomeSecurity::checkMIC(LoRaHomeMICState &state, const uint8_t *mic)
+{
+    uint8_t expected[LH_MIC_SIZE];
+    this->finishMIC(state, expected);
+    // constant time comparison
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < LH_MIC_SIZE; i++)
+    {
+        diff |= expected[i] ^ mic[i];
+    }
+    return diff == 0;
+}
+
+/**
+ * @brief AES-128 encryption of one block, in place
+ * SubBytes and ShiftRows are merged in a single pass over the state
+ *
+ * @param state 16 bytes block
+ */
+void LoRaHomeSecurity::encryptBlock(uint8_t *state)
+{
+    const uint8_t *rk = this->roundKeys;
+    uint8_t i;
+    for (i = 0; i < LH_AES_BLOCK_SIZE; i++)
+    {
+        state[i] ^= rk[i];
+    }
+    for (uint8_t round = 1; round <= LH_AES_ROUNDS; round++)
+    {
+        uint8_t t;
+        // SubBytes + ShiftRows
+        state[0] = SBOX(state[0]);
+        state[4] = SBOX(state[4]);
+        state[8] = SBOX(state[8]);
+        state[12] = SBOX(state[12]);
+        t = state[1];
+        state[1] = SBOX(state[5]);
+        state[5] = SBOX(state[9]);
+        state[9] = SBOX(state[13]);
+        state[13] = SBOX(t);
+        t = state[2];
+        state[2] = SBOX(state[10]);
+        state[10] = SBOX(t);
+        t = state[6];
+        state[6] = SBOX(state[14]);
+        state[14] = SBOX(t);
+        t = state[15];
+        state[15] = SBOX(state[11]);
+        state[11] = SBOX(state[7]);
+        state[7] = SBOX(state[3]);
+        state[3] = SBOX(t);
+        // MixColumns, skipped on the last round
+        if (round != LH_AES_ROUNDS)
+        {
+            for (i = 0; i < LH_AES_BLOCK_SIZE; i += 4)
+            {
+                uint8_t a0 = state[i];
+                uint8_t a1 = state[i + 1];
+                uint8_t a2 = state[i + 2];
+                uint8_t a3 = state[i + 3];
+                t = a0 ^ a1 ^ a2 ^ a3;
+                state[i] = a0 ^ t ^ xtime(a0 ^ a1);
+                state[i + 1] = a1 ^ t ^ xtime(a1 ^ a2);
+                state[i + 2] = a2 ^ t ^ xtime(a2 ^ a3);
+                state[i + 3] = a3 ^ t ^ xtime(a3 ^ a0);
+            }
+        }
+        // AddRoundKey
+        rk += LH_AES_BLOCK_SIZE;
+        for (i = 0; i < LH_AES_BLOCK_SIZE; i++)
+        {
+            state[i] ^= rk[i];
+        }
+    }
+}
+
+/**
+ * @brief CMAC subkey generation step: shift left by one bit, conditional XOR with Rb
+ *
+ * @param dst shifted subkey
+ * @param src subkey to be shifted
+ */
+void LoRaHomeSecurity::leftShiftSubkey(uint8_t *dst, const uint8_t *src)
+{
+    uint8_t msb = src[0] & 0x80;
+    for (uint8_t i = 0; i < LH_AES_BLOCK_SIZE - 1; i++)
+    {
+        dst[i] = (src[i] << 1) | (src[i + 1] >> 7);
+    }
+    dst[LH_AES_BLOCK_SIZE - 1] = src[LH_AES_BLOCK_SIZE - 1] << 1;
+    if (msb)
+    {
+        dst[LH_AES_BLOCK_SIZE - 1] ^= 0x87;
+    }
+}
+
+LoRaHomeSecurity loraHomeSecurity;
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef LORAHOMESECURITY_H
+#define LORAHOMESECURITY_H
+
+#include <Arduino.h>
+
+// the counter is the nonce: it shall never be sent twice with the same key, even after a reset
+#if defined(LH_SECURITY) && !defined(LH_STORAGE)
+#error "LH_SECURITY requires LH_STORAGE, so that the TX counter is not reused after a reset"
+#endif
+
+const uint8_t LH_AES_BLOCK_SIZE = 16;
+const uint8_t LH_AES_ROUNDS = 10;
+const uint8_t LH_AES_KEY_SCHEDULE_SIZE = LH_AES_BLOCK_SIZE * (LH_AES_ROUNDS + 1);
+const uint8_t LH_MIC_SIZE = 4; // truncated AES-CMAC
+// last TX counter value usable with a key: the 16 bit counter never wraps, a new key is required beyond
+const uint16_t LH_SECURITY_COUNTER_MAX = 0xFFFF;
+
+/**
+ * @brief AES-CMAC being computed over bytes given one at a time
+ */
+struct LoRaHomeMICState
+{
+    uint8_t x[LH_AES_BLOCK_SIZE]; // chaining value, XORed with the bytes of the current block
+    uint8_t fill;                 // bytes in the current block
+};
+
+/**
+ * @brief AES-128 frame protection: CTR mode encryption and truncated CMAC
+ * Only the AES forward cipher is needed (CTR and CMAC never decrypt a block).
+ * The key schedule and CMAC subkeys are computed once in begin().
+ * The nonce is built from the frame header (network ID, emitter, recipient, type, counter),
+ * so the counter must never repeat for a given key.
+ */
+class LoRaHomeSecurity
+{
+public:
+    LoRaHomeSecurity();
+    void begin(const uint8_t *key_P);
+    void crypt(const uint8_t *header, uint8_t *data, uint8_t length);
+    void computeMIC(const uint8_t *data, uint8_t length, uint8_t *mic);
+    bool checkMIC(const uint8_t *data, uint8_t length, const uint8_t *mic);
+    void beginMIC(LoRaHomeMICState &state);
+    void updateMIC(LoRaHomeMICState &state, uint8_t data);
+    void finishMIC(LoRaHomeMICState &state, uint8_t *mic);
+    bool checkMIC(LoRaHomeMICState &state, const uint8_t *mic);
+
+private:
+    void encryptBlock(uint8_t *state);
+    static void leftShiftSubkey(uint8_t *dst, const uint8_t *src);
+
+    uint8_t roundKeys[LH_AES_KEY_SCHEDULE_SIZE];
+    uint8_t cmacK1[LH_AES_BLOCK_SIZE];
+    uint8_t cmacK2[LH_AES_BLOCK_SIZE];
+};
+
+extern LoRaHomeSecurity loraHomeSecurity;
+
+#endif
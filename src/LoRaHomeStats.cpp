@@ -0,0 +1,76 @@
+#include <LoRaHomeStats.h>
+
+/**
+ * @brief Construct a new LoRaHomeStats object, with all counters cleared
+ * 
+ */
+LoRaHomeStats::LoRaHomeStats()
+{
+    this->reset();
+}
+
+/**
+ * @brief increment a counter, saturating at 0xFFFF
+ * 
+ * @param counter LH_STAT_xxx counter
+ */
+void LoRaHomeStats::increment(uint8_t counter)
+{
+    if ((counter < LH_STAT_COUNTERS) && (this->counters[counter] != 0xFFFF))
+    {
+        this->counters[counter]++;
+    }
+}
+
+/**
+ * @brief keep the signal quality of the last ACK received
+ * 
+ * @param rssi packet RSSI in dBm
+ * @param snr packet SNR in dB
+ */
+void LoRaHomeStats::setLastAckSignal(int rssi, float snr)
+{
+    this->lastAckRssi = (uint8_t)constrain(-rssi, 0, 255);
+    this->lastAckSnr = (int8_t)constrain((int)(snr * 4), -128, 127);
+}
+
+/**
+ * @brief Get the value of a counter
+ * 
+ * @param counter LH_STAT_xxx counter
+ * @return uint16_t value, 0xFFFF once saturated
+ */
+uint16_t LoRaHomeStats::getCounter(uint8_t counter)
+{
+    return this->counters[counter];
+}
+
+/**
+ * @brief write the stats block into the given buffer
+ * 
+ * @param buffer at least LH_STATS_SIZE bytes
+ * @return uint8_t number of bytes written, LH_STATS_SIZE
+ */
+uint8_t LoRaHomeStats::serialize(uint8_t *buffer)
+{
+    uint8_t i = 0;
+    for (uint8_t counter = 0; counter < LH_STAT_COUNTERS; counter++)
+    {
+        buffer[i++] = this->counters[counter] & 0xff;
+        buffer[i++] = (this->counters[counter] >> 8) & 0xff;
+    }
+    buffer[i++] = this->lastAckRssi;
+    buffer[i++] = (uint8_t)this->lastAckSnr;
+    return i;
+}
+
+/**
+ * @brief clear all the counters and the last ACK signal quality
+ * 
+ */
+void LoRaHomeStats::reset()
+{
+    memset(this->counters, 0, sizeof(this->counters));
+    this->lastAckRssi = 0;
+    this->lastAckSnr = 0;
+}
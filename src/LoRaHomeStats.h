@@ -0,0 +1,44 @@
+#ifndef LORAHOMESTATS_H
+#define LORAHOMESTATS_H
+
+#include <Arduino.h>
+
+// Tx counters
+const uint8_t LH_STAT_TX_FRAMES = 0;    // frames transmitted, retransmissions and ACKs included
+const uint8_t LH_STAT_TX_RETRIES = 1;   // retransmission bursts after a missing or partial ACK
+const uint8_t LH_STAT_TX_LOST = 2;      // uplinks given up without ACK
+const uint8_t LH_STAT_ACK_TIMEOUT = 3;  // no valid ACK received within ACK_TIMEOUT
+const uint8_t LH_STAT_LBT_BUSY = 4;     // frames sent on a channel still busy after listen before talk
+// Rx counters
+const uint8_t LH_STAT_RX_FRAMES = 5;    // valid frames received, ACKs included
+const uint8_t LH_STAT_RX_CRC_ERROR = 6; // frames dropped on a CRC16 error
+const uint8_t LH_STAT_RX_INVALID = 7;   // frames dropped on a MIC error or an invalid header
+const uint8_t LH_STAT_RX_WRONG_NETWORK = 8;
+const uint8_t LH_STAT_RX_OTHER_NODE = 9; // frames for another node, dropped on the header before the CRC check: unverified
+const uint8_t LH_STAT_COUNTERS = 10;
+
+// stats block: LH_STAT_COUNTERS x uint16 LSB first, then the RSSI (-dBm) and SNR (0.25 dB) of the last ACK
+const uint8_t LH_STATS_SIZE = 2 * LH_STAT_COUNTERS + 2;
+
+/**
+ * @brief Link and protocol health of the node
+ * Counters are cumulative since boot and saturate at 0xFFFF,
+ * the gateway computes the deltas between two stats blocks.
+ */
+class LoRaHomeStats
+{
+public:
+    LoRaHomeStats();
+    void increment(uint8_t counter);
+    void setLastAckSignal(int rssi, float snr);
+    uint16_t getCounter(uint8_t counter);
+    uint8_t serialize(uint8_t *buffer);
+    void reset();
+
+private:
+    uint16_t counters[LH_STAT_COUNTERS];
+    uint8_t lastAckRssi;
+    int8_t lastAckSnr;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <LoRaHomeStorage.h>
+#include <LoRaHomeFrame.h>
+#include <EEPROM.h>
+
+// the whole module is compiled out unless the state is persisted (-D LH_STORAGE)
+#ifdef LH_STORAGE
+
+/**
+ * @brief Construct a new LoRaHomeStorage object
+ * Without any valid record, the first save goes to slot 0
+ */
+LoRaHomeStorage::LoRaHomeStorage()
+{
+    this->lastSlot = LH_STORAGE_SLOTS - 1;
+    this->lastSequence = 0xFF;
+}
+
+/**
+ * @brief find the last record saved and read the state from it
+ * All the valid slots are scanned and the newest sequence number wins. The sequence wraps at 256:
+ * the comparison is done on the signed difference, valid as the LH_STORAGE_SLOTS records span less than 128 numbers.
+ * The counter limit and the RX counter are the largest of all the valid records, compared by signed difference too.
+ * 
+ * @param state filled with the stored state
+ * @return true if a valid record is found, false on a blank or corrupted EEPROM area
+ */
+bool LoRaHomeStorage::load(LoRaHomeState &state)
+{
+    uint8_t record[LH_STORAGE_RECORD_SIZE];
+    uint8_t newest[LH_STORAGE_RECORD_SIZE] = {0};
+    uint16_t counterLimit = 0;
+    uint16_t rxCounter = 0;
+    bool rxCounterValid = false;
+    bool found = false;
+    for (uint8_t slot = 0; slot < LH_STORAGE_SLOTS; slot++)
+    {
+        if (!this->readRecord(slot, record))
+        {
+            continue;
+        }
+        uint16_t limit = record[1] | (record[2] << 8);
+        if (!found || ((int16_t)(limit - counterLimit) > 0))
+        {
+            counterLimit = limit;
+        }
+        uint16_t counter = record[5] | (record[6] << 8);
+        if ((record[7] & LH_STORAGE_FLAG_RX_COUNTER) && (!rxCounterValid || ((int16_t)(counter - rxCounter) > 0)))
+        {
+            rxCounter = counter;
+            rxCounterValid = true;
+        }
+        if (found && ((int8_t)(record[0] - newest[0]) <= 0))
+        {
+            continue;
+        }
+        memcpy(newest, record, LH_STORAGE_RECORD_SIZE);
+        this->lastSlot = slot;
+        found = true;
+    }
+    if (!found)
+    {
+        return false;
+    }
+    this->lastSequence = newest[0];
+    state.counterLimit = counterLimit;
+    state.spreadingFactor = newest[3];
+    state.txPower = (int8_t)newest[4];
+    state.rxCounter = rxCounter;
+    state.rxCounterValid = rxCounterValid;
+    return true;
+}
+
+/**
+ * @brief save the state in the slot following the last record
+ * Only the bytes differing from the EEPROM content are written, the sequence number last
+ * 
+ * @param state the state to be saved
+ */
+void LoRaHomeStorage::save(const LoRaHomeState &state)
+{
+    uint8_t record[LH_STORAGE_RECORD_SIZE];
+    record[0] = this->lastSequence + 1;
+    record[1] = state.counterLimit & 0xff;
+    record[2] = (state.counterLimit >> 8) & 0xff;
+    record[3] = state.spreadingFactor;
+    record[4] = (uint8_t)state.txPower;
+    record[5] = state.rxCounter & 0xff;
+    record[6] = (state.rxCounter >> 8) & 0xff;
+    record[7] = state.rxCounterValid ? LH_STORAGE_FLAG_RX_COUNTER : 0;
+    uint16_t crc = crc16(record, LH_STORAGE_RECORD_SIZE - 2);
+    record[LH_STORAGE_RECORD_SIZE - 2] = crc & 0xff;
+    record[LH_STORAGE_RECORD_SIZE - 1] = (crc >> 8) & 0xff;
+    uint8_t slot = (this->lastSlot + 1) % LH_STORAGE_SLOTS;
+    int address = LH_STORAGE_ADDRESS + slot * LH_STORAGE_RECORD_SIZE;
+    for (uint8_t i = 1; i < LH_STORAGE_RECORD_SIZE; i++)
+    {
+        EEPROM.update(address + i, record[i]);
+    }
+    EEPROM.update(address, record[0]);
+    this->lastSlot = slot;
+    this->lastSequence = record[0];
+}
+
+/**
+ * @brief read a record and check its CRC16
+ * 
+ * @param slot slot index
+ * @param record filled with the LH_STORAGE_RECORD_SIZE bytes of the slot
+ * @return true if the CRC is valid
+ */
+bool LoRaHomeStorage::readRecord(uint8_t slot, uint8_t *record)
+{
+    int address = LH_STORAGE_ADDRESS + slot * LH_STORAGE_RECORD_SIZE;
+    for (uint8_t i = 0; i < LH_STORAGE_RECORD_SIZE; i++)
+    {
+        record[i] = EEPROM.read(address + i);
+    }
+    uint16_t crc = record[LH_STORAGE_RECORD_SIZE - 2] | (record[LH_STORAGE_RECORD_SIZE - 1] << 8);
+    return crc16(record, LH_STORAGE_RECORD_SIZE - 2) == crc;
+}
+
+/**
+ * @brief CRC16 ccitt of the frames, initial value 0xFFFF: blank (0xFF) and zeroed records are invalid
+ * 
+ * @param data bytes to be checked
+ * @param length number of bytes
+ * @return uint16_t the CRC
+ */
+uint16_t LoRaHomeStorage::crc16(const uint8_t *data, uint8_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        crc = LoRaHomeFrame::crc16_update(crc, data[i]);
+    }
+    return crc;
+}
+
+LoRaHomeStorage loraHomeStorage;
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LORAHOMESTORAGE_H
+#define LORAHOMESTORAGE_H
+
+#include <Arduino.h>
+
+// EEPROM area of the state records: LH_STORAGE_SLOTS x LH_STORAGE_RECORD_SIZE bytes from LH_STORAGE_ADDRESS
+// (-D LH_STORAGE_ADDRESS=n to move it out of the way of the application)
+#ifndef LH_STORAGE_ADDRESS
+#define LH_STORAGE_ADDRESS 0
+#endif
+#ifndef LH_STORAGE_SLOTS
+#define LH_STORAGE_SLOTS 64
+#endif
+// the 8 bit sequence numbers of the slots are compared by their signed difference
+static_assert(LH_STORAGE_SLOTS <= 128, "LH_STORAGE_SLOTS shall not exceed 128");
+
+// sequence, counter limit (2 bytes), spreading factor, TX power, RX counter (2 bytes), flags, CRC16 (2 bytes)
+const uint8_t LH_STORAGE_RECORD_SIZE = 10;
+// flags: the RX counter is set
+const uint8_t LH_STORAGE_FLAG_RX_COUNTER = 0x01;
+// TX counter values reserved by each record: the counter is persisted once every LH_STORAGE_COUNTER_BLOCK frames
+const uint16_t LH_STORAGE_COUNTER_BLOCK = 64;
+// a new block is reserved when less counter values than the frames of one exchange (fragments, profiler dump) are left
+const uint16_t LH_STORAGE_COUNTER_MARGIN = 16;
+
+/**
+ * @brief state of the node surviving a reset
+ */
+struct LoRaHomeState
+{
+    uint16_t counterLimit; // first TX counter value not reserved yet, the node resumes from it
+    uint8_t spreadingFactor;
+    int8_t txPower;
+    uint16_t rxCounter;  // counter of the last authenticated downlink (LH_SECURITY replay protection)
+    bool rxCounterValid; // false until the first one
+};
+
+/**
+ * @brief Wear leveled storage of the node state in EEPROM
+ * Each save writes the next slot of a ring of records, tagged with an increasing sequence number
+ * and protected by a CRC16. The last record is the valid one with the newest sequence number.
+ * The sequence number is written last: a save interrupted by a reset leaves a record with the sequence
+ * of the overwritten slot and a CRC of the new one, invalid, and the previous records valid.
+ * The counter limit and the RX counter only grow: they are restored as the largest values of all the valid records,
+ * so a record wrongly taken as valid can never move them back.
+ * 64 slots (640 bytes of the 1 KB EEPROM) and a 64 frames counter block: one EEPROM cell write every 4096 uplinks,
+ * plus one every 64 downlinks with LH_SECURITY.
+ */
+class LoRaHomeStorage
+{
+public:
+    LoRaHomeStorage();
+    bool load(LoRaHomeState &state);
+    void save(const LoRaHomeState &state);
+
+private:
+    bool readRecord(uint8_t slot, uint8_t *record);
+    static uint16_t crc16(const uint8_t *data, uint8_t length);
+
+    uint8_t lastSlot;
+    uint8_t lastSequence;
+};
+
+extern LoRaHomeStorage loraHomeStorage;
+
+#endif
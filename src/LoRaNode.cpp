@@ -1,15 +1,6 @@
 #include <LoRaNode.h>
 #include <Arduino.h>
 
-#define DEBUG
-
-#ifdef DEBUG
-#define DEBUG_MSG(x) Serial.println(F(x))
-#define DEBUG_MSG_VAR(x) Serial.println(x)
-#else
-#define DEBUG_MSG(x) // define empty, so macro does nothing
-#endif
-
 volatile bool LoRaNode::needTransmissionNow = false;
 
 /**
@@ -56,6 +47,7 @@ unsigned long LoRaNode::getTransmissionTimeInterval()
 void LoRaNode::setProcessingTimeInterval(unsigned long timeInterval)
 {
   this->processingTimeInterval = timeInterval;
+  this->scheduler.setTaskPeriod(this->processingTaskId, timeInterval);
 }
 
 /**
@@ -66,6 +58,7 @@ void LoRaNode::setProcessingTimeInterval(unsigned long timeInterval)
 void LoRaNode::setTransmissionTimeInterval(unsigned long timeInterval)
 {
   this->transmissionTimeInterval = timeInterval;
+  this->scheduler.setTaskPeriod(this->transmissionTaskId, timeInterval);
 }
 
 /**
@@ -78,6 +71,16 @@ uint16_t LoRaNode::getTxCounter()
   return this->TxCounter;
 }
 
+/**
+ * @brief set the TxCounter value of the Node, e.g. restored after a reset
+ * 
+ * @param counter next TxCounter value
+ */
+void LoRaNode::setTxCounter(uint16_t counter)
+{
+  this->TxCounter = counter;
+}
+
 void LoRaNode::incrementTxCounter()
 {
   this->TxCounter++;
@@ -101,3 +104,276 @@ void LoRaNode::setTransmissionNowFlag(bool flag)
 {
   needTransmissionNow = flag;
 }
+
+/**
+ * @brief register the processing and transmission tasks of the node
+ * To be invoked once after appSetup, processingTimeInterval and transmissionTimeInterval being set
+ * Processing is registered first, so that it runs before transmission when both are due
+ * 
+ * @param processing function invoking appProcessing
+ * @param transmission function sending the Tx payload to the gateway
+ */
+void LoRaNode::startTasks(LoRaNodeTaskCallback processing, LoRaNodeTaskCallback transmission)
+{
+  this->processingTaskId = this->scheduler.addPeriodicTask(processing, this->processingTimeInterval, this->processingTimeInterval);
+  this->transmissionTaskId = this->scheduler.addPeriodicTask(transmission, this->transmissionTimeInterval, this->transmissionTimeInterval);
+}
+
+/**
+ * @brief invoke the tasks which are due. To be called from the main loop
+ * A transmission requested with setTransmissionNowFlag is run immediately
+ */
+void LoRaNode::runTasks()
+{
+  if (needTransmissionNow)
+  {
+    needTransmissionNow = false;
+    this->transmissionForced = true;
+    this->scheduler.triggerTask(this->transmissionTaskId);
+  }
+  this->scheduler.run();
+  this->transmissionForced = false;
+}
+
+/**
+ * @brief indicate whether the running transmission has been requested with setTransmissionNowFlag
+ * A forced transmission is never suppressed by report on change
+ * 
+ * @return true if forced
+ */
+bool LoRaNode::isTransmissionForced()
+{
+  return this->transmissionForced;
+}
+
+/**
+ * @brief Get the scheduler of the node, to add application tasks
+ * 
+ * @return LoRaNodeScheduler& 
+ */
+LoRaNodeScheduler &LoRaNode::getScheduler()
+{
+  return this->scheduler;
+}
+
+/**
+ * @brief enable report on change: a payload identical to the last acknowledged one is not sent,
+ * unless maxSilenceInterval elapsed since the last report (heartbeat)
+ * 
+ * @param maxSilenceInterval in ms, 0 to report every transmission time interval
+ */
+void LoRaNode::setReportOnChange(unsigned long maxSilenceInterval)
+{
+  this->maxSilenceInterval = maxSilenceInterval;
+}
+
+/**
+ * @brief Get the max silence interval of report on change
+ * 
+ * @return unsigned long in ms, 0 if report on change is disabled
+ */
+unsigned long LoRaNode::getMaxSilenceInterval()
+{
+  return this->maxSilenceInterval;
+}
+
+/**
+ * @brief filter a numeric field of the Tx payload with a deadband
+ * As long as the value stays within the deadband of the last reported value, the last reported value is sent,
+ * so that small variations do not count as a change
+ * 
+ * @param key JSON key of the field. The string shall remain valid (literal)
+ * @param deadband absolute deadband
+ * @return true if added, false if LH_MAX_DEADBANDS fields are already filtered
+ */
+bool LoRaNode::addDeadband(const char *key, float deadband)
+{
+  if (this->deadbandCount >= LH_MAX_DEADBANDS)
+  {
+    return false;
+  }
+  Deadband &db = this->deadbands[this->deadbandCount++];
+  db.key = key;
+  db.deadband = deadband;
+  db.reported = false;
+  return true;
+}
+
+/**
+ * @brief replace the fields of the Tx payload within their deadband by their last reported value
+ * 
+ * @param payload the JSON Tx payload
+ */
+void LoRaNode::applyDeadbands(JsonDocument &payload)
+{
+  for (uint8_t i = 0; i < this->deadbandCount; i++)
+  {
+    Deadband &db = this->deadbands[i];
+    if (!db.reported || payload[db.key].isNull())
+    {
+      continue;
+    }
+    float delta = payload[db.key].as<float>() - db.lastReported;
+    if ((delta < db.deadband) && (delta > -db.deadband))
+    {
+      payload[db.key] = db.lastReported;
+    }
+  }
+}
+
+/**
+ * @brief the Tx payload has been acknowledged: its values become the last reported ones
+ * 
+ * @param payload the JSON Tx payload
+ */
+void LoRaNode::commitDeadbands(JsonDocument &payload)
+{
+  for (uint8_t i = 0; i < this->deadbandCount; i++)
+  {
+    Deadband &db = this->deadbands[i];
+    if (!payload[db.key].isNull())
+    {
+      db.lastReported = payload[db.key].as<float>();
+      db.reported = true;
+    }
+  }
+}
+
+/**
+ * @brief record a sample of a time series, e.g. from appProcessing
+ * All the samples recorded since the last acknowledged (or queued, with LH_TX_WINDOW_SIZE > 1) transmission
+ * are sent with addJsonSamples.
+ * When LH_MAX_SAMPLES samples are buffered, the oldest one is dropped
+ * 
+ * @param value sample, scaled to an integer by the application (e.g. temperature in 0.1 C)
+ */
+void LoRaNode::addSample(int16_t value)
+{
+  if (this->sampleCount == LH_MAX_SAMPLES)
+  {
+    this->sampleHead = (this->sampleHead + 1) % LH_MAX_SAMPLES;
+    this->sampleCount--;
+  }
+  Sample &sample = this->samples[(this->sampleHead + this->sampleCount) % LH_MAX_SAMPLES];
+  sample.value = value;
+  sample.time = millis() / 1000;
+  this->sampleCount++;
+}
+
+/**
+ * @brief Get the number of samples buffered
+ * 
+ * @return uint8_t 
+ */
+uint8_t LoRaNode::getSampleCount()
+{
+  return this->sampleCount;
+}
+
+/**
+ * @brief add the buffered samples to the Tx payload, to be called from addJsonTxPayload
+ * The samples are encoded (see encodeSamples) and added as a base64 string
+ * 
+ * @param payload the JSON Tx payload
+ * @param key JSON key of the samples
+ * @return true if added, false if no sample is buffered or the payload is full
+ */
+bool LoRaNode::addJsonSamples(JsonDocument &payload, const char *key)
+{
+  static const char base64[] PROGMEM = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  if (this->sampleCount == 0)
+  {
+    return false;
+  }
+  uint8_t encoded[LH_SAMPLES_ENCODED_MAX_SIZE];
+  uint8_t size = this->encodeSamples(encoded);
+  char text[LH_SAMPLES_TEXT_MAX_SIZE + 1];
+  uint8_t j = 0;
+  for (uint8_t i = 0; i < size; i += 3)
+  {
+    uint32_t group = (uint32_t)encoded[i] << 16;
+    if (i + 1 < size)
+    {
+      group |= (uint32_t)encoded[i + 1] << 8;
+    }
+    if (i + 2 < size)
+    {
+      group |= encoded[i + 2];
+    }
+    text[j++] = pgm_read_byte(&base64[(group >> 18) & 0x3f]);
+    text[j++] = pgm_read_byte(&base64[(group >> 12) & 0x3f]);
+    text[j++] = (i + 1 < size) ? pgm_read_byte(&base64[(group >> 6) & 0x3f]) : '=';
+    text[j++] = (i + 2 < size) ? pgm_read_byte(&base64[group & 0x3f]) : '=';
+  }
+  text[j] = '\0';
+  // char * (not const): the string is copied into the document
+  return payload[key].set((char *)text);
+}
+
+/**
+ * @brief a new Tx payload is being built: none of the buffered samples is carried yet.
+ * To be called before addJsonTxPayload, so that an unsent or unacknowledged payload does not commit stale samples
+ * 
+ */
+void LoRaNode::beginSamples()
+{
+  this->samplesSent = 0;
+}
+
+/**
+ * @brief the Tx payload has been acknowledged, or queued in the TX window that resends it: drop the samples it carried
+ * 
+ */
+void LoRaNode::commitSamples()
+{
+  this->sampleHead = (this->sampleHead + this->samplesSent) % LH_MAX_SAMPLES;
+  this->sampleCount -= this->samplesSent;
+  this->samplesSent = 0;
+}
+
+/**
+ * @brief encode the buffered samples, oldest first:
+ * count, age of the oldest sample in s relative to the frame, oldest value (zig-zag),
+ * then for each next sample: time since the previous one in s, zig-zag delta to the previous value.
+ * All fields are varints (7 bits per byte, LSB first). The gateway rebuilds the series from the frame reception time
+ * 
+ * @param buffer at least LH_SAMPLES_ENCODED_MAX_SIZE bytes
+ * @return uint8_t number of bytes
+ */
+uint8_t LoRaNode::encodeSamples(uint8_t *buffer)
+{
+  uint16_t now = millis() / 1000;
+  uint8_t size = writeVarint(buffer, this->sampleCount);
+  int32_t previousValue = 0;
+  uint16_t previousTime = now;
+  for (uint8_t i = 0; i < this->sampleCount; i++)
+  {
+    Sample &sample = this->samples[(this->sampleHead + i) % LH_MAX_SAMPLES];
+    int32_t delta = sample.value - previousValue;
+    size += writeVarint(&buffer[size], (uint16_t)(i == 0 ? now - sample.time : sample.time - previousTime));
+    size += writeVarint(&buffer[size], ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    previousValue = sample.value;
+    previousTime = sample.time;
+  }
+  this->samplesSent = this->sampleCount;
+  return size;
+}
+
+/**
+ * @brief write a varint: 7 bits per byte, LSB first, MSB set on all bytes but the last
+ * 
+ * @param buffer where to write
+ * @param value the value
+ * @return uint8_t number of bytes written
+ */
+uint8_t LoRaNode::writeVarint(uint8_t *buffer, uint32_t value)
+{
+  uint8_t size = 0;
+  while (value >= 0x80)
+  {
+    buffer[size++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  buffer[size++] = value;
+  return size;
+}
@@ -3,9 +3,29 @@
 
 #include <ArduinoJson.h>
 #include <Arduino.h>
+#include <LoRaNodeScheduler.h>
+#include <LoRaHomeFrame.h>
 
 #define ARDUINO_UNO_BOARD
 
+// Max number of payload fields filtered with a deadband (-D LH_MAX_DEADBANDS=n to change)
+#ifndef LH_MAX_DEADBANDS
+#define LH_MAX_DEADBANDS 4
+#endif
+
+// Max number of samples buffered between two transmissions, 4 bytes of RAM each (-D LH_MAX_SAMPLES=n to change)
+#ifndef LH_MAX_SAMPLES
+#define LH_MAX_SAMPLES 8
+#endif
+// encoded samples: count, age of the oldest sample, base value, then up to 3 + 3 bytes per sample
+// (varints of 16 bits times and 17 bits zig-zag deltas)
+static_assert(3 + 3 + 3 + (LH_MAX_SAMPLES - 1) * 6 <= 255, "LH_MAX_SAMPLES too large for 8 bits encoded sizes");
+const uint8_t LH_SAMPLES_ENCODED_MAX_SIZE = 3 + 3 + 3 + (LH_MAX_SAMPLES - 1) * 6;
+// base64 text of the encoded samples, terminator excluded
+const uint8_t LH_SAMPLES_TEXT_MAX_SIZE = (LH_SAMPLES_ENCODED_MAX_SIZE + 2) / 3 * 4;
+// the text shall fit in one frame with the shortest JSON member around it: {"k":"..."}
+static_assert(LH_SAMPLES_TEXT_MAX_SIZE + 8 <= LH_FRAME_MAX_PAYLOAD_SIZE - 1, "LH_MAX_SAMPLES too large for one frame");
+
 class LoRaNode
 {
 public:
@@ -43,9 +63,24 @@ public:
   void setTransmissionTimeInterval(unsigned long timeInterval);
   void setProcessingTimeInterval(unsigned long timeInterval);
   uint16_t getTxCounter();
+  void setTxCounter(uint16_t counter);
   void incrementTxCounter();
   static void setTransmissionNowFlag(bool flag);
   static bool getTransmissionNowFlag();
+  void startTasks(LoRaNodeTaskCallback processing, LoRaNodeTaskCallback transmission);
+  void runTasks();
+  LoRaNodeScheduler &getScheduler();
+  bool isTransmissionForced();
+  void setReportOnChange(unsigned long maxSilenceInterval);
+  unsigned long getMaxSilenceInterval();
+  bool addDeadband(const char *key, float deadband);
+  void applyDeadbands(JsonDocument &payload);
+  void commitDeadbands(JsonDocument &payload);
+  void addSample(int16_t value);
+  uint8_t getSampleCount();
+  bool addJsonSamples(JsonDocument &payload, const char *key);
+  void beginSamples();
+  void commitSamples();
 
 private:
   uint8_t NodeId = 0;
@@ -55,6 +90,34 @@ private:
   unsigned long processingTimeInterval = 180000;
   // to force immediate transmission
   volatile static bool needTransmissionNow;
+  // processing, transmission and application tasks
+  LoRaNodeScheduler scheduler;
+  uint8_t processingTaskId = LH_TASK_NONE;
+  uint8_t transmissionTaskId = LH_TASK_NONE;
+  bool transmissionForced = false;
+  // report on change: 0 to report every transmission time interval
+  unsigned long maxSilenceInterval = 0;
+  struct Deadband
+  {
+    const char *key;
+    float deadband;
+    float lastReported;
+    bool reported;
+  };
+  Deadband deadbands[LH_MAX_DEADBANDS];
+  uint8_t deadbandCount = 0;
+  // ring of the samples recorded since the last acknowledged transmission
+  struct Sample
+  {
+    int16_t value;
+    uint16_t time; // s, wraps every 18 h
+  };
+  Sample samples[LH_MAX_SAMPLES];
+  uint8_t sampleHead = 0;
+  uint8_t sampleCount = 0;
+  uint8_t samplesSent = 0;
+  uint8_t encodeSamples(uint8_t *buffer);
+  static uint8_t writeVarint(uint8_t *buffer, uint32_t value);
 };
 
 extern LoRaNode *Node;
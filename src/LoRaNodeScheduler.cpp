@@ -0,0 +1,176 @@
+#include <LoRaNodeScheduler.h>
+
+/**
+ * @brief Construct a new LoRaNodeScheduler object, without any task
+ * 
+ */
+LoRaNodeScheduler::LoRaNodeScheduler()
+{
+  for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+  {
+    this->tasks[i].callback = NULL;
+  }
+}
+
+/**
+ * @brief add a task invoked every period
+ * 
+ * @param callback function to be invoked
+ * @param period in ms
+ * @param firstDelay delay before the first invocation, in ms
+ * @return uint8_t task Id, LH_TASK_NONE if the task table is full
+ */
+uint8_t LoRaNodeScheduler::addPeriodicTask(LoRaNodeTaskCallback callback, unsigned long period, unsigned long firstDelay)
+{
+  for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+  {
+    if (this->tasks[i].callback == NULL)
+    {
+      this->tasks[i].callback = callback;
+      this->tasks[i].deadline = millis() + firstDelay;
+      this->tasks[i].period = period;
+      this->tasks[i].maxJitter = 0;
+      return i;
+    }
+  }
+  return LH_TASK_NONE;
+}
+
+/**
+ * @brief change the period of a periodic task, effective after its next invocation
+ * 
+ * @param taskId Id returned when the task was added
+ * @param period in ms
+ */
+void LoRaNodeScheduler::setTaskPeriod(uint8_t taskId, unsigned long period)
+{
+  if (taskId < LH_MAX_TASKS)
+  {
+    this->tasks[taskId].period = period;
+  }
+}
+
+/**
+ * @brief invoke a task as soon as possible. A periodic task then restarts its period
+ * 
+ * @param taskId Id returned when the task was added
+ */
+void LoRaNodeScheduler::triggerTask(uint8_t taskId)
+{
+  if (taskId < LH_MAX_TASKS)
+  {
+    this->tasks[taskId].deadline = millis();
+  }
+}
+
+/**
+ * @brief invoke the tasks whose deadline is reached. To be called from the main loop
+ * 
+ */
+void LoRaNodeScheduler::run()
+{
+  for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+  {
+    Task &task = this->tasks[i];
+    if (task.callback == NULL)
+    {
+      continue;
+    }
+    unsigned long now = millis();
+    // signed difference to be robust to millis() overflow
+    long late = (long)(now - task.deadline);
+    if (late < 0)
+    {
+      continue;
+    }
+    if ((unsigned long)late > task.maxJitter)
+    {
+      task.maxJitter = late;
+    }
+    if ((unsigned long)late < task.period)
+    {
+      task.deadline += task.period;
+    }
+    else
+    {
+      // more than one period late (or triggered): restart the period from now
+      task.deadline = now + task.period;
+    }
+    task.callback();
+  }
+}
+
+/**
+ * @brief time left before the next task is due. The main loop idles during this time
+ * 
+ * @return unsigned long in ms, 0 if a task is due, ULONG_MAX if there is no task
+ */
+unsigned long LoRaNodeScheduler::getTimeToNextDeadline()
+{
+  unsigned long next = (unsigned long)-1;
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+  {
+    if (this->tasks[i].callback == NULL)
+    {
+      continue;
+    }
+    long left = (long)(this->tasks[i].deadline - now);
+    if (left <= 0)
+    {
+      return 0;
+    }
+    if ((unsigned long)left < next)
+    {
+      next = left;
+    }
+  }
+  return next;
+}
+
+/**
+ * @brief Get the max lateness of a task since the last reset
+ * 
+ * @param taskId Id returned when the task was added
+ * @return unsigned long in ms
+ */
+unsigned long LoRaNodeScheduler::getMaxJitter(uint8_t taskId)
+{
+  if (taskId >= LH_MAX_TASKS)
+  {
+    return 0;
+  }
+  return this->tasks[taskId].maxJitter;
+}
+
+/**
+ * @brief reset the max lateness of all the tasks
+ * 
+ */
+void LoRaNodeScheduler::resetJitter()
+{
+  for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+  {
+    this->tasks[i].maxJitter = 0;
+  }
+}
+
+/**
+ * @brief print the max lateness of the tasks since the last reset, one CSV line per task: "jitter,<task Id>,<ms>"
+ * 
+ * @param out where to print, typically Serial
+ */
+void LoRaNodeScheduler::dump(Print &out)
+{
+  for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+  {
+    if (this->tasks[i].callback == NULL)
+    {
+      continue;
+    }
+    out.print(F("jitter,"));
+    out.print(i);
+    out.print(',');
+    out.println(this->getMaxJitter(i));
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef LORANODESCHEDULER_H
+#define LORANODESCHEDULER_H
+
+#include <Arduino.h>
+
+// Max number of tasks, statically allocated (-D LH_MAX_TASKS=n to change)
+#ifndef LH_MAX_TASKS
+#define LH_MAX_TASKS 6
+#endif
+
+const uint8_t LH_TASK_NONE = 0xFF;
+
+typedef void (*LoRaNodeTaskCallback)(void);
+
+/**
+ * @brief Periodic tasks scheduler, without heap allocation
+ * Tasks are kept in a fixed table: with a handful of tasks a linear scan is cheaper than a timer wheel.
+ * Periodic tasks are rescheduled from their deadline, so that lateness does not accumulate.
+ * The lateness of each task (jitter) is measured when it runs, and dumped with the profiler histograms.
+ * The main loop idles while no task is due (getTimeToNextDeadline).
+ */
+class LoRaNodeScheduler
+{
+public:
+  LoRaNodeScheduler();
+  uint8_t addPeriodicTask(LoRaNodeTaskCallback callback, unsigned long period, unsigned long firstDelay = 0);
+  void setTaskPeriod(uint8_t taskId, unsigned long period);
+  void triggerTask(uint8_t taskId);
+  void run();
+  unsigned long getTimeToNextDeadline();
+  unsigned long getMaxJitter(uint8_t taskId);
+  void resetJitter();
+  void dump(Print &out);
+
+private:
+  struct Task
+  {
+    LoRaNodeTaskCallback callback;
+    unsigned long deadline;
+    unsigned long period;
+    unsigned long maxJitter;
+  };
+  Task tasks[LH_MAX_TASKS];
+};
+
+#endif
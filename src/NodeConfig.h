@@ -6,4 +6,14 @@ const unsigned long PROCESSING_TIME_INTERVAL = 5000;
 const unsigned long TRANSMISSION_TIME_INTERVAL = 3000; 
 const uint16_t MY_NETWORK_ID = 0xACDC;
 
+#ifdef LH_SECURITY
+// AES-128 key shared with the gateway, unique per network and never committed:
+// given at build time, e.g. build_flags = -D LH_SECURITY_KEY=${sysenv.LH_SECURITY_KEY}
+// with LH_SECURITY_KEY="{0x..,0x..,...}" (16 bytes) set in the environment
+#ifndef LH_SECURITY_KEY
+#error "LH_SECURITY requires LH_SECURITY_KEY, the 16 bytes AES key shared with the gateway"
+#endif
+const uint8_t SECURITY_KEY[16] PROGMEM = LH_SECURITY_KEY;
+#endif
+
 #endif 
\ No newline at end of file
@@ -2,16 +2,10 @@
 #include <Arduino.h>
 #include <TestNode.h>
 #include "NodeConfig.h"
+#include <LoRaHomeLog.h>
 
-#define DEBUG
-#ifdef DEBUG
-#define DEBUG_MSG(x) Serial.println(F(x))
-#define DEBUG_MSG_VAR(x) Serial.println(x)
-#else
-#define DEBUG_MSG(x) // define empty, so macro does nothing
-#define DEBUG_MSG_VAR(x)
-#endif
-
+// log events of this file
+#define LH_LOG_MODULE LH_LOG_MODULE_APP
 
 /**
  * @brief Construct a new Reed Switch Node:: Reed Switch Node object
@@ -46,7 +40,7 @@ void TestNode::addJsonTxPayload(JsonDocument &payload)
     // send a simple tx counter
     static uint8_t i = 0;
     payload["tx"] = i++;
-    DEBUG_MSG("--- Send msg ...");
+    LH_LOG(LH_LOG_INFO, "--- Send msg ...");
 }
 
 /**
@@ -60,8 +54,8 @@ void TestNode::parseJsonRxPayload(JsonDocument &payload)
    // assume receicing a message with json key "msg", display it
    if (payload["msg"].isNull() == false)
     {
-        DEBUG_MSG("--- receive:");
-        DEBUG_MSG_VAR((const char*)payload["msg"]);
+        // the log only takes numbers: length of the message
+        LH_LOG_VALUE(LH_LOG_INFO, "--- receive msg, length", strlen((const char *)payload["msg"]));
     }
 }
 
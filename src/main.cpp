@@ -4,23 +4,42 @@
 #include <ArduinoJson.h>
 #include <LoRaNode.h>
 #include <LoRaHomeNode.h>
+#include <LoRaHomeProfiler.h>
+#include <LoRaHomeRadioCapture.h>
+#include <LoRaHomeLog.h>
+#include <avr/sleep.h>
 
+// the unit tests of test/embedded have their own setup() and loop()
+#ifndef PIO_UNIT_TESTING
+
+// serial monitor: log, profiler and capture dumps
 #define DEBUG
 
-#ifdef DEBUG
-#define DEBUG_MSG(x) Serial.println(F(x))
-#define DEBUG_MSG_VAR(x) Serial.println(x)
-#else
-#define DEBUG_MSG(x) // define empty, so macro does nothing
-#endif
+// log events of this file
+#define LH_LOG_MODULE LH_LOG_MODULE_MAIN
 
 
-// sampling management
-unsigned long lastSendTime = 0;    // last send time
-unsigned long lastProcessTime = 0; // last processing time
+/**
+* Processing task: application processing of the node
+*/
+void processingTask()
+{
+  Node->appProcessing();
+}
+
+/**
+* Transmission task: send the Tx payload of the node to the gateway
+*/
+void transmissionTask()
+{
+  loraHomeNode.sendToGateway();
+}
 
 void setup()
 {
+#ifdef LH_PROFILER
+  loraHomeProfiler.paintStack();
+#endif
 
 //initialize Serial Monitor
 #ifdef DEBUG
@@ -28,31 +47,56 @@ void setup()
   while (!Serial)
     ;
 #endif
-  DEBUG_MSG("initializing LoRa Node");
+  LH_LOG(LH_LOG_INFO, "initializing LoRa Node");
   // initialize LoRa    
   loraHomeNode.setup();
   // call node specific configuration (end user)
   Node->appSetup();
+  // schedule processing and transmission as per node time intervals
+  Node->startTasks(processingTask, transmissionTask);
 }
 
 /**
 * Main loop of the LoRa Node
 * Constantly try to receive JSON LoRa message
-* Every transmissionTimeInterval send JSON LoRa messages
+* Run processing, transmission and application tasks when due, idle the CPU in between
 */
 void loop()
 {
-  unsigned long tick = millis();
-  if ((tick - lastProcessTime) > Node->getProcessingTimeInterval())
+  Node->runTasks();
+  loraHomeNode.receiveLoraMessage();
+#if (LH_LOG_LEVEL > 0) && defined(DEBUG)
+  loraHomeLog.drain(Serial);
+#endif
+#if (defined(LH_PROFILER) || defined(LH_CAPTURE)) && defined(DEBUG)
+  // commands on the serial monitor:
+  // 'p' dumps the profiler histograms, the stack headroom and the jitter of the tasks
+  // 'c' dumps the packet capture (binary, see tools/lh_pcap.py)
+  if (Serial.available())
   {
-    Node->appProcessing();
-    lastProcessTime = millis();
+    char command = Serial.read();
+#ifdef LH_PROFILER
+    if (command == 'p')
+    {
+      loraHomeProfiler.dump(Serial);
+      Node->getScheduler().dump(Serial);
+    }
+#endif
+#ifdef LH_CAPTURE
+    if (command == 'c')
+    {
+      loraHomeCapture.dump(Serial);
+    }
+#endif
   }
-  if (((tick - lastSendTime) > Node->getTransmissionTimeInterval()) || (Node->getTransmissionNowFlag() == true))
+#endif
+  // no task due and no receive window or wake-on-radio CAD to handle: idle until the next interrupt,
+  // i.e. the millis() tick (1 ms), the radio or the serial port. Deeper sleep modes would stop millis() and the scheduler with it
+  if ((Node->getScheduler().getTimeToNextDeadline() > 0) && (loraHomeNode.getTimeToNextRxEvent() > 0))
   {
-    Node->setTransmissionNowFlag(false);
-    loraHomeNode.sendToGateway();
-    lastSendTime = millis(); // timestamp the message
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_mode();
   }
-  loraHomeNode.receiveLoraMessage();
 }
+
+#endif
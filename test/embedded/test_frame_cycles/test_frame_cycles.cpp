@@ -0,0 +1,235 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LoRaHomeFrame.h>
+#include <LoRaHomeNode.h>
+#include <LoRaHomeProfiler.h>
+#include <LoRaHomeSecurity.h>
+#include <LoRaNode.h>
+#include <NodeConfig.h>
+#include "../../lh_test.h"
+
+// CPU cycles per frame on the ATmega328P, counted by Timer1:
+//   pio test -e simavr -v on the simulated MCU, pio test -e pro8MHzatmega328 -v on the board
+// Build with -D LH_SECURITY to include the AES-CTR encryption and the CMAC of each frame.
+// Each result is printed as a line:
+//   cycles,<name>,<payload bytes>,<cycles>
+// A path above its cycle budget fails the test. At 8 MHz, 8000 cycles are 1 ms.
+// With -D LH_PROFILER (simavr environment), the stack headroom left by all the paths is checked too.
+
+const uint8_t CYCLES_PAYLOAD_SIZES[] = {0, 16, 32, 64, 96, LH_FRAME_MAX_PAYLOAD_SIZE - 1};
+
+/**
+ * @brief cycle budget of a path: fixed + perByte x payload bytes
+ */
+struct CyclesBudget
+{
+    const char *name;
+    uint32_t fixed;
+    uint16_t perByte;
+};
+
+// AES-128 block of the C implementation of LoRaHomeSecurity: about 12000 cycles, i.e. 750 per byte encrypted or MACed
+#ifdef LH_SECURITY
+const uint32_t CYCLES_SECURITY_FIXED = 28000;  // MIC subkey and last block, partial CTR block
+const uint16_t CYCLES_SECURITY_PER_BYTE = 1600; // encryption + MIC
+#else
+const uint32_t CYCLES_SECURITY_FIXED = 0;
+const uint16_t CYCLES_SECURITY_PER_BYTE = 0;
+#endif
+
+// upper bounds estimated from the code, with a margin: a regression of the code, not the compiler version, fails the test
+const CyclesBudget CYCLES_BUDGETS[] = {
+    {"serialize", 1500 + CYCLES_SECURITY_FIXED, 150 + CYCLES_SECURITY_PER_BYTE},  // copy + bitwise CRC16
+    {"create_from_rx_message", 2500 + CYCLES_SECURITY_FIXED, 250 + CYCLES_SECURITY_PER_BYTE}, // byte decoder + CRC16
+    {"crypt", 2000, 1000},
+    {"mic", 26000, 1000},
+    // JSON build, frame serialization, listen before talk, gateway double, ACK decode: a few bytes of payload,
+    // secured by the node, checked and answered by the gateway double, checked by the node
+    {"send_ack_cycle", 150000 + 4 * CYCLES_SECURITY_FIXED, 0},
+};
+
+// stack never used by the paths measured, RAM left to the application
+const uint16_t CYCLES_MIN_STACK_HEADROOM = 128;
+
+// gateway of the ACK cycle
+GatewayRadio gateway;
+
+volatile uint16_t timerOverflows;
+
+ISR(TIMER1_OVF_vect)
+{
+    timerOverflows++;
+}
+
+/**
+ * @brief start counting the CPU cycles: Timer1 without prescaler
+ * 
+ * @param pauseMillis stop the millis() interrupt, so that its cycles are not counted. Paths waiting on millis() keep it.
+ */
+static void startCycles(bool pauseMillis = true)
+{
+    if (pauseMillis)
+    {
+        TIMSK0 &= ~_BV(TOIE0);
+    }
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    timerOverflows = 0;
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+    TCCR1B = _BV(CS10);
+}
+
+/**
+ * @brief stop counting the CPU cycles
+ * 
+ * @return uint32_t cycles since startCycles(), start and stop included
+ */
+static uint32_t stopCycles()
+{
+    TCCR1B = 0;
+    uint32_t cycles = ((uint32_t)timerOverflows << 16) | TCNT1;
+    // overflow at the last cycle, its interrupt not served yet
+    if (TIFR1 & _BV(TOV1))
+    {
+        cycles += 0x10000UL;
+        TIFR1 = _BV(TOV1);
+    }
+    TIMSK1 = 0;
+    TIMSK0 |= _BV(TOIE0);
+    return cycles;
+}
+
+// cycles of startCycles() + stopCycles() alone, subtracted from the results
+static uint32_t cyclesOverhead;
+
+/**
+ * @brief print a result line and check the budget of the path
+ * 
+ * @param name what is measured, a path of CYCLES_BUDGETS
+ * @param payloadSize payload bytes
+ * @param cycles cycles counted, overhead included
+ */
+static void report(const char *name, uint8_t payloadSize, uint32_t cycles)
+{
+    cycles -= cyclesOverhead;
+    uint32_t budget = 0;
+    for (const CyclesBudget &path : CYCLES_BUDGETS)
+    {
+        if (strcmp(path.name, name) == 0)
+        {
+            budget = path.fixed + (uint32_t)path.perByte * payloadSize;
+        }
+    }
+    printResult(Serial, "cycles", name, payloadSize, cycles);
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(0, budget, name);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32_MESSAGE(budget, cycles, name);
+}
+
+void test_frame_serialize()
+{
+    LoRaHomeFrame frame;
+    uint8_t buffer[LH_FRAME_MAX_SIZE];
+    for (uint8_t payloadSize : CYCLES_PAYLOAD_SIZES)
+    {
+        fillFrame(frame, NODE_ID, LH_NODE_ID_GATEWAY, LH_MSG_TYPE_NODE_MSG_ACK_REQ, payloadSize);
+        startCycles();
+        uint8_t size = frame.serialize(buffer);
+        report("serialize", payloadSize, stopCycles());
+        TEST_ASSERT_EQUAL(LH_FRAME_MIN_SIZE + payloadSize, size);
+    }
+}
+
+void test_frame_create_from_rx_message()
+{
+    LoRaHomeFrame frame;
+    uint8_t buffer[LH_FRAME_MAX_SIZE];
+    for (uint8_t payloadSize : CYCLES_PAYLOAD_SIZES)
+    {
+        fillFrame(frame, NODE_ID, LH_NODE_ID_GATEWAY, LH_MSG_TYPE_NODE_MSG_ACK_REQ, payloadSize);
+        uint8_t size = frame.serialize(buffer);
+        startCycles();
+        bool valid = frame.createFromRxMessage(buffer, size, true);
+        report("create_from_rx_message", payloadSize, stopCycles());
+        TEST_ASSERT_TRUE(valid);
+        TEST_ASSERT_EQUAL(payloadSize, frame.payloadSize);
+    }
+}
+
+#ifdef LH_SECURITY
+void test_security_crypt_mic()
+{
+    uint8_t buffer[LH_FRAME_MAX_SIZE];
+    uint8_t mic[LH_MIC_SIZE];
+    memset(buffer, 0x5A, sizeof(buffer));
+    for (uint8_t payloadSize : CYCLES_PAYLOAD_SIZES)
+    {
+        startCycles();
+        loraHomeSecurity.crypt(buffer, &buffer[LH_FRAME_INDEX_PAYLOAD], payloadSize);
+        report("crypt", payloadSize, stopCycles());
+        startCycles();
+        loraHomeSecurity.computeMIC(buffer, LH_FRAME_HEADER_SIZE + payloadSize, mic);
+        report("mic", payloadSize, stopCycles());
+        TEST_ASSERT_TRUE(loraHomeSecurity.checkMIC(buffer, LH_FRAME_HEADER_SIZE + payloadSize, mic));
+    }
+}
+#endif
+
+void test_send_ack_cycle()
+{
+    LoRaHomeStats &stats = loraHomeNode.getStats();
+    // a missing ACK would cost ACK_TIMEOUT per retry: check the first cycle before timing the next one
+    loraHomeNode.sendToGateway();
+    TEST_ASSERT_EQUAL(0, stats.getCounter(LH_STAT_TX_LOST));
+    uint16_t rxFrames = stats.getCounter(LH_STAT_RX_FRAMES);
+    // receiveAck() waits on millis()
+    startCycles(false);
+    loraHomeNode.sendToGateway();
+    uint32_t cycles = stopCycles();
+    report("send_ack_cycle", gateway.received, cycles);
+    TEST_ASSERT_EQUAL(0, stats.getCounter(LH_STAT_TX_LOST));
+    TEST_ASSERT_EQUAL(rxFrames + 1, stats.getCounter(LH_STAT_RX_FRAMES));
+}
+
+#ifdef LH_PROFILER
+void test_stack_headroom()
+{
+    uint16_t headroom = loraHomeProfiler.getStackHeadroom();
+    printResult(Serial, "stack", "headroom", 0, headroom);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT16(CYCLES_MIN_STACK_HEADROOM, headroom);
+}
+#endif
+
+void setup()
+{
+#ifdef LH_PROFILER
+    loraHomeProfiler.paintStack();
+#endif
+    // time for the test runner to open the serial port after the reset
+    delay(2000);
+#ifdef LH_SECURITY
+    loraHomeSecurity.begin(SECURITY_KEY);
+#endif
+    loraHomeNode.setRadio(&gateway);
+    loraHomeNode.setup();
+    Node->appSetup();
+    startCycles();
+    cyclesOverhead = stopCycles();
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_serialize);
+    RUN_TEST(test_frame_create_from_rx_message);
+#ifdef LH_SECURITY
+    RUN_TEST(test_security_crypt_mic);
+#endif
+    RUN_TEST(test_send_ack_cycle);
+    // last: the deepest stack of all the tests
+#ifdef LH_PROFILER
+    RUN_TEST(test_stack_headroom);
+#endif
+    UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,145 @@
+#ifndef LH_TEST_H
+#define LH_TEST_H
+
+// Helpers shared by the tests of test/native (host) and test/embedded (ATmega328P),
+// included as "../../lh_test.h": frames of a given payload size, result lines and a gateway radio double.
+
+#include <Arduino.h>
+#include <LoRaHomeFrame.h>
+#include <LoRaHomeRadio.h>
+#include <NodeConfig.h>
+
+/**
+ * @brief frame with a payload of the given size, filled with letters
+ *
+ * @param frame the frame
+ * @param nodeIdEmitter emitter, e.g. LH_NODE_ID_GATEWAY for a downlink
+ * @param nodeIdRecipient recipient, e.g. NODE_ID for a downlink
+ * @param messageType LH_MSG_TYPE_xxx
+ * @param payloadSize payload bytes, at most LH_FRAME_MAX_PAYLOAD_SIZE - 1
+ */
+inline void fillFrame(LoRaHomeFrame &frame, uint8_t nodeIdEmitter, uint8_t nodeIdRecipient, uint8_t messageType,
+                      uint8_t payloadSize)
+{
+    frame = LoRaHomeFrame(MY_NETWORK_ID, nodeIdEmitter, nodeIdRecipient, messageType, 1);
+    for (uint8_t i = 0; i < payloadSize; i++)
+    {
+        frame.jsonPayload[i] = 'a' + (i % 26);
+    }
+    frame.jsonPayload[payloadSize] = '\0';
+    frame.payloadSize = payloadSize;
+}
+
+/**
+ * @brief print a result line: <kind>,<name>,<payload bytes>,<value>
+ *
+ * @param out where to print: Serial on the board, stdout on the host
+ * @param kind kind of result, e.g. "bench" or "cycles"
+ * @param name what is measured
+ * @param payloadSize payload bytes
+ * @param value the result
+ */
+inline void printResult(Print &out, const char *kind, const char *name, uint16_t payloadSize, uint32_t value)
+{
+    out.print(kind);
+    out.print(',');
+    out.print(name);
+    out.print(',');
+    out.print(payloadSize);
+    out.print(',');
+    out.println(value);
+    out.flush();
+}
+
+/**
+ * @brief LoRaHomeRadio standing for a gateway: each frame requesting an ACK is acknowledged at once.
+ * Without an ACK pending, the downlink given to setDownlink() is received again and again.
+ *
+ */
+class GatewayRadio : public LoRaHomeRadio
+{
+public:
+    GatewayRadio() : received(0), length(0), ackLength(0), downlinkLength(0), reading(NULL), readLength(0), readIndex(0) {}
+    void setDownlink(LoRaHomeFrame &frame) { this->downlinkLength = frame.serialize(this->downlink); }
+    bool begin(long) { return true; }
+    void setSpreadingFactor(int) {}
+    void setSignalBandwidth(long) {}
+    void setCodingRate4(int) {}
+    void setSyncWord(int) {}
+    void setPreambleLength(long) {}
+    void setTxPower(int) {}
+    void setFrf(uint32_t) {}
+    void enableCrc() {}
+    void enableInvertIQ() {}
+    void disableInvertIQ() {}
+    void idle() {}
+    void sleep() {}
+    void receive() {}
+    void beginPacket() { this->length = 0; }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        for (size_t i = 0; (i < size) && (this->length < LH_FRAME_MAX_SIZE); i++)
+        {
+            this->packet[this->length++] = buffer[i];
+        }
+        return size;
+    }
+    void endPacket()
+    {
+        LoRaHomeFrame frame;
+        if (!frame.createFromRxMessage(this->packet, this->length, true) ||
+            (frame.messageType != LH_MSG_TYPE_NODE_MSG_ACK_REQ))
+        {
+            return;
+        }
+        this->received = frame.payloadSize;
+        LoRaHomeFrame ack(MY_NETWORK_ID, LH_NODE_ID_GATEWAY, frame.nodeIdEmitter, LH_MSG_TYPE_GW_ACK, frame.counter);
+        this->ackLength = ack.serialize(this->ack);
+    }
+    bool retransmit() { return false; }
+    // the pending ACK is received once
+    int parsePacket()
+    {
+        this->reading = (this->ackLength > 0) ? this->ack : this->downlink;
+        this->readLength = (this->ackLength > 0) ? this->ackLength : this->downlinkLength;
+        this->readIndex = 0;
+        this->ackLength = 0;
+        return this->readLength;
+    }
+    int read()
+    {
+        return (this->readIndex < this->readLength) ? this->reading[this->readIndex++] : -1;
+    }
+    size_t read(uint8_t *buffer, size_t length)
+    {
+        size_t n = 0;
+        while ((n < length) && (this->readIndex < this->readLength))
+        {
+            buffer[n++] = this->reading[this->readIndex++];
+        }
+        return n;
+    }
+    void onReceive(void (*)(int)) {}
+    void channelActivityDetection() {}
+    int channelActivityResult() { return 0; }
+    void onCadDone(void (*)(bool)) {}
+    int packetRssi() { return -60; }
+    float packetSnr() { return 5.0; }
+    uint8_t random() { return 0x5A; }
+
+    // payload size of the last uplink acknowledged
+    uint8_t received;
+
+private:
+    uint8_t packet[LH_FRAME_MAX_SIZE];
+    uint8_t length;
+    uint8_t ack[LH_FRAME_MAX_SIZE];
+    uint8_t ackLength;
+    uint8_t downlink[LH_FRAME_MAX_SIZE];
+    uint8_t downlinkLength;
+    const uint8_t *reading;
+    uint8_t readLength;
+    uint8_t readIndex;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <unity.h>
+#include <LoRaHomeFrame.h>
+#include <LoRaHomeNode.h>
+#include <LoRaHomeRadio.h>
+#include <LoRaNode.h>
+#include <NodeConfig.h>
+#include "../../lh_test.h"
+
+// Host benchmark of the hot paths of the node: pio test -e native -v
+// Each result is printed as a line:
+//   bench,<name>,<payload bytes>,<ns per call>
+// e.g. pio test -e native -v | grep ^bench, > bench.csv, to compare successive versions of the code.
+// Host timings depend on the host and its load: they only rank the changes, nothing fails on them.
+// Cycle budgets are checked on the ATmega328P by test/embedded/test_frame_cycles, latencies measured by LH_PROFILER.
+
+const unsigned long BENCH_ITERATIONS = 20000;
+const unsigned long BENCH_CYCLES = 2000;
+// largest payload of a single frame, the string terminator excluded
+const uint8_t BENCH_PAYLOAD_SIZES[] = {0, 16, 32, 64, 96, LH_FRAME_MAX_PAYLOAD_SIZE - 1};
+const uint8_t BENCH_JSON_FIELDS[] = {1, 2, 4, 8};
+const char *const BENCH_JSON_KEYS[] = {"temp", "hum", "press", "bat", "rssi", "door", "lux", "tx"};
+
+// results used by no one, so that the compiler keeps the calls measured
+volatile uint32_t benchSink;
+
+// result lines go to stdout, next to the output of the test runner
+FileStream benchOut(NULL, stdout);
+
+// gateway of the node, set up again before each test
+GatewayRadio gateway;
+
+/**
+ * @brief print a benchmark result line
+ * 
+ * @param name what is measured
+ * @param payloadSize payload bytes
+ * @param iterations number of calls
+ * @param elapsed time of all the calls, in us
+ */
+static void report(const char *name, uint16_t payloadSize, unsigned long iterations, unsigned long elapsed)
+{
+    unsigned long ns = (unsigned long)((uint64_t)elapsed * 1000 / iterations);
+    printResult(benchOut, "bench", name, payloadSize, ns);
+}
+
+/**
+ * @brief each test starts with a node just set up and a new gateway, whatever the tests run before
+ * 
+ */
+void setUp()
+{
+    gateway = GatewayRadio();
+    loraHomeNode = LoRaHomeNode();
+    loraHomeNode.setRadio(&gateway);
+    loraHomeNode.setup();
+    Node->appSetup();
+}
+
+void tearDown()
+{
+}
+
+void test_frame_serialize()
+{
+    LoRaHomeFrame frame;
+    uint8_t buffer[LH_FRAME_MAX_SIZE];
+    for (uint8_t payloadSize : BENCH_PAYLOAD_SIZES)
+    {
+        fillFrame(frame, LH_NODE_ID_GATEWAY, NODE_ID, LH_MSG_TYPE_GW_MSG_ACK, payloadSize);
+        unsigned long start = micros();
+        for (unsigned long i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            benchSink += frame.serialize(buffer);
+        }
+        report("serialize", payloadSize, BENCH_ITERATIONS, micros() - start);
+        TEST_ASSERT_EQUAL(LH_FRAME_MIN_SIZE + payloadSize, frame.serialize(buffer));
+    }
+}
+
+void test_frame_check_crc()
+{
+    LoRaHomeFrame frame;
+    uint8_t buffer[LH_FRAME_MAX_SIZE];
+    for (uint8_t payloadSize : BENCH_PAYLOAD_SIZES)
+    {
+        fillFrame(frame, LH_NODE_ID_GATEWAY, NODE_ID, LH_MSG_TYPE_GW_MSG_ACK, payloadSize);
+        uint8_t size = frame.serialize(buffer);
+        unsigned long start = micros();
+        for (unsigned long i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            benchSink += frame.checkCRC(buffer, size);
+        }
+        report("check_crc", payloadSize, BENCH_ITERATIONS, micros() - start);
+        TEST_ASSERT_TRUE(frame.checkCRC(buffer, size));
+    }
+}
+
+void test_frame_create_from_rx_message()
+{
+    LoRaHomeFrame frame;
+    LoRaHomeFrame received;
+    uint8_t buffer[LH_FRAME_MAX_SIZE];
+    for (uint8_t payloadSize : BENCH_PAYLOAD_SIZES)
+    {
+        fillFrame(frame, LH_NODE_ID_GATEWAY, NODE_ID, LH_MSG_TYPE_GW_MSG_ACK, payloadSize);
+        uint8_t size = frame.serialize(buffer);
+        unsigned long start = micros();
+        for (unsigned long i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            benchSink += received.createFromRxMessage(buffer, size, true);
+        }
+        report("create_from_rx_message", payloadSize, BENCH_ITERATIONS, micros() - start);
+        TEST_ASSERT_TRUE(received.createFromRxMessage(buffer, size, true));
+        TEST_ASSERT_EQUAL(payloadSize, received.payloadSize);
+    }
+}
+
+void test_json_build_parse()
+{
+    // sized for the 16 bytes slots of a 64 bits host, 8 bytes on the ATmega328P
+    StaticJsonDocument<4 * LH_FRAME_MAX_PAYLOAD_SIZE> jsonDoc;
+    char text[LH_FRAME_MAX_PAYLOAD_SIZE];
+    for (uint8_t fields : BENCH_JSON_FIELDS)
+    {
+        size_t size = 0;
+        unsigned long start = micros();
+        for (unsigned long i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            jsonDoc.clear();
+            for (uint8_t field = 0; field < fields; field++)
+            {
+                jsonDoc[BENCH_JSON_KEYS[field]] = (long)(i + field * 1013);
+            }
+            size = serializeJson(jsonDoc, text, sizeof(text));
+            benchSink += size;
+        }
+        report("json_build", size, BENCH_ITERATIONS, micros() - start);
+        TEST_ASSERT_TRUE(size > 0);
+        start = micros();
+        for (unsigned long i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            benchSink += (uint32_t)deserializeJson(jsonDoc, text, size).code();
+        }
+        report("json_parse", size, BENCH_ITERATIONS, micros() - start);
+        TEST_ASSERT_FALSE(deserializeJson(jsonDoc, text, size));
+    }
+}
+
+void test_send_ack_cycle()
+{
+    LoRaHomeStats &stats = loraHomeNode.getStats();
+    // a missing ACK would cost ACK_TIMEOUT per retry: check the first cycle before timing the others
+    loraHomeNode.sendToGateway();
+    TEST_ASSERT_EQUAL(0, stats.getCounter(LH_STAT_TX_LOST));
+    uint16_t rxFrames = stats.getCounter(LH_STAT_RX_FRAMES);
+    unsigned long start = micros();
+    for (unsigned long i = 0; i < BENCH_CYCLES; i++)
+    {
+        loraHomeNode.sendToGateway();
+    }
+    report("send_ack_cycle", gateway.received, BENCH_CYCLES, micros() - start);
+    TEST_ASSERT_EQUAL(0, stats.getCounter(LH_STAT_TX_LOST));
+    TEST_ASSERT_EQUAL(rxFrames + BENCH_CYCLES, stats.getCounter(LH_STAT_RX_FRAMES));
+}
+
+void test_receive_downlink()
+{
+    LoRaHomeFrame downlink(MY_NETWORK_ID, LH_NODE_ID_GATEWAY, NODE_ID, LH_MSG_TYPE_GW_MSG_ACK, 1);
+    strcpy(downlink.jsonPayload, "{\"msg\":\"benchmark downlink\"}");
+    downlink.payloadSize = strlen(downlink.jsonPayload);
+    gateway.setDownlink(downlink);
+    LoRaHomeStats &stats = loraHomeNode.getStats();
+    uint16_t rxFrames = stats.getCounter(LH_STAT_RX_FRAMES);
+    uint16_t txFrames = stats.getCounter(LH_STAT_TX_FRAMES);
+    // received, acknowledged, then given to the application
+    unsigned long start = micros();
+    for (unsigned long i = 0; i < BENCH_CYCLES; i++)
+    {
+        loraHomeNode.receiveLoraMessage();
+    }
+    report("receive_downlink", downlink.payloadSize, BENCH_CYCLES, micros() - start);
+    TEST_ASSERT_EQUAL(rxFrames + BENCH_CYCLES, stats.getCounter(LH_STAT_RX_FRAMES));
+    TEST_ASSERT_EQUAL(txFrames + BENCH_CYCLES, stats.getCounter(LH_STAT_TX_FRAMES));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_serialize);
+    RUN_TEST(test_frame_check_crc);
+    RUN_TEST(test_frame_create_from_rx_message);
+    RUN_TEST(test_json_build_parse);
+    RUN_TEST(test_send_ack_cycle);
+    RUN_TEST(test_receive_downlink);
+    return UNITY_END();
+}
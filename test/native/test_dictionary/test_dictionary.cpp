@@ -0,0 +1,190 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LoRaHomeDictionary.h>
+#include <LoRaHomeFrame.h>
+#include "../../lh_test.h"
+
+// Round trip of representative JSON payloads through the key tokenizer and expand(): pio test -e native -v
+// The native environment builds with -D LH_DICTIONARY: the module is compiled out otherwise.
+// Each result is printed as a line:
+//   ratio,<document>,<JSON bytes>,<tokenized bytes in % of the JSON text>
+//   bench,tokenize|expand,<JSON bytes>,<ns per call>
+
+#ifdef LH_DICTIONARY
+
+const unsigned long DICTIONARY_ITERATIONS = 20000;
+// window sizes of the fragment test, terminator included
+const size_t DICTIONARY_WINDOW_MIN = 5;
+const size_t DICTIONARY_WINDOW_MAX = 40;
+
+/**
+ * @brief JSON payload as written by serializeJson
+ */
+struct DictionaryDocument
+{
+    const char *name;
+    const char *json;
+};
+
+const DictionaryDocument DICTIONARY_DOCUMENTS[] = {
+    {"counter", "{\"tx\":12}"},
+    {"weather", "{\"temperature\":21.5,\"humidity\":48,\"pressure\":1013.2,\"battery\":3.02,\"rssi\":-87}"},
+    {"relay", "{\"state\":\"ON\",\"relay\":1,\"switch\":0}"},
+    {"downlink", "{\"msg\":\"temperature, \\\"rssi\\\":1\",\"diag\":\"stats\"}"},
+    {"unknown_keys", "{\"door\":1,\"lux\":250,\"value\":7}"},
+    {"nested", "{\"value\":{\"tx\":1,\"state\":[1,2]},\"msg\":\"\"}"},
+};
+
+// results used by no one, so that the compiler keeps the calls measured
+volatile uint32_t dictionarySink;
+
+// result lines go to stdout, next to the output of the test runner
+FileStream dictionaryOut(NULL, stdout);
+
+/**
+ * @brief tokenize a JSON text as serializeJson does, character by character
+ *
+ * @param json the JSON text
+ * @param buffer where to write the tokenized JSON, at least LH_FRAME_MAX_PAYLOAD_SIZE bytes
+ * @return size_t number of bytes of the tokenized JSON
+ */
+static size_t tokenize(const char *json, char *buffer)
+{
+    LoRaHomeDictionary tokenizer(buffer, LH_FRAME_MAX_PAYLOAD_SIZE);
+    tokenizer.print(json);
+    return tokenizer.end();
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_round_trip()
+{
+    char tokenized[LH_FRAME_MAX_PAYLOAD_SIZE];
+    char expanded[LH_DICTIONARY_EXPANDED_SIZE];
+    for (const DictionaryDocument &document : DICTIONARY_DOCUMENTS)
+    {
+        size_t jsonSize = strlen(document.json);
+        size_t size = tokenize(document.json, tokenized);
+        TEST_ASSERT_TRUE(size <= jsonSize);
+        size_t expandedSize = 0;
+        TEST_ASSERT_EQUAL(LH_EXPAND_OK, LoRaHomeDictionary::expand(tokenized, size, expanded, sizeof(expanded), expandedSize));
+        TEST_ASSERT_EQUAL(jsonSize, expandedSize);
+        TEST_ASSERT_EQUAL_STRING(document.json, expanded);
+        printResult(dictionaryOut, "ratio", document.name, jsonSize, size * 100 / jsonSize);
+    }
+}
+
+void test_keys_in_strings()
+{
+    char tokenized[LH_FRAME_MAX_PAYLOAD_SIZE];
+    // keys of the dictionary in values stay text
+    size_t size = tokenize("{\"msg\":\"tx\"}", tokenized);
+    TEST_ASSERT_EQUAL(7, size);
+    TEST_ASSERT_EQUAL_UINT8(LH_DICTIONARY_TOKEN + 1, (uint8_t)tokenized[1]);
+    TEST_ASSERT_EQUAL_STRING("\"tx\"}", &tokenized[2]);
+}
+
+void test_unknown_token()
+{
+    const char tokenized[] = {'{', (char)0xFE, '1', '}'};
+    char expanded[LH_DICTIONARY_EXPANDED_SIZE];
+    size_t size = 0;
+    TEST_ASSERT_EQUAL(LH_EXPAND_UNKNOWN_TOKEN,
+                      LoRaHomeDictionary::expand(tokenized, sizeof(tokenized), expanded, sizeof(expanded), size));
+}
+
+void test_overflow()
+{
+    // a full frame of "temperature" tokens: 3 bytes each, 16 bytes each once expanded
+    char tokenized[LH_FRAME_MAX_PAYLOAD_SIZE];
+    uint8_t size = 0;
+    tokenized[size++] = '{';
+    while (size + 4 < LH_FRAME_MAX_PAYLOAD_SIZE - 1)
+    {
+        tokenized[size++] = (char)(LH_DICTIONARY_TOKEN + 7);
+        tokenized[size++] = '1';
+        tokenized[size++] = ',';
+    }
+    tokenized[size - 1] = '}';
+    char expanded[LH_DICTIONARY_EXPANDED_SIZE];
+    size_t expandedSize = 0;
+    TEST_ASSERT_EQUAL(LH_EXPAND_OVERFLOW,
+                      LoRaHomeDictionary::expand(tokenized, size, expanded, sizeof(expanded), expandedSize));
+}
+
+void test_windows()
+{
+    // fragments are tokenized one window at a time, from an offset: the windows shall rebuild the whole text
+    char tokenized[LH_FRAME_MAX_PAYLOAD_SIZE];
+    char window[LH_FRAME_MAX_PAYLOAD_SIZE];
+    char rebuilt[LH_FRAME_MAX_PAYLOAD_SIZE];
+    for (const DictionaryDocument &document : DICTIONARY_DOCUMENTS)
+    {
+        size_t size = tokenize(document.json, tokenized);
+        for (size_t capacity = DICTIONARY_WINDOW_MIN; capacity <= DICTIONARY_WINDOW_MAX; capacity++)
+        {
+            size_t length = 0;
+            while (length < size)
+            {
+                LoRaHomeDictionary tokenizer(window, capacity, length);
+                tokenizer.print(document.json);
+                size_t part = tokenizer.end();
+                TEST_ASSERT_TRUE((part > 0) && (part <= capacity - 1));
+                memcpy(&rebuilt[length], window, part);
+                length += part;
+            }
+            TEST_ASSERT_EQUAL(size, length);
+            TEST_ASSERT_EQUAL_MEMORY(tokenized, rebuilt, size);
+        }
+    }
+}
+
+void test_benchmark()
+{
+    char tokenized[LH_FRAME_MAX_PAYLOAD_SIZE];
+    char expanded[LH_DICTIONARY_EXPANDED_SIZE];
+    for (const DictionaryDocument &document : DICTIONARY_DOCUMENTS)
+    {
+        size_t jsonSize = strlen(document.json);
+        size_t size = 0;
+        unsigned long start = micros();
+        for (unsigned long i = 0; i < DICTIONARY_ITERATIONS; i++)
+        {
+            size = tokenize(document.json, tokenized);
+            dictionarySink += size;
+        }
+        printResult(dictionaryOut, "bench", "tokenize", jsonSize,
+                    (unsigned long)((uint64_t)(micros() - start) * 1000 / DICTIONARY_ITERATIONS));
+        size_t expandedSize = 0;
+        start = micros();
+        for (unsigned long i = 0; i < DICTIONARY_ITERATIONS; i++)
+        {
+            dictionarySink += LoRaHomeDictionary::expand(tokenized, size, expanded, sizeof(expanded), expandedSize);
+        }
+        printResult(dictionaryOut, "bench", "expand", jsonSize,
+                    (unsigned long)((uint64_t)(micros() - start) * 1000 / DICTIONARY_ITERATIONS));
+        TEST_ASSERT_EQUAL(jsonSize, expandedSize);
+    }
+}
+
+#endif
+
+int main()
+{
+    UNITY_BEGIN();
+#ifdef LH_DICTIONARY
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_keys_in_strings);
+    RUN_TEST(test_unknown_token);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_windows);
+    RUN_TEST(test_benchmark);
+#endif
+    return UNITY_END();
+}
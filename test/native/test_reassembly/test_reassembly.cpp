@@ -0,0 +1,186 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LoRaHomeFrame.h>
+#include <LoRaHomeReassembly.h>
+#include <NodeConfig.h>
+
+// Reassembly of fragmented uplinks as the gateway receives them, lost, reordered or repeated: pio test -e native -v
+// The native environment builds with -D LH_MAX_FRAGMENTS=4: fragmentation is compiled out with 1.
+
+#if LH_MAX_FRAGMENTS > 1
+
+const uint8_t REASSEMBLY_FRAGMENTS = 3;
+// last fragment not full: the length of the message is only known once it is received
+const uint16_t REASSEMBLY_LENGTH = (REASSEMBLY_FRAGMENTS - 1) * LH_FRAGMENT_PAYLOAD_SIZE + 17;
+// the counters of the fragments wrap: 0xFFFE, 0xFFFF, 0
+const uint16_t REASSEMBLY_FIRST_COUNTER = 0xFFFE;
+// first counter of the next message
+const uint16_t REASSEMBLY_NEXT_COUNTER = (uint16_t)(REASSEMBLY_FIRST_COUNTER + REASSEMBLY_FRAGMENTS);
+
+char message[REASSEMBLY_LENGTH + 1];
+
+/**
+ * @brief fragment of a message as received by the gateway: serialized by the node, then parsed with its CRC
+ *
+ * @param frame the received frame
+ * @param text the message
+ * @param length message bytes
+ * @param firstCounter counter of fragment 0, fragment i is sent with firstCounter + i
+ * @param index fragment index
+ * @param count number of fragments of the message
+ * @param nodeId emitter
+ */
+static void receiveFragment(LoRaHomeFrame &frame, const char *text, uint16_t length, uint16_t firstCounter, uint8_t index,
+                            uint8_t count, uint8_t nodeId = NODE_ID)
+{
+    LoRaHomeFrame sent(MY_NETWORK_ID, nodeId, LH_NODE_ID_GATEWAY, LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ, firstCounter + index);
+    uint16_t start = index * LH_FRAGMENT_PAYLOAD_SIZE;
+    sent.payloadSize = min((uint16_t)LH_FRAGMENT_PAYLOAD_SIZE, (uint16_t)(length - start));
+    memcpy(sent.jsonPayload, &text[start], sent.payloadSize);
+    sent.setFragment(index, count);
+    uint8_t packet[LH_FRAME_MAX_SIZE];
+    uint8_t size = sent.serialize(packet);
+    frame = LoRaHomeFrame();
+    TEST_ASSERT_TRUE(frame.createFromRxMessage(packet, size, true));
+    TEST_ASSERT_TRUE(frame.isFragment());
+}
+
+/**
+ * @brief receive the fragments of the message in the given order, -1 ending the list
+ *
+ * @param reassembly the reassembly of the gateway
+ * @param order fragment indexes, as received
+ * @param bitmaps expected bitmap after each fragment
+ * @return true if the last fragment completed the message
+ */
+static bool receiveInOrder(LoRaHomeReassembly &reassembly, const int8_t *order, const uint16_t *bitmaps)
+{
+    bool complete = false;
+    for (uint8_t i = 0; order[i] >= 0; i++)
+    {
+        LoRaHomeFrame frame;
+        receiveFragment(frame, message, REASSEMBLY_LENGTH, REASSEMBLY_FIRST_COUNTER, order[i], REASSEMBLY_FRAGMENTS);
+        complete = reassembly.addFragment(frame);
+        TEST_ASSERT_EQUAL_HEX16(bitmaps[i], reassembly.getBitmap());
+        TEST_ASSERT_EQUAL(complete, reassembly.isComplete());
+        // the fragment ACK carries the counter of fragment 0, whichever fragment came first
+        TEST_ASSERT_EQUAL_UINT16(REASSEMBLY_FIRST_COUNTER, reassembly.getFirstCounter());
+    }
+    return complete;
+}
+
+/**
+ * @brief the message is rebuilt as sent
+ *
+ * @param reassembly the reassembly of the gateway
+ */
+static void assertMessage(LoRaHomeReassembly &reassembly)
+{
+    TEST_ASSERT_TRUE(reassembly.isComplete());
+    TEST_ASSERT_EQUAL(NODE_ID, reassembly.getNodeIdEmitter());
+    TEST_ASSERT_EQUAL(REASSEMBLY_LENGTH, reassembly.getLength());
+    TEST_ASSERT_EQUAL_STRING(message, reassembly.getMessage());
+}
+
+void setUp()
+{
+    for (uint16_t i = 0; i < REASSEMBLY_LENGTH; i++)
+    {
+        message[i] = 'a' + (i % 26);
+    }
+    message[REASSEMBLY_LENGTH] = '\0';
+}
+
+void tearDown()
+{
+}
+
+void test_in_order()
+{
+    LoRaHomeReassembly reassembly;
+    const int8_t order[] = {0, 1, 2, -1};
+    const uint16_t bitmaps[] = {0x1, 0x3, 0x7};
+    TEST_ASSERT_TRUE(receiveInOrder(reassembly, order, bitmaps));
+    assertMessage(reassembly);
+}
+
+void test_reordered()
+{
+    LoRaHomeReassembly reassembly;
+    const int8_t order[] = {2, 0, 1, -1};
+    const uint16_t bitmaps[] = {0x4, 0x5, 0x7};
+    TEST_ASSERT_TRUE(receiveInOrder(reassembly, order, bitmaps));
+    assertMessage(reassembly);
+}
+
+void test_dropped()
+{
+    LoRaHomeReassembly reassembly;
+    // fragment 1 lost: the fragment ACK asks for it only, the node resends it
+    const int8_t order[] = {0, 2, -1};
+    const uint16_t bitmaps[] = {0x1, 0x5};
+    TEST_ASSERT_FALSE(receiveInOrder(reassembly, order, bitmaps));
+    TEST_ASSERT_EQUAL(REASSEMBLY_LENGTH, reassembly.getLength());
+    const int8_t resent[] = {1, -1};
+    const uint16_t completed[] = {0x7};
+    TEST_ASSERT_TRUE(receiveInOrder(reassembly, resent, completed));
+    assertMessage(reassembly);
+}
+
+void test_duplicates()
+{
+    LoRaHomeReassembly reassembly;
+    // fragments repeated, e.g. resent after a lost fragment ACK: the bitmap and the message do not change
+    const int8_t order[] = {0, 0, 2, 2, 1, 1, -1};
+    const uint16_t bitmaps[] = {0x1, 0x1, 0x5, 0x5, 0x7, 0x7};
+    TEST_ASSERT_TRUE(receiveInOrder(reassembly, order, bitmaps));
+    assertMessage(reassembly);
+}
+
+void test_new_message()
+{
+    LoRaHomeReassembly reassembly;
+    const int8_t order[] = {0, 1, -1};
+    const uint16_t bitmaps[] = {0x1, 0x3};
+    TEST_ASSERT_FALSE(receiveInOrder(reassembly, order, bitmaps));
+    // a fragment of the next message, or of another node, restarts the reassembly
+    LoRaHomeFrame frame;
+    receiveFragment(frame, message, REASSEMBLY_LENGTH, REASSEMBLY_NEXT_COUNTER, 1, REASSEMBLY_FRAGMENTS);
+    TEST_ASSERT_FALSE(reassembly.addFragment(frame));
+    TEST_ASSERT_EQUAL_HEX16(0x2, reassembly.getBitmap());
+    TEST_ASSERT_EQUAL_UINT16(REASSEMBLY_NEXT_COUNTER, reassembly.getFirstCounter());
+    receiveFragment(frame, message, REASSEMBLY_LENGTH, REASSEMBLY_NEXT_COUNTER, 1, REASSEMBLY_FRAGMENTS, NODE_ID + 1);
+    TEST_ASSERT_FALSE(reassembly.addFragment(frame));
+    TEST_ASSERT_EQUAL_HEX16(0x2, reassembly.getBitmap());
+    TEST_ASSERT_EQUAL(NODE_ID + 1, reassembly.getNodeIdEmitter());
+}
+
+void test_invalid()
+{
+    LoRaHomeReassembly reassembly;
+    LoRaHomeFrame frame;
+    // more fragments than the buffer holds
+    receiveFragment(frame, message, REASSEMBLY_LENGTH, REASSEMBLY_FIRST_COUNTER, 0, LH_MAX_FRAGMENTS + 1);
+    TEST_ASSERT_FALSE(reassembly.addFragment(frame));
+    // a fragment before the last one shall be full
+    receiveFragment(frame, message, LH_FRAGMENT_PAYLOAD_SIZE - 1, REASSEMBLY_FIRST_COUNTER, 0, REASSEMBLY_FRAGMENTS);
+    TEST_ASSERT_FALSE(reassembly.addFragment(frame));
+    TEST_ASSERT_EQUAL_HEX16(0, reassembly.getBitmap());
+    TEST_ASSERT_FALSE(reassembly.isComplete());
+}
+
+#endif
+
+int main()
+{
+    UNITY_BEGIN();
+#if LH_MAX_FRAGMENTS > 1
+    RUN_TEST(test_in_order);
+    RUN_TEST(test_reordered);
+    RUN_TEST(test_dropped);
+    RUN_TEST(test_duplicates);
+    RUN_TEST(test_new_message);
+    RUN_TEST(test_invalid);
+#endif
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LoRaNodeScheduler.h>
+
+// Periodic tasks, jitter and deadline of LoRaNodeScheduler: pio test -e native -v
+// The host millis() is the monotonic clock: the checks leave a few ms to the load of the host.
+
+const unsigned long SCHEDULER_TOLERANCE = 5;
+
+uint8_t runsA;
+uint8_t runsB;
+
+void taskA()
+{
+    runsA++;
+}
+
+void taskB()
+{
+    runsB++;
+}
+
+/**
+ * @brief run the tasks during a time, as the main loop does
+ *
+ * @param scheduler the scheduler
+ * @param duration in ms
+ */
+static void runFor(LoRaNodeScheduler &scheduler, unsigned long duration)
+{
+    unsigned long start = millis();
+    while (millis() - start < duration)
+    {
+        scheduler.run();
+    }
+}
+
+void setUp()
+{
+    runsA = 0;
+    runsB = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_no_task()
+{
+    LoRaNodeScheduler scheduler;
+    TEST_ASSERT_EQUAL_UINT32((unsigned long)-1, scheduler.getTimeToNextDeadline());
+    scheduler.run();
+    scheduler.dump(Serial);
+}
+
+void test_periodic()
+{
+    LoRaNodeScheduler scheduler;
+    uint8_t idA = scheduler.addPeriodicTask(taskA, 20);
+    uint8_t idB = scheduler.addPeriodicTask(taskB, 50, 50);
+    TEST_ASSERT_NOT_EQUAL(LH_TASK_NONE, idA);
+    TEST_ASSERT_NOT_EQUAL(idA, idB);
+    // A is due at once, B after its first delay
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getTimeToNextDeadline());
+    scheduler.run();
+    TEST_ASSERT_EQUAL(1, runsA);
+    TEST_ASSERT_EQUAL(0, runsB);
+    unsigned long left = scheduler.getTimeToNextDeadline();
+    TEST_ASSERT_TRUE((left > 20 - SCHEDULER_TOLERANCE) && (left <= 20));
+    // 0, 20, ..., 200 ms: the deadlines do not drift with the calls to run()
+    runFor(scheduler, 210);
+    TEST_ASSERT_EQUAL(11, runsA);
+    TEST_ASSERT_EQUAL(4, runsB);
+}
+
+void test_table_full()
+{
+    LoRaNodeScheduler scheduler;
+    for (uint8_t i = 0; i < LH_MAX_TASKS; i++)
+    {
+        TEST_ASSERT_EQUAL(i, scheduler.addPeriodicTask(taskA, 1000, 1000));
+    }
+    TEST_ASSERT_EQUAL(LH_TASK_NONE, scheduler.addPeriodicTask(taskB, 1000));
+}
+
+void test_jitter()
+{
+    LoRaNodeScheduler scheduler;
+    uint8_t id = scheduler.addPeriodicTask(taskA, 100, 10);
+    // run 30 ms after the deadline
+    delay(40);
+    scheduler.run();
+    TEST_ASSERT_EQUAL(1, runsA);
+    unsigned long jitter = scheduler.getMaxJitter(id);
+    TEST_ASSERT_TRUE((jitter >= 30) && (jitter < 30 + SCHEDULER_TOLERANCE));
+    // less than one period late: the next deadline stays on the grid, 70 ms ahead
+    unsigned long left = scheduler.getTimeToNextDeadline();
+    TEST_ASSERT_TRUE((left > 70 - SCHEDULER_TOLERANCE) && (left <= 70));
+    scheduler.resetJitter();
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getMaxJitter(id));
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getMaxJitter(LH_TASK_NONE));
+    scheduler.dump(Serial);
+}
+
+void test_trigger_and_period()
+{
+    LoRaNodeScheduler scheduler;
+    uint8_t id = scheduler.addPeriodicTask(taskA, 1000, 1000);
+    scheduler.run();
+    TEST_ASSERT_EQUAL(0, runsA);
+    // triggered: run at once, the period restarts from now
+    scheduler.triggerTask(id);
+    TEST_ASSERT_EQUAL_UINT32(0, scheduler.getTimeToNextDeadline());
+    scheduler.run();
+    TEST_ASSERT_EQUAL(1, runsA);
+    scheduler.setTaskPeriod(id, 30);
+    // the new period is effective after the next run, 1000 ms ahead
+    TEST_ASSERT_TRUE(scheduler.getTimeToNextDeadline() > 1000 - SCHEDULER_TOLERANCE);
+    scheduler.triggerTask(id);
+    scheduler.run();
+    TEST_ASSERT_EQUAL(2, runsA);
+    unsigned long left = scheduler.getTimeToNextDeadline();
+    TEST_ASSERT_TRUE((left > 30 - SCHEDULER_TOLERANCE) && (left <= 30));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_no_task);
+    RUN_TEST(test_periodic);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_jitter);
+    RUN_TEST(test_trigger_and_period);
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <unity.h>
+#include <LoRaHomeStorage.h>
+
+// State records of LoRaHomeStorage in the EEPROM shim: pio test -e native -v
+// The native environment builds with -D LH_STORAGE: the module is compiled out otherwise.
+
+#ifdef LH_STORAGE
+
+/**
+ * @brief state with the given counter limit and link settings
+ */
+static LoRaHomeState makeState(uint16_t counterLimit, uint8_t spreadingFactor, int8_t txPower)
+{
+    LoRaHomeState state;
+    state.counterLimit = counterLimit;
+    state.spreadingFactor = spreadingFactor;
+    state.txPower = txPower;
+    state.rxCounter = 0;
+    state.rxCounterValid = false;
+    return state;
+}
+
+/**
+ * @brief each test starts with a blank EEPROM, as a new ATmega328P
+ *
+ */
+void setUp()
+{
+    for (uint16_t address = 0; address < EEPROM.length(); address++)
+    {
+        EEPROM.write(address, 0xFF);
+    }
+}
+
+void tearDown()
+{
+}
+
+void test_blank()
+{
+    LoRaHomeStorage storage;
+    LoRaHomeState state = makeState(0, 7, 14);
+    TEST_ASSERT_FALSE(storage.load(state));
+}
+
+void test_save_load_wrap()
+{
+    LoRaHomeStorage storage;
+    // 3 turns of the ring, the sequence number wrapping too
+    for (uint16_t i = 1; i <= 3 * LH_STORAGE_SLOTS; i++)
+    {
+        storage.save(makeState(i * LH_STORAGE_COUNTER_BLOCK, 7 + (i % 6), 2 + (i % 18)));
+    }
+    LoRaHomeStorage restored;
+    LoRaHomeState state = makeState(0, 0, 0);
+    TEST_ASSERT_TRUE(restored.load(state));
+    uint16_t last = 3 * LH_STORAGE_SLOTS;
+    TEST_ASSERT_EQUAL(last * LH_STORAGE_COUNTER_BLOCK, state.counterLimit);
+    TEST_ASSERT_EQUAL(7 + (last % 6), state.spreadingFactor);
+    TEST_ASSERT_EQUAL(2 + (last % 18), state.txPower);
+}
+
+void test_torn_write()
+{
+    LoRaHomeStorage storage;
+    for (uint16_t i = 1; i <= LH_STORAGE_SLOTS + 3; i++)
+    {
+        storage.save(makeState(i * LH_STORAGE_COUNTER_BLOCK, 9, 14));
+    }
+    // the next save overwrites slot 3, a valid older record: a reset before its last byte leaves the old sequence
+    int address = LH_STORAGE_ADDRESS + 3 * LH_STORAGE_RECORD_SIZE;
+    uint8_t oldSequence = EEPROM.read(address);
+    storage.save(makeState(1000 * LH_STORAGE_COUNTER_BLOCK, 12, 20));
+    EEPROM.write(address, oldSequence);
+    LoRaHomeStorage restored;
+    LoRaHomeState state = makeState(0, 0, 0);
+    TEST_ASSERT_TRUE(restored.load(state));
+    TEST_ASSERT_EQUAL((LH_STORAGE_SLOTS + 3) * LH_STORAGE_COUNTER_BLOCK, state.counterLimit);
+    TEST_ASSERT_EQUAL(9, state.spreadingFactor);
+    // the next save goes after the last valid record, over the torn one
+    restored.save(makeState(state.counterLimit + LH_STORAGE_COUNTER_BLOCK, 9, 14));
+    TEST_ASSERT_TRUE(restored.load(state));
+    TEST_ASSERT_EQUAL((LH_STORAGE_SLOTS + 4) * LH_STORAGE_COUNTER_BLOCK, state.counterLimit);
+}
+
+void test_largest_counter_limit()
+{
+    LoRaHomeStorage storage;
+    storage.save(makeState(5000, 7, 14));
+    // newest record with a lower limit: its link settings are restored, never its limit
+    storage.save(makeState(128, 10, 17));
+    LoRaHomeStorage restored;
+    LoRaHomeState state = makeState(0, 0, 0);
+    TEST_ASSERT_TRUE(restored.load(state));
+    TEST_ASSERT_EQUAL(5000, state.counterLimit);
+    TEST_ASSERT_EQUAL(10, state.spreadingFactor);
+    TEST_ASSERT_EQUAL(17, state.txPower);
+}
+
+void test_largest_counter_limit_wrap()
+{
+    LoRaHomeStorage storage;
+    // the limit wraps at 65536: 64 is past 65472
+    storage.save(makeState(65472, 7, 14));
+    storage.save(makeState(64, 7, 14));
+    storage.save(makeState(65408, 7, 14));
+    LoRaHomeStorage restored;
+    LoRaHomeState state = makeState(0, 0, 0);
+    TEST_ASSERT_TRUE(restored.load(state));
+    TEST_ASSERT_EQUAL(64, state.counterLimit);
+}
+
+void test_rx_counter()
+{
+    LoRaHomeStorage storage;
+    LoRaHomeState state = makeState(64, 7, 14);
+    storage.save(state);
+    LoRaHomeStorage restored;
+    TEST_ASSERT_TRUE(restored.load(state));
+    TEST_ASSERT_FALSE(state.rxCounterValid);
+    // the last authenticated downlink survives a reset, a lower counter of a newer record never wins
+    state.rxCounter = 1000;
+    state.rxCounterValid = true;
+    storage.save(state);
+    state.rxCounter = 900;
+    storage.save(state);
+    state.rxCounterValid = false;
+    storage.save(state);
+    TEST_ASSERT_TRUE(restored.load(state));
+    TEST_ASSERT_TRUE(state.rxCounterValid);
+    TEST_ASSERT_EQUAL(1000, state.rxCounter);
+}
+
+#endif
+
+int main()
+{
+    UNITY_BEGIN();
+#ifdef LH_STORAGE
+    RUN_TEST(test_blank);
+    RUN_TEST(test_save_load_wrap);
+    RUN_TEST(test_torn_write);
+    RUN_TEST(test_largest_counter_limit);
+    RUN_TEST(test_largest_counter_limit_wrap);
+    RUN_TEST(test_rx_counter);
+#endif
+    return UNITY_END();
+}
@@ -0,0 +1,316 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include <time.h>
+
+FileStream Serial(NULL, stderr);
+SPIClass SPI;
+EEPROMClass EEPROM;
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while ((n < size) && (this->write(buffer[n]) == 1))
+    {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::write(const char *text)
+{
+    return this->write((const uint8_t *)text, strlen(text));
+}
+
+int Print::availableForWrite()
+{
+    return 0;
+}
+
+size_t Print::print(const char *text)
+{
+    return this->write(text);
+}
+
+size_t Print::print(const __FlashStringHelper *text)
+{
+    return this->write(reinterpret_cast<const char *>(text));
+}
+
+size_t Print::print(char c)
+{
+    return this->write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return this->printNumber(value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+    return this->print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return this->printNumber(value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+    if ((value < 0) && (base == DEC))
+    {
+        return this->print('-') + this->printNumber(-(unsigned long)value, base);
+    }
+    return this->printNumber((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return this->printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return this->write(text);
+}
+
+size_t Print::println()
+{
+    return this->write("\r\n");
+}
+
+/**
+ * @brief print an unsigned number in base 2 to 16, as the Arduino core does
+ * 
+ */
+size_t Print::printNumber(unsigned long value, int base)
+{
+    char text[8 * sizeof(long) + 1];
+    char *p = &text[sizeof(text) - 1];
+    *p = '\0';
+    if (base < 2)
+    {
+        base = DEC;
+    }
+    do
+    {
+        uint8_t digit = value % base;
+        value /= base;
+        *--p = (digit < 10) ? ('0' + digit) : ('A' + digit - 10);
+    } while (value > 0);
+    return this->write(p);
+}
+
+/**
+ * @brief Construct a new FileStream object
+ * 
+ * @param in file read, NULL for none
+ * @param out file written, NULL for none
+ */
+FileStream::FileStream(FILE *in, FILE *out)
+{
+    this->in = in;
+    this->out = out;
+}
+
+/**
+ * @brief 1 while the file has bytes left: a file is never waited for
+ * 
+ */
+int FileStream::available()
+{
+    return (this->peek() >= 0) ? 1 : 0;
+}
+
+int FileStream::read()
+{
+    if (this->in == NULL)
+    {
+        return -1;
+    }
+    int c = fgetc(this->in);
+    return (c == EOF) ? -1 : c;
+}
+
+int FileStream::peek()
+{
+    int c = this->read();
+    if (c >= 0)
+    {
+        ungetc(c, this->in);
+    }
+    return c;
+}
+
+void FileStream::flush()
+{
+    if (this->out != NULL)
+    {
+        fflush(this->out);
+    }
+}
+
+/**
+ * @brief a file never blocks the writer: room for a serial buffer if written, none otherwise
+ * 
+ */
+int FileStream::availableForWrite()
+{
+    return (this->out != NULL) ? 64 : 0;
+}
+
+size_t FileStream::write(uint8_t data)
+{
+    if (this->out == NULL)
+    {
+        return 0;
+    }
+    return (fputc(data, this->out) == EOF) ? 0 : 1;
+}
+
+size_t FileStream::write(const uint8_t *buffer, size_t size)
+{
+    if (this->out == NULL)
+    {
+        return 0;
+    }
+    return fwrite(buffer, 1, size, this->out);
+}
+
+// simulated time in us, used instead of the monotonic clock once set
+static bool simulated = false;
+static uint64_t simulatedTime = 0;
+static void (*delayHook)(uint64_t until) = NULL;
+
+/**
+ * @brief microseconds of the monotonic clock since the first call, or the simulated time
+ * 
+ */
+static uint64_t hostMicros()
+{
+    if (simulated)
+    {
+        return simulatedTime;
+    }
+    static uint64_t start = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    if (start == 0)
+    {
+        start = us;
+    }
+    return us - start;
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(hostMicros() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)hostMicros();
+}
+
+void delay(unsigned long ms)
+{
+    if (delayHook != NULL)
+    {
+        delayHook(simulatedTime + (uint64_t)ms * 1000);
+        return;
+    }
+    struct timespec wait = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+    nanosleep(&wait, NULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (delayHook != NULL)
+    {
+        delayHook(simulatedTime + us);
+        return;
+    }
+    struct timespec wait = {0, (long)us * 1000};
+    nanosleep(&wait, NULL);
+}
+
+/**
+ * @brief set the simulated time: millis() and micros() no longer follow the monotonic clock
+ * 
+ * @param us time in us
+ */
+void setSimulatedTime(uint64_t us)
+{
+    simulated = true;
+    simulatedTime = us;
+}
+
+/**
+ * @brief let the simulated time pass in delay() and delayMicroseconds()
+ * 
+ * @param hook called with the end of the delay in us, NULL to sleep on the monotonic clock again
+ */
+void setDelayHook(void (*hook)(uint64_t until))
+{
+    delayHook = hook;
+}
+
+void yield()
+{
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+int digitalRead(uint8_t)
+{
+    return LOW;
+}
+
+void attachInterrupt(uint8_t, void (*)(void), int)
+{
+}
+
+void detachInterrupt(uint8_t)
+{
+}
+
+/**
+ * @brief pseudo random number in [0, howbig[, seeded by randomSeed() only: runs are reproducible
+ * 
+ */
+long random(long howbig)
+{
+    if (howbig <= 0)
+    {
+        return 0;
+    }
+    return ::random() % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig)
+    {
+        return howsmall;
+    }
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+    if (seed != 0)
+    {
+        srandom(seed);
+    }
+}
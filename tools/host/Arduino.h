@@ -0,0 +1,157 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host (Linux) shim of the Arduino core, used by the native environment of platformio.ini:
+// only what the node and the LoRa library use. No hardware: pins and interrupts are ignored,
+// the time is the monotonic clock of the host, or a simulated time (setSimulatedTime).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// program memory is plain memory on the host
+#define PROGMEM
+#define PGM_P const char *
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define RISING 3
+#define DEC 10
+#define HEX 16
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define B111 7
+#define B1000 8
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? ((value) |= (1UL << (bit))) : ((value) &= ~(1UL << (bit))))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(p) (p)
+
+template <class T>
+T min(T a, T b)
+{
+    return (a < b) ? a : b;
+}
+
+template <class T>
+T max(T a, T b)
+{
+    return (a > b) ? a : b;
+}
+
+/**
+ * @brief Arduino Print: write() to implement, print() / println() of text and numbers
+ */
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *text);
+    virtual int availableForWrite();
+    virtual void flush() {}
+    size_t print(const char *text);
+    size_t print(const __FlashStringHelper *text);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t println();
+    template <class T>
+    size_t println(T value)
+    {
+        size_t n = this->print(value);
+        return n + this->println();
+    }
+    template <class T>
+    size_t println(T value, int format)
+    {
+        size_t n = this->print(value, format);
+        return n + this->println();
+    }
+
+private:
+    size_t printNumber(unsigned long value, int base);
+};
+
+/**
+ * @brief Arduino Stream: Print with read()
+ */
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long) {}
+};
+
+/**
+ * @brief Stream over host files, e.g. a capture file or stdout
+ * Serial reads nothing and writes on stderr: stdout is left to the output of the host programs.
+ */
+class FileStream : public Stream
+{
+public:
+    FileStream(FILE *in, FILE *out);
+    void begin(unsigned long) {}
+    operator bool() { return true; }
+    int available();
+    int read();
+    int peek();
+    void flush();
+    int availableForWrite();
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+
+private:
+    FILE *in;
+    FILE *out;
+};
+
+extern FileStream Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+#define noInterrupts()
+#define interrupts()
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Simulated time, e.g. for the nodes of tools/lh_netsim.py: once set, millis() and micros() return the time given
+// to setSimulatedTime() and delay() lets it pass through the hook, which returns once the time has been set past the end
+void setSimulatedTime(uint64_t us);
+void setDelayHook(void (*hook)(uint64_t until));
+
+#endif
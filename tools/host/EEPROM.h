@@ -0,0 +1,23 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+// Host shim of the Arduino EEPROM library: 1 KB in RAM, erased (0xFF) at start as a new ATmega328P
+
+#include <Arduino.h>
+
+class EEPROMClass
+{
+public:
+    EEPROMClass() { memset(this->memory, 0xFF, sizeof(this->memory)); }
+    uint8_t read(int address) { return this->memory[address % sizeof(this->memory)]; }
+    void write(int address, uint8_t value) { this->memory[address % sizeof(this->memory)] = value; }
+    void update(int address, uint8_t value) { this->write(address, value); }
+    uint16_t length() { return sizeof(this->memory); }
+
+private:
+    uint8_t memory[1024];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
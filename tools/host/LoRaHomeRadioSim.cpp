@@ -0,0 +1,442 @@
+#include <LoRaHomeRadioSim.h>
+#include <LoRa.h>
+#include <ctype.h>
+
+// modes of the radio, as given to the simulator
+static const uint8_t SIM_MODE_STANDBY = 0;
+static const uint8_t SIM_MODE_SLEEP = 1;
+static const uint8_t SIM_MODE_RX = 2;
+
+// longest reply: a packet of LH_FRAME_MAX_SIZE bytes in hex and its fields
+static const size_t SIM_LINE_SIZE = 2 * LH_FRAME_MAX_SIZE + 96;
+
+/**
+ * @brief Construct a new LoRaHomeRadioSim object, in standby at simulated time 0
+ *
+ * @param in replies of the simulator
+ * @param out requests to the simulator
+ * @param seed seed of random(), different on each node: it seeds the listen before talk backoff
+ */
+LoRaHomeRadioSim::LoRaHomeRadioSim(FILE *in, FILE *out, uint8_t seed)
+{
+    this->in = in;
+    this->out = out;
+    this->commandCallback = NULL;
+    this->receiveCallback = NULL;
+    this->cadDoneCallback = NULL;
+    this->now = 0;
+    this->frf = 0;
+    this->spreadingFactor = 7;
+    this->bandwidth = 125000;
+    this->codingRate = 5;
+    this->preambleLength = 8;
+    this->txPower = 17;
+    this->invertIQ = false;
+    this->mode = SIM_MODE_STANDBY;
+    this->rxFrf = 0;
+    this->rxSpreadingFactor = 0;
+    this->rxInvertIQ = false;
+    this->txLength = 0;
+    this->length = 0;
+    this->index = 0;
+    this->received = false;
+    this->packetFrf = 0;
+    this->packetSpreadingFactor = 0;
+    this->rssi = 0;
+    this->snr = 0;
+    this->polled = false;
+    this->cadResult = -1;
+    this->seed = (seed != 0) ? seed : 1;
+    setSimulatedTime(0);
+}
+
+/**
+ * @brief register the callback of the commands of the simulator, e.g. "end" to print the results and exit
+ *
+ * @param callback called with the command line, NULL to ignore the commands
+ */
+void LoRaHomeRadioSim::onCommand(void (*callback)(const char *command))
+{
+    this->commandCallback = callback;
+}
+
+/**
+ * @brief let the simulated time pass until the given time, or until a packet or a command comes first
+ * A packet received is held for parsePacket(), or given to the onReceive() callback
+ *
+ * @param time simulated time in us
+ * @return true if the time has been reached
+ */
+bool LoRaHomeRadioSim::waitUntil(uint64_t time)
+{
+    this->polled = false;
+    if (time <= this->now)
+    {
+        return true;
+    }
+    fprintf(this->out, "wait %llu\n", (unsigned long long)time);
+    fflush(this->out);
+    return this->readReply() == 't';
+}
+
+/**
+ * @brief let the simulated time pass until the given time, whatever comes meanwhile, as delay() does
+ *
+ * @param time simulated time in us
+ */
+void LoRaHomeRadioSim::delayUntil(uint64_t time)
+{
+    while (this->now < time)
+    {
+        this->waitUntil(time);
+    }
+}
+
+/**
+ * @brief Get the FRF register value of the channel of the last packet received
+ *
+ */
+uint32_t LoRaHomeRadioSim::getPacketFrf()
+{
+    return this->packetFrf;
+}
+
+/**
+ * @brief Get the spreading factor of the last packet received
+ *
+ */
+uint8_t LoRaHomeRadioSim::getPacketSpreadingFactor()
+{
+    return this->packetSpreadingFactor;
+}
+
+bool LoRaHomeRadioSim::begin(long frequency)
+{
+    this->frf = LORA_FRF(frequency);
+    return true;
+}
+
+void LoRaHomeRadioSim::setSpreadingFactor(int sf)
+{
+    this->spreadingFactor = sf;
+}
+
+void LoRaHomeRadioSim::setSignalBandwidth(long sbw)
+{
+    this->bandwidth = sbw;
+}
+
+void LoRaHomeRadioSim::setCodingRate4(int denominator)
+{
+    this->codingRate = denominator;
+}
+
+void LoRaHomeRadioSim::setSyncWord(int)
+{
+}
+
+void LoRaHomeRadioSim::setPreambleLength(long length)
+{
+    this->preambleLength = length;
+}
+
+void LoRaHomeRadioSim::setTxPower(int level)
+{
+    this->txPower = level;
+}
+
+void LoRaHomeRadioSim::setFrf(uint32_t frf)
+{
+    this->frf = frf;
+}
+
+void LoRaHomeRadioSim::enableCrc()
+{
+}
+
+void LoRaHomeRadioSim::enableInvertIQ()
+{
+    this->invertIQ = true;
+}
+
+void LoRaHomeRadioSim::disableInvertIQ()
+{
+    this->invertIQ = false;
+}
+
+void LoRaHomeRadioSim::idle()
+{
+    this->setMode(SIM_MODE_STANDBY);
+}
+
+void LoRaHomeRadioSim::sleep()
+{
+    this->setMode(SIM_MODE_SLEEP);
+}
+
+void LoRaHomeRadioSim::receive()
+{
+    this->setMode(SIM_MODE_RX);
+}
+
+void LoRaHomeRadioSim::beginPacket()
+{
+    this->txLength = 0;
+}
+
+size_t LoRaHomeRadioSim::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; (i < size) && (this->txLength < LH_FRAME_MAX_SIZE); i++)
+    {
+        this->txPacket[this->txLength++] = buffer[i];
+    }
+    return size;
+}
+
+void LoRaHomeRadioSim::endPacket()
+{
+    this->transmit();
+}
+
+/**
+ * @brief send the last packet again, unless a packet received since has overwritten it
+ *
+ * @return true if sent
+ */
+bool LoRaHomeRadioSim::retransmit()
+{
+    if (this->txLength == 0)
+    {
+        return false;
+    }
+    this->transmit();
+    return true;
+}
+
+/**
+ * @brief packet received since the last call. Polling again without packet lets LH_RADIO_SIM_POLL pass,
+ * so that the loops polling the radio until a timeout end
+ *
+ * @return int size of the packet, 0 if none
+ */
+int LoRaHomeRadioSim::parsePacket()
+{
+    if (!this->received && this->polled)
+    {
+        this->waitUntil(this->now + LH_RADIO_SIM_POLL);
+    }
+    if (!this->received)
+    {
+        this->polled = true;
+        return 0;
+    }
+    this->received = false;
+    this->index = 0;
+    return this->length;
+}
+
+int LoRaHomeRadioSim::read()
+{
+    if (this->index >= this->length)
+    {
+        return -1;
+    }
+    return this->packet[this->index++];
+}
+
+size_t LoRaHomeRadioSim::read(uint8_t *buffer, size_t length)
+{
+    size_t n = 0;
+    while ((n < length) && (this->index < this->length))
+    {
+        buffer[n++] = this->packet[this->index++];
+    }
+    return n;
+}
+
+/**
+ * @brief register the receive callback, called from waitUntil() when a packet is received
+ *
+ * @param callback called with the size of the packet, NULL to unregister
+ */
+void LoRaHomeRadioSim::onReceive(void (*callback)(int))
+{
+    this->receiveCallback = callback;
+}
+
+/**
+ * @brief run a CAD on the current settings: returns at its end, the result is then available at once
+ *
+ */
+void LoRaHomeRadioSim::channelActivityDetection()
+{
+    fprintf(this->out, "cad %lu %u %u\n", (unsigned long)this->frf, this->spreadingFactor, this->invertIQ ? 1 : 0);
+    fflush(this->out);
+    this->polled = false;
+    this->cadResult = -1;
+    while (this->readReply() != 'c')
+    {
+    }
+    this->mode = SIM_MODE_STANDBY;
+    if (this->cadDoneCallback != NULL)
+    {
+        this->cadDoneCallback(this->cadResult > 0);
+    }
+}
+
+int LoRaHomeRadioSim::channelActivityResult()
+{
+    return this->cadResult;
+}
+
+void LoRaHomeRadioSim::onCadDone(void (*callback)(bool))
+{
+    this->cadDoneCallback = callback;
+}
+
+int LoRaHomeRadioSim::packetRssi()
+{
+    return this->rssi;
+}
+
+float LoRaHomeRadioSim::packetSnr()
+{
+    return this->snr / 4.0;
+}
+
+/**
+ * @brief pseudo random byte (8 bits xorshift) from the seed of the node, so that runs are reproducible
+ *
+ */
+uint8_t LoRaHomeRadioSim::random()
+{
+    this->seed ^= this->seed << 3;
+    this->seed ^= this->seed >> 5;
+    this->seed ^= this->seed << 4;
+    return this->seed;
+}
+
+/**
+ * @brief read the next reply of the simulator and set the simulated time
+ * A packet is held for parsePacket(), a command is given to the command callback.
+ * The end of the input stands for the "end" command: the program exits if the callback returns.
+ *
+ * @return char 't', 'c' (CAD), 'r' (packet) or 'x' (command)
+ */
+char LoRaHomeRadioSim::readReply()
+{
+    char line[SIM_LINE_SIZE];
+    if (fgets(line, sizeof(line), this->in) == NULL)
+    {
+        if (this->commandCallback != NULL)
+        {
+            this->commandCallback("end");
+        }
+        exit(0);
+    }
+    char *p = strchr(line, ' ');
+    if (p == NULL)
+    {
+        p = line + strlen(line);
+    }
+    this->now = strtoull(p, &p, 10);
+    setSimulatedTime(this->now);
+    if (strncmp(line, "t ", 2) == 0)
+    {
+        return 't';
+    }
+    if (strncmp(line, "cad ", 4) == 0)
+    {
+        this->cadResult = strtol(p, &p, 10);
+        return 'c';
+    }
+    if (strncmp(line, "rx ", 3) == 0)
+    {
+        this->packetFrf = strtoul(p, &p, 10);
+        this->packetSpreadingFactor = strtoul(p, &p, 10);
+        this->rssi = strtol(p, &p, 10);
+        this->snr = strtol(p, &p, 10);
+        while (*p == ' ')
+        {
+            p++;
+        }
+        this->length = 0;
+        while (isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1]) && (this->length < LH_FRAME_MAX_SIZE))
+        {
+            char hex[3] = {p[0], p[1], '\0'};
+            this->packet[this->length++] = strtoul(hex, NULL, 16);
+            p += 2;
+        }
+        this->index = 0;
+        this->received = true;
+        // the FIFO holds the packet received now
+        this->txLength = 0;
+        if (this->receiveCallback != NULL)
+        {
+            this->receiveCallback(this->length);
+        }
+        return 'r';
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    if (this->commandCallback != NULL)
+    {
+        this->commandCallback(line);
+    }
+    return 'x';
+}
+
+/**
+ * @brief give a new mode to the simulator. Receive settings are taken when the receive mode is entered
+ *
+ * @param mode SIM_MODE_xxx
+ */
+void LoRaHomeRadioSim::setMode(uint8_t mode)
+{
+    if (mode == SIM_MODE_RX)
+    {
+        if ((this->mode == SIM_MODE_RX) && (this->rxFrf == this->frf) && (this->rxSpreadingFactor == this->spreadingFactor) &&
+            (this->rxInvertIQ == this->invertIQ))
+        {
+            return;
+        }
+        this->rxFrf = this->frf;
+        this->rxSpreadingFactor = this->spreadingFactor;
+        this->rxInvertIQ = this->invertIQ;
+        fprintf(this->out, "rx %lu %u %u\n", (unsigned long)this->frf, this->spreadingFactor, this->invertIQ ? 1 : 0);
+    }
+    else if (mode != this->mode)
+    {
+        fprintf(this->out, (mode == SIM_MODE_SLEEP) ? "sleep\n" : "standby\n");
+    }
+    this->mode = mode;
+}
+
+/**
+ * @brief send the packet held, returns at the end of its time on air with the radio in standby
+ *
+ */
+void LoRaHomeRadioSim::transmit()
+{
+    fprintf(this->out, "tx %lu %u %ld %u %ld %d %u ", (unsigned long)this->frf, this->spreadingFactor, this->bandwidth,
+            this->codingRate, this->preambleLength, this->txPower, this->invertIQ ? 1 : 0);
+    printHex(this->out, this->txPacket, this->txLength);
+    fflush(this->out);
+    this->polled = false;
+    while (this->readReply() != 't')
+    {
+    }
+    this->mode = SIM_MODE_STANDBY;
+}
+
+/**
+ * @brief print bytes in hex, then the end of the line
+ *
+ */
+void LoRaHomeRadioSim::printHex(FILE *out, const uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        fprintf(out, "%02x", data[i]);
+    }
+    fputc('\n', out);
+}
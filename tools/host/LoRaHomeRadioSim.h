@@ -0,0 +1,121 @@
+#ifndef LORAHOMERADIOSIM_H
+#define LORAHOMERADIOSIM_H
+
+#include <Arduino.h>
+#include <LoRaHomeRadio.h>
+#include <LoRaHomeFrame.h>
+
+// Line protocol with the network simulator (tools/lh_netsim.py), times in us of simulated time.
+// Requests, written by the radio, the last three blocking until their reply:
+//   rx <FRF> <SF> <inverted IQ 0|1>     receive mode with these settings
+//   standby, sleep                      other modes
+//   tx <FRF> <SF> <bandwidth Hz> <coding rate denominator> <preamble symbols> <power dBm> <inverted IQ> <bytes in hex>
+//                                       packet sent, replied at the end of its time on air
+//   cad <FRF> <SF> <inverted IQ>        channel activity detection, replied at the end of the CAD
+//   wait <time>                         replied at the given time, or earlier with a packet or a command
+// Replies, read by the radio:
+//   t <time>                            time reached, end of the transmission
+//   cad <time> <0|1>                    end of the CAD, 1 if a preamble was detected
+//   rx <time> <FRF> <SF> <RSSI dBm> <SNR in 0.25 dB> <bytes in hex>
+//                                       packet received, ending at that time
+//   <command> <time> [arguments]        anything else, given to the onCommand() callback, e.g. "end"
+// The radio is in standby at the end of a transmission or a CAD.
+// The programs print their own lines on the same output, e.g. "ev ..." events: the simulator takes them
+// at the time of the last reply.
+
+// simulated time let pass by a parsePacket() polling again without packet (us): busy loops advance the time.
+// A packet ends the wait at once: this is only the resolution of the receive timeouts
+#ifndef LH_RADIO_SIM_POLL
+#define LH_RADIO_SIM_POLL 20000
+#endif
+
+/**
+ * @brief LoRaHomeRadio of a node or gateway run by the network simulator, over stdin / stdout
+ * The simulator owns the time and the channel: it computes the time on air, the collisions and the CAD results,
+ * and delivers the packets received. The radio sets the simulated time of the host shim (setSimulatedTime)
+ * from each reply, millis() only advances while the radio waits.
+ * Like the SX127x, one received packet is held at a time: a new packet overwrites the one not read yet,
+ * and the packet sent is lost for retransmit() once a packet has been received.
+ */
+class LoRaHomeRadioSim : public LoRaHomeRadio
+{
+public:
+    LoRaHomeRadioSim(FILE *in, FILE *out, uint8_t seed);
+    void onCommand(void (*callback)(const char *command));
+    bool waitUntil(uint64_t time);
+    void delayUntil(uint64_t time);
+    uint32_t getPacketFrf();
+    uint8_t getPacketSpreadingFactor();
+    bool begin(long frequency);
+    void setSpreadingFactor(int sf);
+    void setSignalBandwidth(long sbw);
+    void setCodingRate4(int denominator);
+    void setSyncWord(int sw);
+    void setPreambleLength(long length);
+    void setTxPower(int level);
+    void setFrf(uint32_t frf);
+    void enableCrc();
+    void enableInvertIQ();
+    void disableInvertIQ();
+    void idle();
+    void sleep();
+    void receive();
+    void beginPacket();
+    size_t write(const uint8_t *buffer, size_t size);
+    void endPacket();
+    bool retransmit();
+    int parsePacket();
+    int read();
+    size_t read(uint8_t *buffer, size_t length);
+    void onReceive(void (*callback)(int));
+    void channelActivityDetection();
+    int channelActivityResult();
+    void onCadDone(void (*callback)(bool));
+    int packetRssi();
+    float packetSnr();
+    uint8_t random();
+
+private:
+    char readReply();
+    void setMode(uint8_t mode);
+    void transmit();
+    static void printHex(FILE *out, const uint8_t *data, uint8_t length);
+
+    FILE *in;
+    FILE *out;
+    void (*commandCallback)(const char *command);
+    void (*receiveCallback)(int);
+    void (*cadDoneCallback)(bool);
+    uint64_t now;
+    // radio settings
+    uint32_t frf;
+    uint8_t spreadingFactor;
+    long bandwidth;
+    uint8_t codingRate;
+    long preambleLength;
+    int txPower;
+    bool invertIQ;
+    // mode and receive settings last given to the simulator
+    uint8_t mode;
+    uint32_t rxFrf;
+    uint8_t rxSpreadingFactor;
+    bool rxInvertIQ;
+    // packet sent, kept for retransmit() until a packet is received
+    uint8_t txPacket[LH_FRAME_MAX_SIZE];
+    uint8_t txLength;
+    // packet received, held until read
+    uint8_t packet[LH_FRAME_MAX_SIZE];
+    uint8_t length;
+    uint8_t index;
+    bool received;
+    uint32_t packetFrf;
+    uint8_t packetSpreadingFactor;
+    int rssi;
+    int snr;
+    // parsePacket() returned 0 since the last wait
+    bool polled;
+    int cadResult;
+    uint8_t seed;
+};
+
+#endif
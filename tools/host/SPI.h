@@ -0,0 +1,27 @@
+#ifndef SPI_H
+#define SPI_H
+
+// Host shim of the Arduino SPI library: no device, every transfer reads 0
+
+#include <Arduino.h>
+
+class SPISettings
+{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass
+{
+public:
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t) { return 0; }
+};
+
+extern SPIClass SPI;
+
+#endif
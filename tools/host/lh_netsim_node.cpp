@@ -0,0 +1,478 @@
+// Node or gateway of the network simulator, built by the netsim environment of platformio.ini:
+//   pio run -e netsim
+//   tools/lh_netsim.py --program .pio/build/netsim/program ...
+// Each simulated node runs the real LoRaHomeNode and scheduler over a LoRaHomeRadioSim, the simulator owning the
+// time and the channel. The gateway is a model built on the frame code of the node: ACKs, fragment ACKs with
+// LoRaHomeReassembly, window ACKs, downlinks on command. Both print their events as lines for the statistics:
+//   ev gen <counter>                   node: uplink payload built, with the TX counter of its (first) frame
+//   ev sent <0|1>                      node: uplink exchange over, 1 if acknowledged
+//   ev dl <downlink id>                node: downlink given to the application
+//   ev up <node> <counter> <bytes>     gateway: uplink payload received, fragmented messages once reassembled
+//   stats <LH_STAT_xxx counters>       node: on the "end" command, before exiting
+// Not built by pio test: the unit tests have their own main().
+#if defined(LH_NETSIM) && !defined(PIO_UNIT_TESTING)
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LoRa.h>
+#include <LoRaNode.h>
+#include <LoRaHomeNode.h>
+#include <LoRaHomeReassembly.h>
+#include <LoRaHomeRadioSim.h>
+#include <NodeConfig.h>
+
+// gateway model: delay between the end of an uplink and its ACK (ms), as LoRaWAN gateways schedule it
+const unsigned long GATEWAY_TURNAROUND = 10;
+// receive windows of the nodes, as in LoRaHomeNode.cpp: downlinks held for the RX1 window of the next uplink,
+// opened RX1_DELAY after the end of the ACK
+const unsigned long GATEWAY_RX1_DELAY = 1000;
+// margin after the opening of the window (ms)
+const unsigned long GATEWAY_RX1_MARGIN = 20;
+// transmissions scheduled at once, e.g. ACKs of the frames received by the channels of a concentrator
+const uint8_t GATEWAY_TX_QUEUE_SIZE = 16;
+const uint64_t SIM_FOREVER = (uint64_t)-1;
+
+static LoRaHomeRadioSim *radio = NULL;
+
+/**
+ * @brief let the time of delay() pass on the radio, packets received meanwhile are held by the radio
+ *
+ */
+static void simDelay(uint64_t until)
+{
+    radio->delayUntil(until);
+}
+
+/**
+ * @brief LoRaNode sending a JSON payload of a given size, {"n":<counter>,"p":"aaa..."}, every uplink interval
+ * Its keys are not in the LoRaHomeDictionary: the payload has the same size with -D LH_DICTIONARY
+ */
+class SimNode : public LoRaNode
+{
+public:
+    SimNode(uint8_t nodeId, unsigned long interval, uint16_t payloadSize)
+        : nodeId(nodeId), interval(interval), payloadSize(payloadSize) {}
+    void appSetup()
+    {
+        this->setNodeId(this->nodeId);
+        this->setTransmissionTimeInterval(this->interval);
+        // the processing task does nothing: once a day
+        this->setProcessingTimeInterval(86400000UL);
+    }
+    void appProcessing() {}
+    void addJsonTxPayload(JsonDocument &payload)
+    {
+        printf("ev gen %u\n", this->getTxCounter());
+        payload["n"] = this->getTxCounter();
+        // padding after ,"p":""
+        size_t size = measureJson(payload) + 7;
+        size_t pad = (this->payloadSize > size) ? min((size_t)(this->payloadSize - size), sizeof(this->padding) - 1) : 0;
+        memset(this->padding, 'a', pad);
+        this->padding[pad] = '\0';
+        payload["p"] = (const char *)this->padding;
+    }
+    void parseJsonRxPayload(JsonDocument &payload)
+    {
+        if (!payload["dl"].isNull())
+        {
+            printf("ev dl %lu\n", payload["dl"].as<unsigned long>());
+        }
+    }
+
+private:
+    uint8_t nodeId;
+    unsigned long interval;
+    uint16_t payloadSize;
+    char padding[LH_MAX_PAYLOAD_SIZE + 1];
+};
+
+/**
+ * @brief Processing task: application processing of the node
+ */
+static void processingTask()
+{
+    Node->appProcessing();
+}
+
+/**
+ * @brief Transmission task: send the payload to the gateway, tell whether it has been acknowledged
+ */
+static void transmissionTask()
+{
+    LoRaHomeStats &stats = loraHomeNode.getStats();
+    uint16_t lost = stats.getCounter(LH_STAT_TX_LOST);
+    loraHomeNode.sendToGateway();
+    printf("ev sent %u\n", (stats.getCounter(LH_STAT_TX_LOST) == lost) ? 1 : 0);
+}
+
+/**
+ * @brief commands of the simulator to a node: "end" prints the counters of the node and exits
+ *
+ */
+static void nodeCommand(const char *command)
+{
+    if (strncmp(command, "end", 3) != 0)
+    {
+        return;
+    }
+    LoRaHomeStats &stats = loraHomeNode.getStats();
+    printf("stats");
+    for (uint8_t counter = 0; counter < LH_STAT_COUNTERS; counter++)
+    {
+        printf(" %u", stats.getCounter(counter));
+    }
+    printf("\n");
+    fflush(stdout);
+    exit(0);
+}
+
+/**
+ * @brief run a node as the main loop of src/main.cpp does, idling until the next task or receive policy event
+ *
+ * @return int never returns, exits on the "end" command
+ */
+static int runNode(uint8_t nodeId, unsigned long boot, unsigned long interval, uint16_t payloadSize, uint8_t spreadingFactor,
+                   uint8_t rxPolicy)
+{
+    radio->onCommand(nodeCommand);
+    radio->delayUntil((uint64_t)boot * 1000);
+    Node = new SimNode(nodeId, interval, payloadSize);
+    loraHomeNode.setRadio(radio);
+    loraHomeNode.setup();
+    Node->appSetup();
+    loraHomeNode.setSpreadingFactor(spreadingFactor);
+    loraHomeNode.setRxPolicy(rxPolicy);
+    Node->startTasks(processingTask, transmissionTask);
+    while (true)
+    {
+        Node->runTasks();
+        loraHomeNode.receiveLoraMessage();
+        unsigned long next = min(Node->getScheduler().getTimeToNextDeadline(), loraHomeNode.getTimeToNextRxEvent());
+        if (next > 0)
+        {
+            radio->waitUntil((next == (unsigned long)-1) ? SIM_FOREVER : micros() + (uint64_t)next * 1000);
+        }
+    }
+}
+
+/**
+ * @brief frame scheduled by the gateway model
+ */
+struct GatewayTx
+{
+    uint64_t time;
+    uint32_t frf;
+    uint8_t spreadingFactor;
+    long preambleLength;
+    // node whose held downlink follows this ACK, LH_NODE_ID_GATEWAY if none
+    uint8_t downlinkNode;
+    uint8_t length;
+    uint8_t packet[LH_FRAME_MAX_SIZE];
+};
+
+/**
+ * @brief what the gateway model knows of a node
+ */
+struct GatewayNode
+{
+    uint8_t spreadingFactor;
+    // windowed uplinks: last counter received and bitmap of the counters received before it
+    uint16_t lastCounter;
+    uint16_t counterBitmap;
+    // downlink waiting for the node, -1 if none, sent at downlinkTime (SIM_FOREVER: held until the next uplink)
+    long downlink;
+    uint64_t downlinkTime;
+    LoRaHomeReassembly reassembly;
+};
+
+static GatewayNode gatewayNodes[256];
+static GatewayTx gatewayQueue[GATEWAY_TX_QUEUE_SIZE];
+static uint8_t gatewayQueued = 0;
+static uint16_t gatewayCounter = 0;
+static uint32_t gatewayFrf;
+static uint8_t gatewaySpreadingFactor;
+static long gatewayPreambleLength;
+static bool gatewayWindows;
+static uint8_t gatewayDownlinkSize;
+
+/**
+ * @brief schedule a frame of the gateway, dropped if the queue is full
+ *
+ * @param frame the frame
+ * @param time simulated time of its transmission, in us
+ * @param frf channel
+ * @param spreadingFactor SF
+ * @param preambleLength preamble in symbols, long for wake-on-radio nodes
+ * @param downlinkNode node whose held downlink is scheduled at the end of this frame, LH_NODE_ID_GATEWAY if none
+ */
+static void gatewaySchedule(LoRaHomeFrame &frame, uint64_t time, uint32_t frf, uint8_t spreadingFactor, long preambleLength,
+                            uint8_t downlinkNode = LH_NODE_ID_GATEWAY)
+{
+    if (gatewayQueued == GATEWAY_TX_QUEUE_SIZE)
+    {
+        return;
+    }
+    GatewayTx &tx = gatewayQueue[gatewayQueued++];
+    tx.time = time;
+    tx.frf = frf;
+    tx.spreadingFactor = spreadingFactor;
+    tx.preambleLength = preambleLength;
+    tx.downlinkNode = downlinkNode;
+    tx.length = frame.serialize(tx.packet);
+}
+
+/**
+ * @brief schedule the downlink waiting for a node, {"dl":<id>,"msg":"aaa..."} of the downlink payload size
+ *
+ * @param nodeId the node
+ */
+static void gatewayScheduleDownlink(uint8_t nodeId)
+{
+    GatewayNode &node = gatewayNodes[nodeId];
+    LoRaHomeFrame frame(MY_NETWORK_ID, LH_NODE_ID_GATEWAY, nodeId, LH_MSG_TYPE_GW_MSG_NO_ACK, gatewayCounter++);
+    int size = snprintf(frame.jsonPayload, LH_FRAME_MAX_PAYLOAD_SIZE, "{\"dl\":%ld,\"msg\":\"", node.downlink);
+    while ((size + 2 < gatewayDownlinkSize) && (size + 3 < LH_FRAME_MAX_PAYLOAD_SIZE))
+    {
+        frame.jsonPayload[size++] = 'a';
+    }
+    strcpy(&frame.jsonPayload[size], "\"}");
+    frame.payloadSize = size + 2;
+    gatewaySchedule(frame, node.downlinkTime, gatewayFrf, node.spreadingFactor, gatewayPreambleLength);
+    node.downlink = -1;
+}
+
+/**
+ * @brief commands of the simulator to the gateway: "dl <time> <node> <id>" queues a downlink, "end" exits
+ *
+ */
+static void gatewayCommand(const char *command)
+{
+    if (strncmp(command, "end", 3) == 0)
+    {
+        fflush(stdout);
+        exit(0);
+    }
+    unsigned long long time;
+    unsigned int nodeId;
+    long id;
+    if ((sscanf(command, "dl %llu %u %ld", &time, &nodeId, &id) != 3) || (nodeId > 0xFF))
+    {
+        return;
+    }
+    GatewayNode &node = gatewayNodes[nodeId];
+    node.downlink = id;
+    // held for the RX1 window of the next uplink, or sent at once
+    node.downlinkTime = gatewayWindows ? SIM_FOREVER : time;
+    if (!gatewayWindows)
+    {
+        gatewayScheduleDownlink(nodeId);
+    }
+}
+
+/**
+ * @brief bitmap of the window ACK of a frame: bit i set if the frame with counter (counter - i) has been received
+ *
+ * @param node the emitter
+ * @param counter counter of the frame requesting the ACK
+ * @return uint16_t the bitmap
+ */
+static uint16_t gatewayWindowBitmap(GatewayNode &node, uint16_t counter)
+{
+    uint16_t age = node.lastCounter - counter;
+    return (age < 16) ? (node.counterBitmap >> age) : 0;
+}
+
+/**
+ * @brief handle an uplink frame received: report it, schedule its ACK and the downlink held for the node
+ *
+ * @param frame the frame, CRC checked
+ */
+static void gatewayReceive(LoRaHomeFrame &frame)
+{
+    if ((frame.networkID != MY_NETWORK_ID) || (frame.nodeIdRecipient != LH_NODE_ID_GATEWAY))
+    {
+        return;
+    }
+    GatewayNode &node = gatewayNodes[frame.nodeIdEmitter];
+    node.spreadingFactor = radio->getPacketSpreadingFactor();
+    uint8_t type = frame.messageType;
+    if ((type != LH_MSG_TYPE_NODE_MSG_ACK_REQ) && (type != LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ) &&
+        (type != LH_MSG_TYPE_NODE_MSG_WINDOW_ACK_REQ))
+    {
+        return;
+    }
+    LoRaHomeFrame ack(MY_NETWORK_ID, LH_NODE_ID_GATEWAY, frame.nodeIdEmitter, LH_MSG_TYPE_GW_ACK, frame.counter);
+    if (frame.isFragment())
+    {
+        if (node.reassembly.addFragment(frame))
+        {
+            printf("ev up %u %u %u\n", frame.nodeIdEmitter, node.reassembly.getFirstCounter(), node.reassembly.getLength());
+        }
+        ack.messageType = LH_MSG_TYPE_GW_FRAGMENT_ACK;
+        ack.counter = node.reassembly.getFirstCounter();
+        ack.setAckBitmap(node.reassembly.getBitmap());
+    }
+    else
+    {
+        printf("ev up %u %u %u\n", frame.nodeIdEmitter, frame.counter, frame.payloadSize);
+        int16_t age = frame.counter - node.lastCounter;
+        if (age > 0)
+        {
+            node.counterBitmap = (age < 16) ? (node.counterBitmap << age) | 1 : 1;
+            node.lastCounter = frame.counter;
+        }
+        else if (age > -16)
+        {
+            node.counterBitmap |= 1 << -age;
+        }
+        if (type == LH_MSG_TYPE_NODE_MSG_WINDOW_ACK_REQ)
+        {
+            ack.messageType = LH_MSG_TYPE_GW_WINDOW_ACK;
+            ack.setAckBitmap(gatewayWindowBitmap(node, frame.counter));
+        }
+    }
+    if (type == LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ)
+    {
+        return;
+    }
+    bool held = (node.downlink >= 0) && (node.downlinkTime == SIM_FOREVER);
+    gatewaySchedule(ack, micros() + GATEWAY_TURNAROUND * 1000, radio->getPacketFrf(), radio->getPacketSpreadingFactor(), 8,
+                    held ? frame.nodeIdEmitter : LH_NODE_ID_GATEWAY);
+}
+
+/**
+ * @brief back to receive on the gateway channel, uplinks with normal IQ
+ *
+ */
+static void gatewayRxMode()
+{
+    radio->disableInvertIQ();
+    radio->setFrf(gatewayFrf);
+    radio->setSpreadingFactor(gatewaySpreadingFactor);
+    radio->setPreambleLength(8);
+    radio->receive();
+}
+
+/**
+ * @brief send the frames of the queue which are due, in order, back to receive after each one
+ *
+ * @return uint64_t time of the next frame of the queue, SIM_FOREVER if none
+ */
+static uint64_t gatewaySend()
+{
+    uint64_t next = SIM_FOREVER;
+    uint8_t i = 0;
+    while (i < gatewayQueued)
+    {
+        GatewayTx &tx = gatewayQueue[i];
+        if (tx.time > micros())
+        {
+            next = min(next, tx.time);
+            i++;
+            continue;
+        }
+        radio->idle();
+        radio->enableInvertIQ();
+        radio->setFrf(tx.frf);
+        radio->setSpreadingFactor(tx.spreadingFactor);
+        radio->setPreambleLength(tx.preambleLength);
+        radio->beginPacket();
+        radio->write(tx.packet, tx.length);
+        radio->endPacket();
+        gatewayRxMode();
+        uint8_t downlinkNode = tx.downlinkNode;
+        gatewayQueue[i] = gatewayQueue[--gatewayQueued];
+        if ((downlinkNode != LH_NODE_ID_GATEWAY) && (gatewayNodes[downlinkNode].downlink >= 0))
+        {
+            // the node sleeps after the ACK, up to its RX1 window
+            gatewayNodes[downlinkNode].downlinkTime = micros() + (GATEWAY_RX1_DELAY + GATEWAY_RX1_MARGIN) * 1000;
+            gatewayScheduleDownlink(downlinkNode);
+        }
+        // sending took time: scan the queue again
+        i = 0;
+        next = SIM_FOREVER;
+    }
+    return next;
+}
+
+/**
+ * @brief run the gateway model, listening on one channel and SF (the simulator decides for a concentrator)
+ *
+ * @return int never returns, exits on the "end" command
+ */
+static int runGateway(uint32_t frf, uint8_t spreadingFactor, long preambleLength, bool windows, uint8_t downlinkSize)
+{
+    gatewayFrf = frf;
+    gatewaySpreadingFactor = spreadingFactor;
+    gatewayPreambleLength = preambleLength;
+    gatewayWindows = windows;
+    gatewayDownlinkSize = downlinkSize;
+    for (GatewayNode &node : gatewayNodes)
+    {
+        node.spreadingFactor = spreadingFactor;
+        node.lastCounter = 0;
+        node.counterBitmap = 0;
+        node.downlink = -1;
+    }
+#ifdef LH_SECURITY
+    loraHomeSecurity.begin(SECURITY_KEY);
+#endif
+    radio->onCommand(gatewayCommand);
+    radio->begin(0);
+    radio->setSignalBandwidth(125E3);
+    radio->setCodingRate4(5);
+    radio->setTxPower(14);
+    gatewayRxMode();
+    while (true)
+    {
+        int size = radio->parsePacket();
+        if (size > 0)
+        {
+            uint8_t packet[LH_FRAME_MAX_SIZE];
+            LoRaHomeFrame frame;
+            size = radio->read(packet, min(size, (int)LH_FRAME_MAX_SIZE));
+            if (frame.createFromRxMessage(packet, size, true))
+            {
+                gatewayReceive(frame);
+            }
+        }
+        uint64_t next = gatewaySend();
+        if (size == 0)
+        {
+            radio->waitUntil(next);
+        }
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *rxPolicies[] = {"continuous", "windows", "wake-on-radio"};
+    if ((argc == 9) && (strcmp(argv[1], "node") == 0))
+    {
+        uint8_t rxPolicy = 0;
+        while ((rxPolicy < 3) && (strcmp(argv[8], rxPolicies[rxPolicy]) != 0))
+        {
+            rxPolicy++;
+        }
+        if (rxPolicy < 3)
+        {
+            radio = new LoRaHomeRadioSim(stdin, stdout, atoi(argv[3]));
+            setDelayHook(simDelay);
+            return runNode(atoi(argv[2]), atol(argv[4]), atol(argv[5]), atoi(argv[6]), atoi(argv[7]), rxPolicy);
+        }
+    }
+    if ((argc == 7) && (strcmp(argv[1], "gateway") == 0))
+    {
+        radio = new LoRaHomeRadioSim(stdin, stdout, 1);
+        setDelayHook(simDelay);
+        return runGateway(LORA_FRF(atof(argv[2])), atoi(argv[3]), atol(argv[4]), atoi(argv[5]) != 0, atoi(argv[6]));
+    }
+    fprintf(stderr, "usage: %s node <node id> <seed> <boot ms> <uplink interval ms> <payload bytes> <SF> "
+                    "<continuous|windows|wake-on-radio>\n"
+                    "       %s gateway <frequency Hz> <SF> <downlink preamble symbols> <hold downlinks 0|1> <downlink payload bytes>\n",
+            argv[0], argv[0]);
+    return 2;
+}
+
+#endif
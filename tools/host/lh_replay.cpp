@@ -0,0 +1,58 @@
+// Host replay of a capture through the node, built by the native environment of platformio.ini:
+//   pio run -e native
+//   .pio/build/native/program capture.txt [log file] > replay.txt
+// The "rx" lines of the capture (see LoRaHomeRadioCapture.h) are received by the node in order, the packets
+// sent in response are printed on stdout as "tx" lines, to be compared with the "tx" lines of the capture.
+// The binary log is written to the log file if given (tools/lh_log.py), the counters are printed on stderr at the end.
+// Not built by pio test: the unit tests have their own main(), nor by the netsim environment (lh_netsim_node.cpp).
+#if !defined(PIO_UNIT_TESTING) && !defined(LH_NETSIM)
+
+#include <Arduino.h>
+#include <LoRaNode.h>
+#include <LoRaHomeNode.h>
+#include <LoRaHomeRadioCapture.h>
+#include <LoRaHomeLog.h>
+
+int main(int argc, char **argv)
+{
+    if ((argc < 2) || (argc > 3))
+    {
+        fprintf(stderr, "usage: %s <capture file> [log file]\n", argv[0]);
+        return 2;
+    }
+    FILE *file = fopen(argv[1], "r");
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    FILE *logFile = (argc == 3) ? fopen(argv[2], "wb") : NULL;
+    FileStream capture(file, NULL);
+    FileStream out(NULL, stdout);
+    FileStream log(NULL, logFile);
+    LoRaHomeRadioReplay radio(capture, &out);
+    loraHomeNode.setRadio(&radio);
+    loraHomeNode.setup();
+    Node->appSetup();
+    while (capture.available())
+    {
+        loraHomeNode.receiveLoraMessage();
+#if LH_LOG_LEVEL > 0
+        loraHomeLog.drain(log);
+#endif
+    }
+    out.flush();
+    fclose(file);
+    if (logFile != NULL)
+    {
+        fclose(logFile);
+    }
+    LoRaHomeStats &stats = loraHomeNode.getStats();
+    fprintf(stderr, "rx frames %u, crc errors %u, invalid %u, wrong network %u, other node %u, tx frames %u\n",
+            stats.getCounter(LH_STAT_RX_FRAMES), stats.getCounter(LH_STAT_RX_CRC_ERROR),
+            stats.getCounter(LH_STAT_RX_INVALID), stats.getCounter(LH_STAT_RX_WRONG_NETWORK),
+            stats.getCounter(LH_STAT_RX_OTHER_NODE), stats.getCounter(LH_STAT_TX_FRAMES));
+    return 0;
+}
+
+#endif
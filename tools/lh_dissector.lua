@@ -0,0 +1,161 @@
+-- Wireshark dissector of the LoRa Home captures written by tools/lh_pcap.py
+-- (LINKTYPE_USER0 link type): wireshark -X lua_script:tools/lh_dissector.lua capture.pcap
+--
+-- pseudo-header: version, flags (bit 7: tx, bits 3..0: SF), RSSI (dBm), SNR (0.25 dB), frequency (Hz)
+-- frame: emitter, recipient, type, network ID, counter, payload size, [fragment], payload, [MIC], CRC16
+-- multi-byte fields LSB first
+
+local MSG_TYPES = {
+    [0x00] = "node message",
+    [0x01] = "node message, ACK requested",
+    [0x02] = "gateway message",
+    [0x03] = "gateway message, ACK requested",
+    [0x04] = "node ACK",
+    [0x06] = "gateway ACK",
+    [0x07] = "gateway fragment ACK",
+    [0x08] = "node message, window ACK requested",
+    [0x09] = "gateway window ACK",
+    [0x0A] = "node diagnostics",
+}
+
+local SECURED_FLAG = 0x80
+local FRAGMENT_FLAG = 0x40
+local STATS_FLAG = 0x20
+local COMPRESSED_FLAG = 0x10
+local MIC_SIZE = 4
+-- LoRaHomeStats block: 10 counters (2 bytes), RSSI (-dBm), SNR (0.25 dB)
+local STATS_SIZE = 22
+local STATS_COUNTERS = { "tx frames", "tx retries", "tx lost", "ACK timeouts", "LBT busy",
+    "rx frames", "rx CRC errors", "rx invalid", "rx wrong network", "rx other node (unverified)" }
+
+local lh = Proto("lorahome", "LoRa Home")
+
+local f = lh.fields
+f.direction = ProtoField.string("lorahome.direction", "Direction")
+f.sf = ProtoField.uint8("lorahome.sf", "Spreading factor", base.DEC, nil, 0x0f)
+f.rssi = ProtoField.int8("lorahome.rssi", "RSSI (dBm)")
+f.snr = ProtoField.float("lorahome.snr", "SNR (dB)")
+f.frequency = ProtoField.uint32("lorahome.frequency", "Frequency (Hz)")
+f.emitter = ProtoField.uint8("lorahome.emitter", "Emitter", base.DEC)
+f.recipient = ProtoField.uint8("lorahome.recipient", "Recipient", base.DEC)
+f.type = ProtoField.uint8("lorahome.type", "Message type", base.HEX, MSG_TYPES, 0x0f)
+f.secured = ProtoField.bool("lorahome.secured", "Secured", 8, nil, SECURED_FLAG)
+f.fragmented = ProtoField.bool("lorahome.fragmented", "Fragment", 8, nil, FRAGMENT_FLAG)
+f.with_stats = ProtoField.bool("lorahome.with_stats", "Stats appended", 8, nil, STATS_FLAG)
+f.compressed = ProtoField.bool("lorahome.compressed", "Dictionary keys", 8, nil, COMPRESSED_FLAG)
+f.network = ProtoField.uint16("lorahome.network", "Network ID", base.HEX)
+f.counter = ProtoField.uint16("lorahome.counter", "Counter", base.DEC)
+f.payload_size = ProtoField.uint8("lorahome.payload_size", "Payload size", base.DEC)
+f.fragment_index = ProtoField.uint8("lorahome.fragment.index", "Fragment index", base.DEC, nil, 0xf0)
+f.fragment_last = ProtoField.uint8("lorahome.fragment.last", "Last fragment index", base.DEC, nil, 0x0f)
+f.payload = ProtoField.string("lorahome.payload", "Payload")
+f.payload_bytes = ProtoField.bytes("lorahome.payload_bytes", "Payload")
+f.bitmap = ProtoField.uint16("lorahome.bitmap", "ACK bitmap", base.HEX)
+f.stats_counter = ProtoField.uint16("lorahome.stats.counter", "Counter", base.DEC)
+f.mic = ProtoField.bytes("lorahome.mic", "MIC")
+f.crc = ProtoField.uint16("lorahome.crc", "CRC16", base.HEX)
+
+local function crc16_ccitt(tvb, offset, length)
+    local crc = 0xFFFF
+    for i = offset, offset + length - 1 do
+        crc = bit.bxor(crc, bit.lshift(tvb(i, 1):uint(), 8))
+        for _ = 1, 8 do
+            if bit.band(crc, 0x8000) ~= 0 then
+                crc = bit.band(bit.bxor(bit.lshift(crc, 1), 0x1021), 0xFFFF)
+            else
+                crc = bit.band(bit.lshift(crc, 1), 0xFFFF)
+            end
+        end
+    end
+    return crc
+end
+
+function lh.dissector(tvb, pinfo, tree)
+    pinfo.cols.protocol = "LoRaHome"
+    local root = tree:add(lh, tvb())
+    if tvb:len() < 8 then
+        return
+    end
+    local flags = tvb(1, 1):uint()
+    local tx = bit.band(flags, 0x80) ~= 0
+    local radio = root:add(tvb(0, 8), "Radio")
+    radio:add(f.direction, tvb(1, 1), tx and "tx" or "rx")
+    radio:add(f.sf, tvb(1, 1))
+    radio:add(f.frequency, tvb(4, 4), tvb(4, 4):le_uint())
+    if not tx then
+        radio:add(f.rssi, tvb(2, 1))
+        radio:add(f.snr, tvb(3, 1), tvb(3, 1):int() / 4)
+    end
+
+    local frame = tvb(8):tvb()
+    local length = frame:len()
+    if length < 10 then
+        root:add_expert_info(PI_MALFORMED, PI_ERROR, "frame shorter than the header and CRC")
+        return
+    end
+    local rawType = frame(2, 1):uint()
+    local msgType = bit.band(rawType, 0x0f)
+    root:add(f.emitter, frame(0, 1))
+    root:add(f.recipient, frame(1, 1))
+    local typeTree = root:add(f.type, frame(2, 1))
+    typeTree:add(f.secured, frame(2, 1))
+    typeTree:add(f.fragmented, frame(2, 1))
+    typeTree:add(f.with_stats, frame(2, 1))
+    typeTree:add(f.compressed, frame(2, 1))
+    root:add_le(f.network, frame(3, 2))
+    root:add_le(f.counter, frame(5, 2))
+    root:add(f.payload_size, frame(7, 1))
+
+    local index = 8
+    if bit.band(rawType, FRAGMENT_FLAG) ~= 0 then
+        root:add(f.fragment_index, frame(index, 1))
+        root:add(f.fragment_last, frame(index, 1))
+        index = index + 1
+    end
+    local payloadSize = frame(7, 1):uint()
+    local secured = bit.band(rawType, SECURED_FLAG) ~= 0
+    local footer = 2 + (secured and MIC_SIZE or 0)
+    if index + payloadSize + footer > length then
+        root:add_expert_info(PI_MALFORMED, PI_ERROR, "payload size larger than the frame")
+        return
+    end
+    if payloadSize > 0 then
+        local payload = frame(index, payloadSize)
+        local jsonSize = payloadSize
+        if bit.band(rawType, STATS_FLAG) ~= 0 and payloadSize >= STATS_SIZE then
+            jsonSize = payloadSize - STATS_SIZE
+        end
+        if secured or msgType == 0x0A or bit.band(rawType, COMPRESSED_FLAG) ~= 0 then
+            root:add(f.payload_bytes, frame(index, jsonSize))
+        elseif msgType == 0x07 or msgType == 0x09 then
+            root:add_le(f.bitmap, frame(index, 2))
+        elseif jsonSize > 0 then
+            root:add(f.payload, frame(index, jsonSize))
+        end
+        if jsonSize < payloadSize and not secured then
+            local stats = root:add(frame(index + jsonSize, STATS_SIZE), "Link stats")
+            for i, name in ipairs(STATS_COUNTERS) do
+                stats:add_le(f.stats_counter, frame(index + jsonSize + 2 * (i - 1), 2)):prepend_text(name .. ": ")
+            end
+            stats:add(frame(index + jsonSize + 20, 1), "Last ACK RSSI: -" .. frame(index + jsonSize + 20, 1):uint() .. " dBm")
+            stats:add(frame(index + jsonSize + 21, 1), "Last ACK SNR: " .. frame(index + jsonSize + 21, 1):int() / 4 .. " dB")
+        end
+        index = index + payloadSize
+    end
+    if secured then
+        root:add(f.mic, frame(index, MIC_SIZE))
+        index = index + MIC_SIZE
+    end
+    local crcItem = root:add_le(f.crc, frame(length - 2, 2))
+    if crc16_ccitt(frame, 0, length - 2) ~= frame(length - 2, 2):le_uint() then
+        crcItem:add_expert_info(PI_CHECKSUM, PI_WARN, "bad CRC")
+    end
+
+    local name = MSG_TYPES[msgType] or string.format("type 0x%02x", msgType)
+    pinfo.cols.src = tostring(frame(0, 1):uint())
+    pinfo.cols.dst = tostring(frame(1, 1):uint())
+    pinfo.cols.info = string.format("%s %d -> %d, counter %d", name, frame(0, 1):uint(), frame(1, 1):uint(),
+        frame(5, 2):le_uint())
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, lh)
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Decode the LoRaHomeLog binary log (-D LH_LOG_LEVEL=n).
+
+Reads the serial output of the node from a capture file or stdin and prints
+one line per log record. The events are identified by module and event ID,
+the hash of the message computed by lhLogId (LoRaHomeLog.h): the messages
+are taken from the LH_LOG / LH_LOG_VALUE calls of the sources (--src).
+Editing the sources around a call does not change its ID, only rewording
+the message does. Text printed on the serial port between the records
+(e.g. profiler dumps) is passed through.
+
+--check lists the messages of a module sharing an ID and exits with an
+error if any: run before each build by tools/lh_log_check.py.
+
+Example: lh_log.py serial.log --level 3
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+RECORD = struct.Struct("<BBHH")
+VALUE = struct.Struct("<i")
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+MODULE_LOG = 7
+DEFAULT_SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+
+MODULE_CONSTANT = re.compile(r"const uint8_t LH_LOG_MODULE_(\w+) = (\d+);")
+MODULE_DEFINE = re.compile(r"#define LH_LOG_MODULE LH_LOG_MODULE_(\w+)")
+CALL = re.compile(r'LH_LOG(?:_VALUE)?\(\s*\w+\s*,\s*"((?:[^"\\]|\\.)*)"')
+
+
+def event_id(message):
+    """lhLogId of LoRaHomeLog.h: FNV-1a of the message folded to 16 bits."""
+    value = 2166136261
+    for byte in message.encode("latin-1"):
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return (value ^ (value >> 16)) & 0xFFFF
+
+
+def unescape(literal):
+    """Text of a C string literal, simple escapes only."""
+    return re.sub(r"\\(.)", lambda match: {"n": "\n", "t": "\t"}.get(match.group(1), match.group(1)), literal)
+
+
+def scan_calls(src):
+    """List (module, file, line, message) of the LH_LOG calls of the sources, and the module names."""
+    with open(os.path.join(src, "LoRaHomeLog.h")) as header:
+        modules = {name: int(value) for name, value in MODULE_CONSTANT.findall(header.read())}
+    names = {value: name.lower() for name, value in modules.items()}
+    calls = []
+    for name in sorted(os.listdir(src)):
+        if not name.endswith(".cpp"):
+            continue
+        with open(os.path.join(src, name)) as source:
+            lines = source.read().splitlines()
+        module = None
+        for number, line in enumerate(lines, 1):
+            define = MODULE_DEFINE.search(line)
+            if define:
+                module = modules[define.group(1)]
+            for call in CALL.finditer(line):
+                if module is not None:
+                    calls.append((module, name, number, unescape(call.group(1))))
+    return calls, names
+
+
+def load_messages(src):
+    """Map (module, event ID) to (file, message) from the LH_LOG calls of the sources."""
+    calls, names = scan_calls(src)
+    messages = {}
+    for module, name, _, message in calls:
+        messages[(module, event_id(message))] = (name, message)
+    return messages, names
+
+
+def find_collisions(src):
+    """List the different messages of a module sharing an event ID, as (module name, ID, [(file, line, message)])."""
+    calls, names = scan_calls(src)
+    by_id = {}
+    for module, name, number, message in calls:
+        by_id.setdefault((module, event_id(message)), []).append((name, number, message))
+    collisions = []
+    for (module, identifier), sites in sorted(by_id.items()):
+        if len(set(message for _, _, message in sites)) > 1:
+            collisions.append((names.get(module, module), identifier, sites))
+    return collisions
+
+
+def check(src):
+    """Print the event ID collisions, return the number of colliding IDs."""
+    collisions = find_collisions(src)
+    for module, identifier, sites in collisions:
+        sys.stderr.write("lh_log: %s event ID 0x%04x shared by:\n" % (module, identifier))
+        for name, number, message in sites:
+            sys.stderr.write("  %s:%d \"%s\"\n" % (name, number, message))
+    if collisions:
+        sys.stderr.write("lh_log: reword one of the messages so that each has its own ID\n")
+    return len(collisions)
+
+
+def decode(data, messages, names, min_level):
+    text = bytearray()
+    epoch = 0
+    last = None
+    index = 0
+    while index < len(data):
+        if data[index] != SYNC or index + RECORD.size > len(data):
+            text.append(data[index])
+            index += 1
+            continue
+        _, flags, identifier, millis = RECORD.unpack_from(data, index)
+        module = flags >> 5
+        level = (flags >> 2) & 0x07
+        size = RECORD.size + (VALUE.size if flags & 1 else 0)
+        if level not in LEVELS or index + size > len(data):
+            text.append(data[index])
+            index += 1
+            continue
+        value = VALUE.unpack_from(data, index + RECORD.size)[0] if flags & 1 else None
+        index += size
+        if text:
+            sys.stdout.write(text.decode("ascii", "replace"))
+            text = bytearray()
+        # records hold the 16 LSB of millis(): unwrap assuming less than 65 s between records
+        if last is not None and millis < last:
+            epoch += 0x10000
+        last = millis
+        if level > min_level:
+            continue
+        if module == MODULE_LOG:
+            message = "%d records lost, log ring full" % value
+            value = None
+        else:
+            source, message = messages.get((module, identifier), ("?", "unknown event 0x%04x" % identifier))
+        out = "%10.3f %-5s %-10s %s" % ((epoch + millis) / 1000.0, LEVELS[level], names.get(module, module), message)
+        if value is not None:
+            out += " = %d" % value
+        print(out)
+    if text:
+        sys.stdout.write(text.decode("ascii", "replace"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", nargs="?", default="-", help="serial capture, - for stdin")
+    parser.add_argument("--src", default=DEFAULT_SRC, help="sources of the firmware")
+    parser.add_argument("--level", type=int, default=4, help="highest level printed")
+    parser.add_argument("--check", action="store_true", help="only check that the event IDs are unique")
+    args = parser.parse_args()
+
+    if args.check:
+        sys.exit(1 if check(args.src) else 0)
+
+    messages, names = load_messages(args.src)
+    data = sys.stdin.buffer.read() if args.input == "-" else open(args.input, "rb").read()
+    decode(data, messages, names, args.level)
+
+
+if __name__ == "__main__":
+    main()
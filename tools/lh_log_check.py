@@ -0,0 +1,17 @@
+"""PlatformIO pre-build script: fail the build when two LH_LOG messages of a module have the same event ID.
+
+The event ID of a log record is the 16 bit hash of its message (lhLogId in LoRaHomeLog.h),
+tools/lh_log.py could not tell two colliding messages apart.
+Enabled by extra_scripts = pre:tools/lh_log_check.py in platformio.ini.
+"""
+
+import os
+import sys
+
+Import("env")  # env: the PlatformIO build environment
+
+sys.path.insert(0, os.path.join(env["PROJECT_DIR"], "tools"))
+import lh_log
+
+if lh_log.check(env["PROJECT_SRC_DIR"]):
+    env.Exit(1)
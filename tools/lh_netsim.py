@@ -0,0 +1,553 @@
+#!/usr/bin/env python3
+"""Discrete-event simulation of LoRa Home nodes sharing one gateway.
+
+Capacity planning: how many nodes one gateway serves at a given SF, uplink
+interval and receive policy. Each node is a process running the real node
+stack, built for the host (pio run -e netsim, tools/host/lh_netsim_node.cpp):
+LoRaHomeNode, the scheduler, listen before talk, retries, fragmentation and
+the receive policies, with the settings of the build. Its LoRaHomeRadio is a
+LoRaHomeRadioSim, talking to this script over stdin / stdout (protocol in
+tools/host/LoRaHomeRadioSim.h). The gateway is a model of the same build:
+ACKs, fragment ACKs with LoRaHomeReassembly, window ACKs and downlinks.
+
+This script only orchestrates and counts: it owns the virtual clock (us) and
+the channel, and steps the programs in time order, one at a time.
+
+Channel model:
+- time on air from the Semtech SX127x formula (explicit header, CRC on)
+- log-distance path loss with log-normal shadowing per link, SX1276
+  sensitivity, nodes spread uniformly in a disc around the gateway
+- a receiver locks on a frame at the end of its preamble, if it listens on
+  its channel, SF and IQ at that time, and loses it when it leaves that mode
+- collisions between overlapping frames on the same channel, SF and IQ, with
+  capture effect: a frame survives if it is CAPTURE_DB above each interferer
+- SF and IQ orthogonality: downlinks (inverted IQ) do not hit the uplinks
+- CAD: detects a frame on the air on the channel, SF and IQ, above sensitivity
+- --loss: each frame otherwise received is lost with this probability, e.g.
+  fading or other networks, to see how retries and the selective resend of
+  the fragments (payloads above one frame) cope
+
+Gateway models (--gateway):
+- sx127x: single radio, on --frequency and the first SF only, one frame at a
+  time, half duplex (deaf while sending)
+- concentrator: 8 demodulators over all channels and SF, half duplex
+
+Downlinks (--downlink-interval): the script asks the gateway for a downlink
+to each node at random times. The gateway sends it at once, held until the
+RX1 window of the next uplink with --rx-policy windows, with a preamble longer
+than --wake-period with wake-on-radio (the analytic model of the latency and
+listening current is printed for comparison: it ignores the wake ups on the
+frames to other nodes, which the simulation counts).
+
+The channel plan, security and other firmware settings come from the build,
+see [env:netsim] in platformio.ini. --wake-period shall match the WOR_PERIOD
+of the build.
+
+--nodes, --payload and --loss take comma separated values: each combination
+is a point of the sweep. The points of a replica share its seed: same node
+positions and shadowing, the loss drawn apart.
+Replicas and parameter sweeps run on all cores (multiprocessing).
+
+--capture writes the traffic seen by the gateway in the first run (uplinks
+received, frames sent) in the binary capture format of the node RAM ring
+(LoRaHomeRadioCapture.h), to be converted with lh_pcap.py.
+
+Example: pio run -e netsim
+         lh_netsim.py --nodes 100,500,1000 --sf 7 --interval 600
+         lh_netsim.py --rx-policy wake-on-radio --wake-period 1 --downlink-interval 3600
+         lh_netsim.py --nodes 50 --payload 10,300 --loss 0,0.05,0.1,0.2
+"""
+
+import argparse
+import collections
+import heapq
+import json
+import math
+import multiprocessing
+import os
+import random
+import struct
+import subprocess
+import sys
+
+# LoRaHomeNode.cpp defaults, for the models of this script
+LBT_CAD_SYMBOLS = 2
+PREAMBLE_SYMBOLS = 8
+# wake-on-radio: a wake up costs a CAD and the oscillator start, at RX current
+WOR_WAKE_OVERHEAD = 0.001
+WOR_SYNC_SYMBOLS = 8  # preamble left after the CAD for the receiver to synchronize
+LORA_FREQUENCY = 868000000
+NODE_ID_MAX = 254  # 0 is the gateway, 255 broadcast
+NOISE_FLOOR_DBM = -117  # 125 kHz, 6 dB noise figure
+CAPTURE_VERSION = 1
+CAPTURE_FLAG_TX = 0x80
+FOREVER = 2 ** 64 - 1
+
+# SX1276 datasheet, 3.3 V supply
+CURRENT_MA = {
+    "tx": 120.0,  # PA_BOOST, 17 dBm
+    "rx": 10.8,
+    "cad": 10.8,
+    "standby": 1.6,
+    "sleep": 0.0002,
+    "off": 0.0,
+}
+SENSITIVITY_DBM = {7: -123, 8: -126, 9: -129, 10: -132, 11: -134.5, 12: -137}
+CAPTURE_DB = 6.0
+CONCENTRATOR_DEMODULATORS = 8
+
+
+def time_on_air(size, sf, bandwidth=125e3, coding_rate=5, preamble=8):
+    symbol = (2 ** sf) / bandwidth
+    low_data_rate = 1 if symbol > 0.016 else 0
+    numerator = 8 * size - 4 * sf + 28 + 16
+    symbols = 8 + max(math.ceil(numerator / (4.0 * (sf - 2 * low_data_rate))) * coding_rate, 0)
+    return (preamble + 4.25 + symbols) * symbol
+
+
+def wake_on_radio_preamble(period, sf, bandwidth=125e3):
+    """Downlink preamble in symbols for a node waking every period: one CAD falls in it, with room to sync."""
+    symbol = (2 ** sf) / bandwidth
+    return int(math.ceil(period / symbol)) + LBT_CAD_SYMBOLS + WOR_SYNC_SYMBOLS
+
+
+def wake_on_radio_model(period, sf, downlink_size, downlink_interval):
+    """Analytic latency and average receive current of a wake-on-radio node."""
+    symbol = (2 ** sf) / 125e3
+    wake = LBT_CAD_SYMBOLS * symbol + WOR_WAKE_OVERHEAD
+    downlink = time_on_air(downlink_size, sf, preamble=wake_on_radio_preamble(period, sf))
+    # the CAD detecting the preamble starts uniformly in its first period: RX until the end of the downlink
+    rx_per_downlink = downlink - period / 2.0
+    current = CURRENT_MA["rx"] * wake / period
+    if downlink_interval > 0:
+        current += CURRENT_MA["rx"] * rx_per_downlink / downlink_interval
+    return {
+        "preamble_symbols": wake_on_radio_preamble(period, sf),
+        "downlink_latency": downlink,
+        "rx_per_downlink": rx_per_downlink,
+        "listen_current_ua": 1000 * current,
+    }
+
+
+def capture_record(time, tx, sf, frf, rssi, snr, frame):
+    header = struct.pack("<BI", (CAPTURE_FLAG_TX if tx else 0) | sf, int(time * 1000) & 0xFFFFFFFF)
+    header += frf.to_bytes(3, "little") + struct.pack("<bbB", rssi, snr, len(frame))
+    return header + frame
+
+
+def write_capture(path, records):
+    with open(path, "wb") as out:
+        chunk = b""
+        for _, record in sorted(records, key=lambda r: r[0]):
+            if len(chunk) + len(record) > 0xFFFF:
+                out.write(b"LHC" + struct.pack("<BHH", CAPTURE_VERSION, 0, len(chunk)) + chunk)
+                chunk = b""
+            chunk += record
+        out.write(b"LHC" + struct.pack("<BHH", CAPTURE_VERSION, 0, len(chunk)) + chunk)
+
+
+class Transmission:
+    def __init__(self, program, start, fields):
+        self.program = program
+        self.frf = int(fields[0])
+        self.sf = int(fields[1])
+        bandwidth = int(fields[2])
+        self.power = int(fields[5])
+        self.iq = int(fields[6])
+        self.frame = bytes.fromhex(fields[7]) if len(fields) > 7 else b""
+        preamble = int(fields[4])
+        symbol = (2 ** self.sf) / float(bandwidth)
+        self.start = start
+        self.end = start + int(round(1e6 * time_on_air(len(self.frame), self.sf, bandwidth, int(fields[3]), preamble)))
+        # the receivers lock on the frame at the end of its preamble
+        self.sync = start + int(round(1e6 * (preamble + 4.25) * symbol))
+
+
+class Program:
+    """A node or the gateway: its process, its radio as seen by the channel, what it has done."""
+
+    def __init__(self, argv, node_id, position, demodulators):
+        self.process = subprocess.Popen(argv, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                        universal_newlines=True, bufsize=1)
+        self.node_id = node_id
+        self.position = position
+        self.demodulators = demodulators
+        self.mode = "off"
+        self.mode_since = 0
+        self.mode_time = collections.Counter()
+        self.rx = None
+        self.locks = []
+        # blocking request: "wait", "tx" or "cad", None while running
+        self.request = None
+        self.token = 0
+        # packets received and commands, given at the next wait
+        self.inbox = collections.deque()
+        self.tx_time = 0
+        self.stats = None
+
+    def set_mode(self, mode, time, rx=None):
+        self.mode_time[self.mode] += time - self.mode_since
+        self.mode = mode
+        self.mode_since = time
+        self.rx = rx
+        self.locks = []
+
+
+class Simulation:
+    def __init__(self, args, point, seed, capture=None):
+        self.args = args
+        self.capture = capture
+        self.records = []
+        self.rng = random.Random(seed)
+        self.seed = seed
+        nodes, self.payload, self.loss = point
+        self.loss_rng = random.Random(-seed)
+        self.now = 0
+        self.events = []
+        self.sequence = 0
+        self.active = []
+        self.horizon = 0
+        self.links = {}
+        self.generated = {}
+        self.delivered = {}
+        self.duplicates = 0
+        self.sent = collections.Counter()
+        self.airtime = collections.Counter()
+        self.downlinks = {}
+        self.downlink_latencies = []
+        self.downlink_id = 0
+        sfs = [int(sf) for sf in str(args.sf).split(",")]
+        interval = int(args.interval * 1000)
+        preamble = PREAMBLE_SYMBOLS
+        if args.rx_policy == "wake-on-radio":
+            preamble = wake_on_radio_preamble(args.wake_period, max(sfs))
+        self.gateway = Program([args.program, "gateway", str(int(args.frequency)), str(sfs[0]), str(preamble),
+                                "1" if args.rx_policy == "windows" else "0", str(args.downlink_payload)],
+                               0, (0.0, 0.0), CONCENTRATOR_DEMODULATORS if args.gateway == "concentrator" else 1)
+        self.programs = [self.gateway]
+        self.nodes = []
+        for index in range(nodes):
+            distance = args.radius * math.sqrt(self.rng.random())
+            angle = self.rng.uniform(0, 2 * math.pi)
+            # scheduler tasks start one interval after boot, boots are spread over one interval
+            boot = self.rng.randrange(max(interval, 1))
+            node = Program([args.program, "node", str(index + 1), str(self.rng.randrange(1, 256)), str(boot),
+                            str(interval), str(self.payload), str(sfs[index % len(sfs)]), args.rx_policy],
+                           index + 1, (distance * math.cos(angle), distance * math.sin(angle)), 1)
+            self.nodes.append(node)
+            self.programs.append(node)
+            if args.downlink_interval > 0:
+                self.schedule(self.expovariate(args.downlink_interval), "downlink", node)
+        self.schedule(int(args.duration * 1e6), "end", None)
+
+    def expovariate(self, mean):
+        return self.now + int(1e6 * self.rng.expovariate(1.0 / mean))
+
+    def schedule(self, time, kind, target, data=None):
+        self.sequence += 1
+        heapq.heappush(self.events, (time, self.sequence, kind, target, data))
+
+    def rssi(self, tx, program):
+        """RSSI of a transmission at a program: reciprocal links, shadowing drawn once per pair from the seed."""
+        key = (min(tx.program.node_id, program.node_id), max(tx.program.node_id, program.node_id))
+        if key not in self.links:
+            a, b = tx.program.position, program.position
+            distance = math.hypot(a[0] - b[0], a[1] - b[1])
+            self.links[key] = (40.0 + 10 * self.args.path_loss_exponent * math.log10(max(distance, 1.0)) +
+                               random.Random("%d-%d-%d" % (self.seed, key[0], key[1])).gauss(0, self.args.shadowing))
+        return tx.power - self.links[key]
+
+    def listening(self, program, tx):
+        """The program demodulates a frame with the settings of tx: concentrators on all channels and SF."""
+        if program.mode != "rx" or program is tx.program:
+            return False
+        frf, sf, iq = program.rx
+        if program is self.gateway and self.args.gateway == "concentrator":
+            return iq == tx.iq
+        return (frf, sf, iq) == (tx.frf, tx.sf, tx.iq)
+
+    def interferers(self, tx, start, end):
+        return [t for t in self.active if t is not tx and t.start < end and start < t.end and
+                (t.frf, t.sf, t.iq) == (tx.frf, tx.sf, tx.iq)]
+
+    def run(self):
+        for program in self.programs:
+            self.step(program)
+        while self.events:
+            self.now, _, kind, target, data = heapq.heappop(self.events)
+            if getattr(self, "on_" + kind)(target, data):
+                break
+        return self.report()
+
+    def reply(self, program, line):
+        program.request = None
+        program.process.stdin.write(line + "\n")
+        self.step(program)
+
+    def step(self, program):
+        """Read the requests of a program up to the next blocking one, at the current time."""
+        while True:
+            line = program.process.stdout.readline()
+            if not line:
+                raise RuntimeError("%s exited with %s" % (" ".join(program.process.args),
+                                                          program.process.wait()))
+            fields = line.split()
+            if not fields:
+                continue
+            kind = fields[0]
+            if kind == "ev":
+                self.on_program_event(program, fields[1:])
+            elif kind == "rx":
+                program.set_mode("rx", self.now, tuple(int(f) for f in fields[1:4]))
+            elif kind in ("standby", "sleep"):
+                program.set_mode(kind, self.now)
+            elif kind == "wait":
+                program.request = "wait"
+                if program.inbox:
+                    self.reply(program, program.inbox.popleft())
+                    return
+                until = int(fields[1])
+                program.token += 1
+                if until != FOREVER:
+                    self.schedule(until, "wake", program, program.token)
+                return
+            elif kind == "tx":
+                self.start_transmission(program, fields[1:])
+                return
+            elif kind == "cad":
+                program.request = "cad"
+                program.set_mode("cad", self.now)
+                symbol = 2 ** int(fields[2]) / 125e3
+                self.schedule(self.now + int(1e6 * LBT_CAD_SYMBOLS * symbol), "cad_end", program,
+                              (int(fields[1]), int(fields[2]), int(fields[3]), self.now))
+                return
+
+    def give(self, program, line):
+        """A packet or a command for a program: at once if it waits, at its next wait otherwise."""
+        if program.request == "wait":
+            program.token += 1
+            self.reply(program, line)
+        else:
+            program.inbox.append(line)
+
+    def start_transmission(self, program, fields):
+        program.request = "tx"
+        program.set_mode("tx", self.now)
+        tx = Transmission(program, self.now, fields)
+        program.tx_time += tx.end - tx.start
+        if program is not self.gateway:
+            self.airtime[tx.frf] += tx.end - tx.start
+        self.active.append(tx)
+        self.horizon = max(self.horizon, tx.end - tx.start)
+        if self.capture and program is self.gateway:
+            self.records.append((self.now / 1e6, capture_record(self.now / 1e6, True, tx.sf, tx.frf, 0, 0, tx.frame)))
+        self.schedule(tx.sync, "sync", tx)
+        self.schedule(tx.end, "tx_end", tx)
+
+    def on_sync(self, tx, _):
+        for program in self.programs:
+            if (self.listening(program, tx) and len(program.locks) < program.demodulators and
+                    self.rssi(tx, program) >= SENSITIVITY_DBM[tx.sf]):
+                program.locks.append(tx)
+
+    def on_tx_end(self, tx, _):
+        # forget the transmissions which cannot overlap anymore
+        self.active = [t for t in self.active if t.end > self.now - self.horizon]
+        for program in self.programs:
+            if tx not in program.locks:
+                continue
+            program.locks.remove(tx)
+            rssi = self.rssi(tx, program)
+            if any(rssi - self.rssi(other, program) < CAPTURE_DB for other in self.interferers(tx, tx.start, tx.end)):
+                continue
+            if self.loss and self.loss_rng.random() < self.loss:
+                continue
+            snr = int(max(-128, min(127, 4 * (rssi - NOISE_FLOOR_DBM))))
+            rssi = int(max(-128, min(127, round(rssi))))
+            if self.capture and program is self.gateway:
+                self.records.append((self.now / 1e6, capture_record(self.now / 1e6, False, tx.sf, tx.frf, rssi, snr,
+                                                                    tx.frame)))
+            self.give(program, "rx %d %d %d %d %d %s" % (self.now, tx.frf, tx.sf, rssi, snr, tx.frame.hex()))
+        tx.program.set_mode("standby", self.now)
+        self.reply(tx.program, "t %d" % self.now)
+
+    def on_cad_end(self, program, cad):
+        frf, sf, iq, start = cad
+        detected = any(t.program is not program and (t.frf, t.sf, t.iq) == (frf, sf, iq) and
+                       t.start < self.now and start < t.end and self.rssi(t, program) >= SENSITIVITY_DBM[sf]
+                       for t in self.active)
+        program.set_mode("standby", self.now)
+        self.reply(program, "cad %d %d" % (self.now, 1 if detected else 0))
+
+    def on_wake(self, program, token):
+        if program.request == "wait" and program.token == token:
+            self.reply(program, "t %d" % self.now)
+
+    def on_downlink(self, node, _):
+        """A downlink for the node is available at the gateway."""
+        self.downlink_id += 1
+        self.downlinks[self.downlink_id] = self.now
+        self.give(self.gateway, "dl %d %d %d" % (self.now, node.node_id, self.downlink_id))
+        self.schedule(self.expovariate(self.args.downlink_interval), "downlink", node)
+
+    def on_end(self, *_):
+        for program in self.programs:
+            program.set_mode("off", self.now)
+            program.process.stdin.write("end %d\n" % self.now)
+            program.process.stdin.close()
+            for line in program.process.stdout:
+                fields = line.split()
+                if fields and fields[0] == "stats":
+                    program.stats = [int(f) for f in fields[1:]]
+            program.process.wait()
+        return True
+
+    def on_program_event(self, program, fields):
+        if fields[0] == "gen":
+            self.generated[(program.node_id, int(fields[1]))] = self.now
+        elif fields[0] == "sent":
+            self.sent[int(fields[1])] += 1
+        elif fields[0] == "dl":
+            requested = self.downlinks.pop(int(fields[1]), None)
+            if requested is not None:
+                self.downlink_latencies.append((self.now - requested) / 1e6)
+        elif fields[0] == "up":
+            key = (int(fields[1]), int(fields[2]))
+            if key in self.delivered:
+                self.duplicates += 1
+            elif key in self.generated:
+                self.delivered[key] = (self.now - self.generated[key]) / 1e6
+
+    def report(self):
+        if self.capture:
+            write_capture(self.capture, self.records)
+        duration = self.args.duration * 1e6
+        generated = len(self.generated)
+        latencies = sorted(self.delivered.values())
+        downlink_latencies = sorted(self.downlink_latencies)
+        requested = len(self.downlink_latencies) + len(self.downlinks)
+        day = 86400e6 / duration
+        energy = [sum(CURRENT_MA[mode] * time for mode, time in n.mode_time.items()) / 3600e6 * day for n in self.nodes]
+        stats = [sum(values) for values in zip(*(n.stats for n in self.nodes if n.stats))]
+        uplinks = float(sum(self.sent.values()))
+
+        def percentile(values, p):
+            return values[min(int(len(values) * p / 100.0), len(values) - 1)] if values else None
+
+        def per_uplink(counter):
+            # LH_STAT_xxx order of LoRaHomeStats.h
+            return stats[counter] / uplinks if stats and uplinks else None
+
+        return {
+            "nodes": len(self.nodes),
+            "payload": self.payload,
+            "loss": self.loss,
+            "generated": generated,
+            "delivery_ratio": len(latencies) / float(generated) if generated else None,
+            "ack_ratio": self.sent[1] / uplinks if uplinks else None,
+            "duplicates": self.duplicates,
+            "latency_p50": percentile(latencies, 50),
+            "latency_p90": percentile(latencies, 90),
+            "latency_p99": percentile(latencies, 99),
+            "frames_per_uplink": per_uplink(0),
+            "lbt_busy_per_uplink": per_uplink(4),
+            "channel_load": [self.airtime[f] / duration for f in sorted(self.airtime)],
+            "node_duty_cycle_max": max(n.tx_time for n in self.nodes) / duration if self.nodes else 0,
+            "energy_mah_per_day_mean": sum(energy) / len(energy) if energy else 0,
+            "downlink_ratio": len(downlink_latencies) / float(requested) if requested else None,
+            "downlink_latency_p50": percentile(downlink_latencies, 50),
+            "downlink_latency_p99": percentile(downlink_latencies, 99),
+        }
+
+
+def run_one(job):
+    args, point, seed, capture = job
+    return Simulation(args, point, seed, capture).run()
+
+
+def merge(results):
+    point = ("nodes", "payload", "loss")
+    merged = dict((key, results[0][key]) for key in point)
+    merged["replicas"] = len(results)
+    for key in results[0]:
+        values = [r[key] for r in results if r[key] is not None]
+        if key in point or not values:
+            continue
+        if isinstance(values[0], list):
+            # channels without uplink in a run are missing from its list
+            merged[key] = [sum(v[i] for v in values if i < len(v)) / len(values)
+                           for i in range(max(len(v) for v in values))]
+        else:
+            merged[key] = sum(values) / len(values)
+    return merged
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--program", default=".pio/build/netsim/program", help="node build of pio run -e netsim")
+    parser.add_argument("--nodes", default="100", help="number of nodes, comma separated for a sweep")
+    parser.add_argument("--sf", default="7", help="spreading factor, comma separated to spread the nodes over several SF")
+    parser.add_argument("--interval", type=float, default=600, help="uplink interval in s")
+    parser.add_argument("--payload", default="10",
+                        help="JSON payload size in bytes, fragmented above one frame, comma separated for a sweep")
+    parser.add_argument("--loss", default="0", help="probability of losing a frame received, comma separated for a sweep")
+    parser.add_argument("--frequency", type=float, default=LORA_FREQUENCY,
+                        help="gateway and downlink channel in Hz, the first channel of the plan")
+    parser.add_argument("--gateway", choices=["sx127x", "concentrator"], default="concentrator")
+    parser.add_argument("--rx-policy", choices=["continuous", "windows", "wake-on-radio"], default="continuous")
+    parser.add_argument("--wake-period", type=float, default=1.0, help="WOR_PERIOD of the build in s")
+    parser.add_argument("--downlink-interval", type=float, default=0,
+                        help="mean interval between two downlinks to a node in s, 0 for none")
+    parser.add_argument("--downlink-payload", type=int, default=10, help="downlink JSON payload size in bytes")
+    parser.add_argument("--duration", type=float, default=86400, help="simulated time in s")
+    parser.add_argument("--radius", type=float, default=2000, help="radius of the node area in m")
+    parser.add_argument("--path-loss-exponent", type=float, default=2.7)
+    parser.add_argument("--shadowing", type=float, default=6, help="log-normal shadowing sigma in dB")
+    parser.add_argument("--replicas", type=int, default=4, help="runs with different seeds per point")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--workers", type=int, default=multiprocessing.cpu_count())
+    parser.add_argument("--json", action="store_true", help="machine readable output")
+    parser.add_argument("--capture", help="binary capture file of the gateway traffic of the first run")
+    args = parser.parse_args()
+
+    points = [(int(n), int(p), float(l)) for n in args.nodes.split(",") for p in args.payload.split(",")
+              for l in args.loss.split(",")]
+    if max(point[0] for point in points) > NODE_ID_MAX:
+        sys.exit("at most %d nodes: node ids are 1 byte" % NODE_ID_MAX)
+    if not os.access(args.program, os.X_OK):
+        sys.exit("%s not found: pio run -e netsim" % args.program)
+    jobs = [(args, point, args.seed + r, None) for point in points for r in range(args.replicas)]
+    jobs[0] = jobs[0][:3] + (args.capture,)
+    with multiprocessing.Pool(args.workers) as pool:
+        results = pool.map(run_one, jobs)
+    merged = [merge(results[i * args.replicas:(i + 1) * args.replicas]) for i in range(len(points))]
+    model = None
+    if args.rx_policy == "wake-on-radio":
+        sf = max(int(sf) for sf in str(args.sf).split(","))
+        model = wake_on_radio_model(args.wake_period, sf, 8 + args.downlink_payload + 2, args.downlink_interval)
+    if args.json:
+        print(json.dumps({"results": merged, "model": model} if model else merged, indent=2))
+        return
+    print("%6s %8s %6s %9s %9s %8s %8s %7s %7s %8s %9s %10s" % (
+        "nodes", "payload", "loss", "delivery", "acked", "lat p50", "lat p99", "frames", "busy", "load", "dutycyc",
+        "mAh/day"))
+    for m in merged:
+        print("%6d %8d %5.0f%% %8.1f%% %8.1f%% %7.2fs %7.2fs %7.2f %7.2f %7.1f%% %8.2f%% %10.2f" % (
+            m["nodes"], m["payload"], 100 * m["loss"], 100 * m.get("delivery_ratio", 0), 100 * m.get("ack_ratio", 0),
+            m.get("latency_p50", 0), m.get("latency_p99", 0), m.get("frames_per_uplink", 0),
+            m.get("lbt_busy_per_uplink", 0), 100 * max(m.get("channel_load", [0])),
+            100 * m["node_duty_cycle_max"], m["energy_mah_per_day_mean"]))
+    if args.downlink_interval > 0:
+        print("%6s %8s %6s %9s %8s %8s" % ("nodes", "payload", "loss", "dl recv", "dl p50", "dl p99"))
+        for m in merged:
+            print("%6d %8d %5.0f%% %8.1f%% %7.2fs %7.2fs" % (
+                m["nodes"], m["payload"], 100 * m["loss"], 100 * m.get("downlink_ratio", 0),
+                m.get("downlink_latency_p50", 0), m.get("downlink_latency_p99", 0)))
+    if model:
+        print("wake-on-radio model: preamble %d symbols, downlink latency %.2fs, listening %.1f uA (%.2f mAh/day)" % (
+            model["preamble_symbols"], model["downlink_latency"], model["listen_current_ua"],
+            model["listen_current_ua"] * 24 / 1000))
+
+
+if __name__ == "__main__":
+    main()
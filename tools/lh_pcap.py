@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Convert LoRa Home packet captures to pcap.
+
+Inputs (files or stdin), in any mix:
+- binary dumps of the RAM ring (-D LH_CAPTURE, 'c' key on the serial
+  monitor). Text printed around the dumps (DEBUG messages) is skipped.
+- capture lines of LoRaHomeRadioRecorder: "rx,<ms>,<rssi>,<snr>,<hex>"
+  and "tx,<ms>,<hex>"
+- captures of the network simulator (lh_netsim.py --capture)
+
+Packets are written with the LINKTYPE_USER0 (147) link type. Each packet
+starts with a LoRa Home pseudo-header, multi-byte fields LSB first:
+  version (1), flags (bit 7: tx, bits 3..0: SF), RSSI (dBm, int8),
+  SNR (0.25 dB, int8), frequency (Hz, 4 bytes)
+followed by the LoRa Home frame. tools/lh_dissector.lua decodes them:
+  wireshark -X lua_script:tools/lh_dissector.lua capture.pcap
+
+Example: lh_pcap.py serial.log -o capture.pcap
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+MAGIC = b"LHC"
+CAPTURE_VERSION = 1
+CAPTURE_HEADER = struct.Struct("<3sBHH")
+RECORD_HEADER = struct.Struct("<BI3sbbB")
+FLAG_TX = 0x80
+LINKTYPE_USER0 = 147
+PSEUDO_HEADER = struct.Struct("<BBbbI")
+PSEUDO_HEADER_VERSION = 1
+CAPTURE_LINE = re.compile(rb"^(rx),(\d+),(-?\d+),(-?\d+),([0-9a-fA-F]*)\s*$|^(tx),(\d+),([0-9a-fA-F]*)\s*$", re.M)
+
+
+def frf_to_frequency(frf):
+    # SX127x: frequency = FRF x 32 MHz / 2^19
+    return frf * 32000000 // 2 ** 19
+
+
+def parse_dumps(data):
+    """Return the packets of the binary dumps and the data left around them."""
+    packets = []
+    text = []
+    dropped = 0
+    position = 0
+    while True:
+        start = data.find(MAGIC + bytes([CAPTURE_VERSION]), position)
+        if start < 0 or start + CAPTURE_HEADER.size > len(data):
+            text.append(data[position:])
+            break
+        text.append(data[position:start])
+        _, _, lost, size = CAPTURE_HEADER.unpack_from(data, start)
+        dropped += lost
+        index = start + CAPTURE_HEADER.size
+        end = min(index + size, len(data))
+        while index + RECORD_HEADER.size <= end:
+            flags, millis, frf, rssi, snr, length = RECORD_HEADER.unpack_from(data, index)
+            index += RECORD_HEADER.size
+            frame = data[index:index + length]
+            index += length
+            packets.append((millis, flags, rssi, snr, frf_to_frequency(int.from_bytes(frf, "little")), frame))
+        position = end
+    return packets, b"".join(text), dropped
+
+
+def parse_lines(text):
+    packets = []
+    for match in CAPTURE_LINE.finditer(text):
+        if match.group(1):
+            packets.append((int(match.group(2)), 0, int(match.group(3)), int(match.group(4)), 0,
+                            bytes.fromhex(match.group(5).decode())))
+        else:
+            packets.append((int(match.group(7)), FLAG_TX, 0, 0, 0, bytes.fromhex(match.group(8).decode())))
+    return packets
+
+
+def write_pcap(out, packets, start):
+    out.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, 65535, LINKTYPE_USER0))
+    for millis, flags, rssi, snr, frequency, frame in packets:
+        record = PSEUDO_HEADER.pack(PSEUDO_HEADER_VERSION, flags,
+                                    max(-128, min(127, rssi)), max(-128, min(127, snr)), frequency) + frame
+        seconds, ms = divmod(millis, 1000)
+        out.write(struct.pack("<IIII", start + seconds, ms * 1000, len(record), len(record)))
+        out.write(record)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("inputs", nargs="*", default=["-"], help="capture files, - for stdin")
+    parser.add_argument("-o", "--output", required=True, help="pcap file to write")
+    parser.add_argument("--start", type=int, default=0,
+                        help="UNIX time of the node boot: packet times are millis() since boot")
+    args = parser.parse_args()
+
+    packets = []
+    dropped = 0
+    for name in args.inputs:
+        data = sys.stdin.buffer.read() if name == "-" else open(name, "rb").read()
+        binary, text, lost = parse_dumps(data)
+        packets += binary + parse_lines(text)
+        dropped += lost
+    with open(args.output, "wb") as out:
+        write_pcap(out, packets, args.start)
+    print("%d packets written, %d dropped by the node ring" % (len(packets), dropped), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Summarize the LoRaHomeProfiler histograms (-D LH_PROFILER).
+
+Reads the "prof,<stage>,<b0>,...,<b19>" lines dumped on the serial monitor
+('p' key) from a capture file or stdin and prints per stage percentiles.
+Percentiles are bucket upper bounds, i.e. log2 resolution.
+
+--json prints the same summary as JSON, tagged with --label (e.g. the
+firmware version), to keep the results of successive firmware versions and
+compare them.
+
+--budget stage=us (repeatable) and --min-stack bytes check the p99 of the
+stages and the stack headroom ("stack,<bytes>" line): the exit code is 1
+if a budget is exceeded.
+
+The max lateness of the scheduler tasks ("jitter,<task>,<ms>" lines) is
+printed too. Tasks 0 and 1 are the processing and transmission tasks.
+"""
+
+import argparse
+import json
+import sys
+
+STAGES = ["json_build", "serialize", "lbt", "fifo_upload", "time_on_air",
+          "turnaround", "ack_wait", "fifo_read", "decode", "json_parse",
+          "app_callback"]
+TASKS = ["processing", "transmission"]
+BUCKETS = 20
+
+
+def bucket_upper_bound(bucket):
+    # bucket 0: < 8 us, bucket i: [2^(i+2), 2^(i+3)) us, last bucket open ended
+    if bucket == BUCKETS - 1:
+        return float("inf")
+    return 2 ** (bucket + 3)
+
+
+def percentile(counts, p):
+    total = sum(counts)
+    rank = total * p / 100.0
+    seen = 0
+    for bucket, count in enumerate(counts):
+        seen += count
+        if count and seen >= rank:
+            return bucket_upper_bound(bucket)
+    return 0
+
+
+def format_us(value):
+    if value == float("inf"):
+        return ">2.1s"
+    if value >= 1000:
+        return "%dms" % (value // 1000)
+    return "%dus" % value
+
+
+def stage_name(stage):
+    return STAGES[stage] if stage < len(STAGES) else str(stage)
+
+
+def task_name(task):
+    return TASKS[task] if task < len(TASKS) else "task %d" % task
+
+
+def check_budgets(histograms, stack, budgets, min_stack):
+    ok = True
+    for budget in budgets:
+        name, limit = budget.split("=")
+        stage = STAGES.index(name)
+        if stage not in histograms:
+            continue
+        p99 = percentile(histograms[stage], 99)
+        if p99 > int(limit):
+            print("budget exceeded: %s p99 %s > %sus" % (name, format_us(p99), limit), file=sys.stderr)
+            ok = False
+    if min_stack is not None and stack is not None and stack < min_stack:
+        print("budget exceeded: stack headroom %d < %d bytes" % (stack, min_stack), file=sys.stderr)
+        ok = False
+    return ok
+
+
+def print_json(histograms, stack, jitter, label):
+    stages = {}
+    for stage, counts in sorted(histograms.items()):
+        stages[stage_name(stage)] = {
+            "count": sum(counts),
+            # upper bounds in us, null for the open ended last bucket
+            "p50": percentile(counts, 50),
+            "p90": percentile(counts, 90),
+            "p99": percentile(counts, 99),
+            "histogram": counts,
+        }
+        for key in ("p50", "p90", "p99"):
+            if stages[stage_name(stage)][key] == float("inf"):
+                stages[stage_name(stage)][key] = None
+    jitter = {task_name(task): ms for task, ms in sorted(jitter.items())}
+    print(json.dumps({"label": label, "stack_headroom": stack, "stages": stages, "task_jitter_ms": jitter},
+                     indent=2))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="serial capture, stdin if omitted")
+    parser.add_argument("--json", action="store_true", help="machine readable output")
+    parser.add_argument("--label", default="", help="label of the results, e.g. firmware version")
+    parser.add_argument("--budget", action="append", default=[], metavar="STAGE=US",
+                        help="max p99 of a stage in us")
+    parser.add_argument("--min-stack", type=int, help="min stack headroom in bytes")
+    args = parser.parse_args()
+    stream = open(args.capture) if args.capture else sys.stdin
+    histograms = {}
+    stack = None
+    jitter = {}
+    for line in stream:
+        fields = line.strip().split(",")
+        if len(fields) == 2 and fields[0] == "stack":
+            stack = int(fields[1])
+        if len(fields) == 3 and fields[0] == "jitter":
+            jitter[int(fields[1])] = int(fields[2])
+        if len(fields) != BUCKETS + 2 or fields[0] != "prof":
+            continue
+        histograms[int(fields[1])] = [int(f) for f in fields[2:]]
+    ok = check_budgets(histograms, stack, args.budget, args.min_stack)
+    if args.json:
+        print_json(histograms, stack, jitter, args.label)
+        sys.exit(0 if ok else 1)
+    print("%-13s %7s %7s %7s %7s" % ("stage", "count", "p50", "p90", "p99"))
+    for stage, counts in sorted(histograms.items()):
+        name = stage_name(stage)
+        print("%-13s %7d %7s %7s %7s" % (name, sum(counts),
+                                         format_us(percentile(counts, 50)),
+                                         format_us(percentile(counts, 90)),
+                                         format_us(percentile(counts, 99))))
+    if stack is not None:
+        print("stack headroom: %d bytes" % stack)
+    for task, ms in sorted(jitter.items()):
+        print("%s task max jitter: %d ms" % (task_name(task), ms))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()